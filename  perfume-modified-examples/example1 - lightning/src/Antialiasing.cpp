@@ -0,0 +1,263 @@
+#include "Antialiasing.h"
+
+Antialiasing *Antialiasing::active = NULL;
+
+// frames after every mode switch of the benchmark that are not counted, while buffers are reallocated and drivers settle
+static const int WARMUP_FRAMES = 30;
+
+// the window position of the vertex, multiplied by w so that perspective correct interpolation leaves it linear in
+// window space; the fragment shader divides it out again
+static const char *vertexSource =
+	"#version 120\n"
+	"uniform vec4 viewport;\n"
+	"varying vec3 center;\n"
+	"void main() {\n"
+	"	gl_FrontColor = gl_Color;\n"
+	"	gl_Position = ftransform();\n"
+	"	vec2 window = viewport.xy + (gl_Position.xy / gl_Position.w * 0.5 + 0.5) * viewport.zw;\n"
+	"	center = vec3(window * gl_Position.w, gl_Position.w);\n"
+	"}\n";
+
+// primitive is 1 for points and 2 for lines, whose size is 2 * radius + 1 pixels; anything else is drawn unchanged
+static const char *fragmentSource =
+	"#version 120\n"
+	"uniform int primitive;\n"
+	"uniform float radius;\n"
+	"varying vec3 center;\n"
+	"void main() {\n"
+	"	float coverage = 1.0;\n"
+	"	if (primitive == 1)\n"
+	"		coverage = clamp(radius + 0.5 - length(gl_PointCoord - 0.5) * (2.0 * radius + 1.0), 0.0, 1.0);\n"
+	"	else if (primitive == 2)\n"
+	"		coverage = clamp(radius + 0.5 - length(gl_FragCoord.xy - center.xy / center.z), 0.0, 1.0);\n"
+	"	gl_FragColor = vec4(gl_Color.rgb, gl_Color.a * coverage);\n"
+	"}\n";
+
+void Antialiasing::setup(int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+
+		if (arg == "--antialiasing" && i + 1 < argc)
+		{
+			string name = argv[++i];
+
+			for (int m = 0; m < NUM_MODES; m++)
+			{
+				if (name == getModeName((Mode)m))
+					mode = (Mode)m;
+			}
+		}
+		else if (arg == "--samples" && i + 1 < argc)
+		{
+			samples = ofToInt(argv[++i]);
+		}
+		else if (arg == "--aa-benchmark" && i + 1 < argc)
+		{
+			benchmarkFrames = ofToInt(argv[++i]);
+		}
+	}
+}
+
+void Antialiasing::start()
+{
+	shaderLoaded = shader.setupShaderFromSource(GL_VERTEX_SHADER, vertexSource)
+		&& shader.setupShaderFromSource(GL_FRAGMENT_SHADER, fragmentSource)
+		&& shader.linkProgram();
+
+	if (!shaderLoaded)
+		ofLogWarning("Antialiasing", "could not compile the shader");
+
+	setMode(mode);
+
+	if (benchmarkFrames > 0)
+	{
+		benchmarkStart = mode;
+		for (int m = 0; m < NUM_MODES; m++)
+			frameTimes[m] = 0;
+		frame = 0;
+
+		// as many frames as the driver can draw
+		ofSetFrameRate(0);
+		ofSetVerticalSync(false);
+
+		mode = SMOOTH;
+		ofLogNotice("Antialiasing", "benchmark: " + ofToString(benchmarkFrames) + " frames in each mode");
+	}
+}
+
+string Antialiasing::getModeName(Mode mode)
+{
+	switch (mode)
+	{
+	case SMOOTH: return "smooth";
+	case MULTISAMPLE: return "msaa";
+	case SHADER: return "shader";
+	default: return "";
+	}
+}
+
+bool Antialiasing::isSupported(Mode mode) const
+{
+	if (mode == MULTISAMPLE)
+		return samples > 0 && ofFbo::maxSamples() > 0;
+	if (mode == SHADER)
+		return shaderLoaded;
+	return true;
+}
+
+void Antialiasing::setMode(Mode mode)
+{
+	if (!isSupported(mode))
+	{
+		ofLogWarning("Antialiasing", getModeName(mode) + " is not supported, using smooth");
+		mode = SMOOTH;
+	}
+
+	if (mode == MULTISAMPLE)
+		samples = MIN(samples, ofFbo::maxSamples());
+
+	this->mode = mode;
+}
+
+void Antialiasing::nextMode()
+{
+	Mode next = mode;
+	do
+	{
+		next = (Mode)((next + 1) % NUM_MODES);
+	}
+	while (!isSupported(next));
+
+	mode = next;
+}
+
+void Antialiasing::begin()
+{
+	active = this;
+
+	if (mode == SMOOTH)
+	{
+		glEnable(GL_LINE_SMOOTH);
+		glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
+		glEnable(GL_POINT_SMOOTH);
+		glHint(GL_POINT_SMOOTH_HINT, GL_NICEST);
+	}
+	else if (mode == MULTISAMPLE)
+	{
+		glEnable(GL_MULTISAMPLE);
+	}
+	else if (mode == SHADER)
+	{
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+
+		// gl_PointCoord is only defined for point sprites
+		glEnable(GL_POINT_SPRITE);
+
+		shader.begin();
+		shader.setUniform4f("viewport", viewport[0], viewport[1], viewport[2], viewport[3]);
+		shader.setUniform1i("primitive", 0);
+	}
+}
+
+void Antialiasing::end()
+{
+	if (mode == SMOOTH)
+	{
+		glDisable(GL_LINE_SMOOTH);
+		glDisable(GL_POINT_SMOOTH);
+	}
+	else if (mode == MULTISAMPLE)
+	{
+		glDisable(GL_MULTISAMPLE);
+	}
+	else if (mode == SHADER)
+	{
+		shader.end();
+		glDisable(GL_POINT_SPRITE);
+	}
+
+	active = NULL;
+}
+
+void Antialiasing::lineWidth(float width)
+{
+	if (active == NULL || active->mode != SHADER)
+	{
+		glLineWidth(width);
+		return;
+	}
+
+	// a pixel wider, for the faded edge
+	glLineWidth(width + 1);
+	active->shader.setUniform1i("primitive", 2);
+	active->shader.setUniform1f("radius", width * 0.5);
+}
+
+void Antialiasing::pointSize(float size)
+{
+	if (active == NULL || active->mode != SHADER)
+	{
+		glPointSize(size);
+		return;
+	}
+
+	glPointSize(size + 1);
+	active->shader.setUniform1i("primitive", 1);
+	active->shader.setUniform1f("radius", size * 0.5);
+}
+
+bool Antialiasing::update()
+{
+	if (benchmarkFrames == 0)
+		return false;
+
+	frame++;
+	if (frame > WARMUP_FRAMES)
+		frameTimes[mode] += ofGetLastFrameTime();
+
+	if (frame < WARMUP_FRAMES + benchmarkFrames)
+		return false;
+
+	frame = 0;
+
+	// the next supported mode, or the end of the benchmark
+	int next = mode + 1;
+	while (next < NUM_MODES && !isSupported((Mode)next))
+		next++;
+
+	if (next < NUM_MODES)
+	{
+		mode = (Mode)next;
+		return true;
+	}
+
+	logBenchmark();
+
+	benchmarkFrames = 0;
+	mode = benchmarkStart;
+	ofSetFrameRate(60);
+	ofSetVerticalSync(true);
+
+	return true;
+}
+
+void Antialiasing::logBenchmark()
+{
+	for (int m = 0; m < NUM_MODES; m++)
+	{
+		if (!isSupported((Mode)m))
+		{
+			ofLogNotice("Antialiasing", getModeName((Mode)m) + ": not supported");
+			continue;
+		}
+
+		double ms = frameTimes[m] / benchmarkFrames * 1000;
+		string line = getModeName((Mode)m) + ": " + ofToString(ms, 2) + " ms per frame";
+		if (m == MULTISAMPLE)
+			line += " (" + ofToString(samples) + " samples)";
+		ofLogNotice("Antialiasing", line);
+	}
+}
@@ -0,0 +1,153 @@
+#include "ContactDetector.h"
+
+// bones per figure at most, for telling bones of different figures apart in one number
+static const int MAX_BONES = 1024;
+// squared length below which a bone counts as a point
+static const float EPSILON = 1e-6;
+
+void ContactDetector::clear()
+{
+	capsules.clear();
+}
+
+void ContactDetector::addFigure(const vector<ofVec3f> &segments, float radius, int figure)
+{
+	float grow = radius + margin * 0.5;
+	for (int i = 0; i + 1 < segments.size(); i += 2)
+	{
+		Capsule c;
+		c.a = segments[i];
+		c.b = segments[i + 1];
+		c.radius = radius;
+		c.figure = figure;
+		c.bone = i / 2;
+		c.min.set(MIN(c.a.x, c.b.x) - grow, MIN(c.a.y, c.b.y) - grow, MIN(c.a.z, c.b.z) - grow);
+		c.max.set(MAX(c.a.x, c.b.x) + grow, MAX(c.a.y, c.b.y) + grow, MAX(c.a.z, c.b.z) + grow);
+		capsules.push_back(c);
+	}
+}
+
+void ContactDetector::sort()
+{
+	// a different set of capsules starts over from their order of addition
+	if (order.size() != capsules.size())
+	{
+		order.resize(capsules.size());
+		for (int i = 0; i < order.size(); i++)
+			order[i] = i;
+	}
+
+	// insertion sort, close to linear on last frame's nearly sorted order
+	for (int i = 1; i < order.size(); i++)
+	{
+		int item = order[i];
+		float x = capsules[item].min.x;
+		int j = i - 1;
+		while (j >= 0 && capsules[order[j]].min.x > x)
+		{
+			order[j + 1] = order[j];
+			j--;
+		}
+		order[j + 1] = item;
+	}
+}
+
+void ContactDetector::update()
+{
+	sort();
+
+	contacts.clear();
+	touched.swap(touching);
+	touching.clear();
+
+	for (int i = 0; i < order.size(); i++)
+	{
+		const Capsule &c = capsules[order[i]];
+		// the boxes after this one in the order that start before it ends along x
+		for (int j = i + 1; j < order.size(); j++)
+		{
+			const Capsule &d = capsules[order[j]];
+			if (d.min.x > c.max.x)
+				break;
+			if (c.figure == d.figure)
+				continue;
+			if (d.min.y > c.max.y || d.max.y < c.min.y || d.min.z > c.max.z || d.max.z < c.min.z)
+				continue;
+
+			ofVec3f onC, onD;
+			float reach = c.radius + d.radius + margin;
+			float distance = closestPoints(c.a, c.b, d.a, d.b, onC, onD);
+			if (distance > reach * reach)
+				continue;
+
+			const Capsule &first = c.figure < d.figure ? c : d;
+			const Capsule &second = c.figure < d.figure ? d : c;
+			BoneContact contact;
+			contact.figureA = first.figure;
+			contact.boneA = first.bone;
+			contact.figureB = second.figure;
+			contact.boneB = second.bone;
+			contact.position = (onC + onD) * 0.5;
+			contact.distance = sqrt(distance);
+			contacts.push_back(contact);
+			touching.insert(make_pair(first.figure * MAX_BONES + first.bone, second.figure * MAX_BONES + second.bone));
+		}
+	}
+
+	// reported after the sweep, so listeners see all of them in getContacts()
+	for (int i = 0; i < contacts.size(); i++)
+	{
+		BoneContact &contact = contacts[i];
+		if (touched.count(make_pair(contact.figureA * MAX_BONES + contact.boneA, contact.figureB * MAX_BONES + contact.boneB)) == 0)
+			ofNotifyEvent(contactBegan, contact);
+	}
+}
+
+// from Ericson, Real-Time Collision Detection, 5.1.9
+float ContactDetector::closestPoints(const ofVec3f &a0, const ofVec3f &a1, const ofVec3f &b0, const ofVec3f &b1, ofVec3f &onA, ofVec3f &onB)
+{
+	ofVec3f da = a1 - a0, db = b1 - b0, r = a0 - b0;
+	float a = da.dot(da), e = db.dot(db), f = db.dot(r);
+	float s, t;
+
+	if (a <= EPSILON && e <= EPSILON)
+	{
+		s = t = 0;
+	}
+	else if (a <= EPSILON)
+	{
+		s = 0;
+		t = ofClamp(f / e, 0, 1);
+	}
+	else
+	{
+		float c = da.dot(r);
+		if (e <= EPSILON)
+		{
+			t = 0;
+			s = ofClamp(-c / a, 0, 1);
+		}
+		else
+		{
+			float b = da.dot(db);
+			float denominator = a * e - b * b;
+			// parallel segments: any s will do
+			s = denominator > 0 ? ofClamp((b * f - c * e) / denominator, 0, 1) : 0;
+			t = (b * s + f) / e;
+			if (t < 0)
+			{
+				t = 0;
+				s = ofClamp(-c / a, 0, 1);
+			}
+			else if (t > 1)
+			{
+				t = 1;
+				s = ofClamp((b - c) / a, 0, 1);
+			}
+		}
+	}
+
+	onA = a0 + da * s;
+	onB = b0 + db * t;
+	return onA.squareDistance(onB);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "ofMain.h"
+#include <set>
+
+// two bones of different figures closer than their radii plus the margin
+struct BoneContact
+{
+	// figureA is the lower number; a bone is a pair of points in the figure's segments, bone i at 2 * i and 2 * i + 1
+	int figureA, boneA;
+	int figureB, boneB;
+	// halfway between the nearest points of the two bones
+	ofVec3f position;
+	// between the bones' center lines
+	float distance;
+};
+
+// Finds where the limbs of different figures come close, and reports each such contact once, when it begins.  Every
+// bone of every pose is a capsule; a sweep and prune along x pairs up the capsules whose boxes overlap, and only those
+// pairs get the exact distance between their segments.  The capsules keep their order along x from frame to frame, and
+// as the poses move only a little in between, putting them back in order takes about one pass.
+//
+//   ofAddListener(contacts.contactBegan, this, &Tracker::contactBegan);
+//   ...
+//   contacts.clear();
+//   contacts.addFigure(bones, 6, figure);   // for every figure, in the same order every frame
+//   contacts.update();                      // notifies contactBegan for the new contacts
+class ContactDetector
+{
+public:
+
+	ContactDetector() : margin(0) {}
+
+	// how close, beyond touching, two capsules count as in contact
+	void setMargin(float margin) { this->margin = margin; }
+
+	void clear();
+	// a capsule of the given radius around every pair of points, as the bone segments Tracker keeps for a pose
+	void addFigure(const vector<ofVec3f> &segments, float radius, int figure);
+	// finds the contacts between the figures added since clear(), and notifies contactBegan for each that was not
+	// there the last time
+	void update();
+
+	// all contacts found by the last update()
+	const vector<BoneContact> &getContacts() const { return contacts; }
+	int getNumCapsules() const { return capsules.size(); }
+
+	ofEvent<BoneContact> contactBegan;
+
+protected:
+
+	struct Capsule
+	{
+		ofVec3f a, b;
+		float radius;
+		int figure, bone;
+		// bounding box, grown by half the margin
+		ofVec3f min, max;
+	};
+
+	float margin;
+	vector<Capsule> capsules;
+	// capsule numbers by the low end of their boxes along x
+	vector<int> order;
+
+	vector<BoneContact> contacts;
+	// the pairs of bones in contact, by figure and bone, now and the last time
+	set< pair<int, int> > touching, touched;
+
+	void sort();
+	// the squared distance between the segments from a0 to a1 and from b0 to b1, and the nearest points on them
+	static float closestPoints(const ofVec3f &a0, const ofVec3f &a1, const ofVec3f &b0, const ofVec3f &b1, ofVec3f &onA, ofVec3f &onB);
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "ofMain.h"
+#include "GpuTimer.h"
+
+// Picks the resolution the scene is drawn at from how long the GPU takes for a frame, so the show keeps up with the
+// display when effects peak and returns to full resolution when they calm down.  The scale is one of a few fixed
+// levels, so buffers are only reallocated when it changes, and it changes reluctantly:
+//
+//   - down a level when the GPU time has been over the budget for a number of frames in a row
+//   - up a level when the GPU time, scaled by the pixel count of the level above, would have stayed well under the
+//     budget for a longer run of frames
+//   - not at all for a while after a change, until the timer reflects the new size
+//
+//   resolution.begin();
+//   ...                                 // everything drawn for the frame
+//   resolution.end();
+//   ...
+//   if (resolution.update())            // once per frame
+//       allocate buffers at resolution.getScale() times the window size
+//
+// With a QualityGovernor on the same frames, the governor goes first: update(!quality.isCutting(), quality.isFull())
+// keeps the resolution while the governor is still cutting the effects, and raises it only once they are all back.
+//
+// From the command line: --gpu-budget <milliseconds>, 0 to turn it off.  Needs ARB_timer_query; without it the scale
+// stays at 1.
+class DynamicResolution
+{
+public:
+
+	DynamicResolution() : enabled(true), budget(0.014), level(0), smoothed(0), over(0), under(0), settle(0) {}
+
+	// reads the option above from the command line
+	void setup(int argc, char *argv[]);
+
+	void setEnabled(bool enabled);
+	bool isEnabled() const { return enabled && GpuTimer::isSupported(); }
+
+	// seconds of GPU time a frame may take
+	void setBudget(float budget) { this->budget = budget; }
+	float getBudget() const { return budget; }
+
+	// bracket the GPU work of a frame
+	void begin() { timer.begin(); }
+	void end() { timer.end(); }
+
+	// call once per frame; returns true when the scale changed.  The GPU time is followed either way, but the scale
+	// only drops if mayDrop and only rises if mayRise.
+	bool update(bool mayDrop = true, bool mayRise = true);
+
+	// fraction of the window size the scene should be drawn at
+	float getScale() const { return SCALES[level]; }
+	// 0 is full resolution
+	int getLevel() const { return level; }
+	int getNumLevels() const { return NUM_LEVELS; }
+	// recent GPU time per frame in seconds, smoothed over a few frames
+	float getGpuTime() const { return smoothed; }
+
+protected:
+
+	static const int NUM_LEVELS = 5;
+	static const float SCALES[NUM_LEVELS];
+
+	bool enabled;
+	float budget;
+	int level;
+
+	GpuTimer timer;
+	float smoothed;
+	// consecutive frames over the budget, and under it with room for the level above
+	int over, under;
+	// frames to wait after a change
+	int settle;
+
+	void setLevel(int level);
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "ofMain.h"
+
+// A slowly changing velocity field on a coarse 3D grid, for things that should drift and swirl through the scene.  The
+// velocities are the curl of three noise fields, so the flow has no sources or sinks: particles carried by it circle
+// around instead of bunching up.
+//
+// The noise is only evaluated at the grid points, and only for keys a few seconds apart; in between, the field blends
+// from one key to the next while the key after that is computed a slice per update, so no frame pays for a whole key.
+// Sampling is a trilinear lookup, cheap enough to do for every particle and every vertex.
+//
+//   flow.setup(ofVec3f(-1000, -200, -1000), ofVec3f(1000, 800, 1000), 16, 8, 16);
+//   ...
+//   flow.update(elapsedTime);               // once per frame
+//   ...
+//   velocity = flow.sample(position);       // about unit length on average
+//
+// Outside its bounds the field continues the velocities at the nearest edge.
+class FlowField
+{
+public:
+
+	FlowField() : nx(0), ny(0), nz(0), period(4), scale(3), seed(0), from(0), to(1), next(2), keyTime(0), slice(0), started(false) {}
+
+	// the grid spans min to max with the given number of points along each axis, at least 2
+	void setup(const ofVec3f &min, const ofVec3f &max, int nx, int ny, int nz);
+
+	// seconds from one key of the field to the next
+	void setPeriod(float period) { this->period = period; }
+	// how many swirls fit across the grid, roughly
+	void setScale(float scale) { this->scale = scale; }
+	// picks a different field
+	void setSeed(float seed) { this->seed = seed; }
+
+	// moves the field to the given time in seconds; a jump of more than a period computes the keys at once
+	void update(float time);
+
+	ofVec3f sample(const ofVec3f &position) const;
+
+	const ofVec3f &getMin() const { return min; }
+	const ofVec3f &getMax() const { return max; }
+
+protected:
+
+	ofVec3f min, max;
+	int nx, ny, nz;
+	float period, scale, seed;
+
+	// the keys at keyTime and a period later, and the one a period after that, being computed
+	vector<ofVec3f> keys[3];
+	int from, to, next;
+	float keyTime;
+	// next slice of the key being computed
+	int slice;
+	bool started;
+	// the blend of the two keys at the current time, which sample() reads
+	vector<ofVec3f> current;
+
+	// evaluates one z slice of the field at the given time into key
+	void computeSlice(vector<ofVec3f> &key, int z, float time);
+	// scales a finished key to an average velocity of 1
+	void normalize(vector<ofVec3f> &key);
+	void computeKey(vector<ofVec3f> &key, float time);
+	// the next slice of the key being computed
+	void computeNextSlice();
+};
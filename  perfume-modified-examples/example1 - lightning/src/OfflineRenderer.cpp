@@ -0,0 +1,94 @@
+#include "OfflineRenderer.h"
+
+OfflineRenderer::~OfflineRenderer()
+{
+	finish();
+}
+
+bool OfflineRenderer::setup(int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+
+		if (arg == "--render" && i + 1 < argc)
+		{
+			enabled = true;
+			path = argv[++i];
+		}
+		else if (arg == "--size" && i + 2 < argc)
+		{
+			width = ofToInt(argv[++i]);
+			height = ofToInt(argv[++i]);
+		}
+		else if (arg == "--fps" && i + 1 < argc)
+		{
+			fps = ofToFloat(argv[++i]);
+		}
+		else if (arg == "--duration" && i + 1 < argc)
+		{
+			duration = ofToFloat(argv[++i]);
+		}
+		else if (arg == "--encoder" && i + 1 < argc)
+		{
+			encoder = argv[++i];
+		}
+	}
+
+	if (width <= 0 || height <= 0 || fps <= 0)
+	{
+		ofLogError("OfflineRenderer", "invalid --size or --fps");
+		enabled = false;
+	}
+
+	return enabled;
+}
+
+void OfflineRenderer::start(float defaultDuration)
+{
+	if (!enabled) return;
+
+	if (duration <= 0)
+		duration = defaultDuration;
+
+	fbo.allocate(width, height, GL_RGBA);
+
+	// every frame has to reach the encoder, so wait for it instead of dropping frames
+	capture.setBlocking(true);
+	if (!capture.start(width, height, new EncoderSink(path, fps, encoder)))
+	{
+		enabled = false;
+		return;
+	}
+
+	frame = 0;
+
+	ofLogNotice("OfflineRenderer", "rendering " + ofToString(getNumFrames()) + " frames to " + path);
+}
+
+void OfflineRenderer::finish()
+{
+	if (!capture.isCapturing()) return;
+
+	capture.stop();
+
+	ofLogNotice("OfflineRenderer", "finished " + path);
+}
+
+void OfflineRenderer::begin()
+{
+	fbo.begin();
+}
+
+void OfflineRenderer::end()
+{
+	capture.capture();
+	fbo.end();
+
+	frame++;
+}
+
+void OfflineRenderer::draw(float x, float y, float w, float h)
+{
+	fbo.draw(x, y, w, h);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "ofMain.h"
+#include "FrameCapture.h"
+
+// Renders the scene at a fixed timestep into an offscreen buffer instead of playing it live, and streams every frame
+// as raw RGBA to an encoder process (ffmpeg by default).  Started from the command line:
+//
+//   example --render out.mp4 [--size 3840 2160] [--fps 60] [--duration 64.28] [--encoder "command"]
+//
+// Frames are read back through a blocking FrameCapture, so nothing is dropped and frames are produced as fast as they
+// can be drawn and encoded.
+class OfflineRenderer
+{
+public:
+
+	OfflineRenderer() : enabled(false), width(1920), height(1080), fps(60), duration(0),
+		frame(0) {}
+
+	virtual ~OfflineRenderer();
+
+	// reads the options above from the command line; returns true if --render was given
+	bool setup(int argc, char *argv[]);
+	bool isEnabled() const { return enabled; }
+
+	// allocates the render target and starts the encoder; needs a GL context, so call it from testApp::setup()
+	void start(float defaultDuration);
+	void finish();
+
+	// scene time of the frame being rendered, in seconds
+	float getTime() const { return frame / fps; }
+	bool isDone() const { return frame >= getNumFrames(); }
+	int getNumFrames() const { return ceil(duration * fps); }
+
+	// render the scene between begin() and end()
+	void begin();
+	void end();
+
+	// preview of the last rendered frame
+	void draw(float x, float y, float w, float h);
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	float getFps() const { return fps; }
+
+protected:
+
+	bool enabled;
+	string path;
+	string encoder;
+
+	int width, height;
+	float fps;
+	float duration;
+
+	int frame;
+
+	ofFbo fbo;
+	FrameCapture capture;
+};
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "ofMain.h"
+#include "GpuTimer.h"
+
+// Holds a frame time budget by scaling how dense the effects are.  The effects are split into subsystems (particles,
+// bolts, ...), each of which is timed separately on the CPU and the GPU and has a quality between 0 and 1.  Knobs are the
+// numbers the effects are made of - particle limits, emissions per frame, bolt counts - and follow the quality of
+// their subsystem between the bounds they were added with.
+//
+// Every frame the governor splits the frame time into what the subsystems cost and the rest, which scaling cannot
+// change, and picks the qualities that fit the subsystems into what the rest leaves of the budget.  Subsystems with a
+// higher priority keep their quality longer.  Qualities drop quickly and recover slowly, so the show degrades
+// gracefully under load instead of dropping frames, without pumping back and forth.
+//
+//   enum { PARTICLES };
+//   enum { MAX_PARTICLES };
+//   quality.addSubsystem("particles");
+//   quality.addKnob(PARTICLES, 1000, 10000);
+//   ...
+//   quality.beginFrame();                   // start of update()
+//   quality.begin(PARTICLES);               // any number of times per frame
+//   ... update the particles, at most quality.get(MAX_PARTICLES) of them
+//   quality.end(PARTICLES);
+//   ...
+//   quality.beginFrameDraw();               // start of draw()
+//   ...
+//   quality.beginDraw(PARTICLES);           // once per frame
+//   ... draw the particles
+//   quality.endDraw(PARTICLES);
+//   quality.endFrame();                     // end of draw()
+//
+// From the command line: --frame-budget <milliseconds>, 0 to keep every knob at its maximum.  GPU times need
+// ARB_timer_query; without it only the CPU times count.
+//
+// DynamicResolution reacts to the GPU time of the same frames.  Left alone, the two would both cut at once and then
+// both recover, so the app only lets the resolution drop while the governor is not cutting (isCutting()), and only
+// rise once the governor is back at full quality (isFull()): the effects thin out first and come back first.
+class QualityGovernor
+{
+public:
+
+	QualityGovernor() : enabled(true), budget(0.014), frameStart(0), drawing(false), cpuFrame(0), gpuFrame(0), cutting(false) {}
+	virtual ~QualityGovernor();
+
+	// reads the option above from the command line
+	void setup(int argc, char *argv[]);
+
+	// subsystems and knobs are added once, before the first frame; both return the index to refer to them by.  A knob
+	// is at min at quality 0 and at max at quality 1.
+	int addSubsystem(const string &name, float priority = 1);
+	int addKnob(int subsystem, float min, float max);
+
+	// off, every knob stays at its maximum
+	void setEnabled(bool enabled);
+	bool isEnabled() const { return enabled; }
+
+	// seconds the CPU and the GPU may each spend on a frame
+	void setBudget(float budget) { this->budget = budget; }
+	float getBudget() const { return budget; }
+
+	// bracket everything done for a frame, from the start of update() to the end of draw(); endFrame() adjusts the
+	// qualities
+	void beginFrame();
+	void endFrame();
+	// start of draw(): the frame's GPU time is measured from here, as the GPU has nothing to do during update() and
+	// timing from beginFrame() would count the CPU work of the update against the GPU budget
+	void beginFrameDraw();
+
+	// bracket CPU work of a subsystem; the times of a frame add up
+	void begin(int subsystem);
+	void end(int subsystem);
+	// bracket the drawing of a subsystem, timed on the CPU and the GPU; once per frame for each subsystem
+	void beginDraw(int subsystem);
+	void endDraw(int subsystem);
+
+	// current value of a knob, between its bounds
+	float get(int knob) const;
+	float getQuality(int subsystem) const { return subsystems[subsystem]->quality; }
+
+	int getNumSubsystems() const { return subsystems.size(); }
+	const string &getName(int subsystem) const { return subsystems[subsystem]->name; }
+	// recent times per frame in seconds, smoothed over a few frames
+	float getCpuTime(int subsystem) const { return subsystems[subsystem]->cpu; }
+	float getGpuTime(int subsystem) const { return subsystems[subsystem]->gpu; }
+	float getFrameCpuTime() const { return cpuFrame; }
+	float getFrameGpuTime() const { return gpuFrame; }
+
+	// whether the last frame lowered some quality, and whether every quality is back at its maximum (or nearly; they
+	// approach it slowly); for DynamicResolution, see above
+	bool isCutting() const { return cutting; }
+	bool isFull() const;
+
+protected:
+
+	struct Subsystem
+	{
+		string name;
+		float priority;
+		float quality;
+		// smoothed times per frame
+		float cpu, gpu;
+		// CPU time of the current frame so far, and the start of the running interval
+		unsigned long long frameCpu, start;
+		GpuTimer timer;
+		bool drawn;
+	};
+
+	struct Knob
+	{
+		int subsystem;
+		float min, max;
+	};
+
+	bool enabled;
+	float budget;
+	// GpuTimer is not copyable, so the subsystems are kept by pointer
+	vector<Subsystem*> subsystems;
+	vector<Knob> knobs;
+
+	unsigned long long frameStart;
+	GpuTimer frameTimer;
+	// frameTimer was started by beginFrameDraw()
+	bool drawing;
+	float cpuFrame, gpuFrame;
+	bool cutting;
+
+	// the quality every subsystem can have with the given costs, in seconds per frame at its current quality, and
+	// frame time
+	void fit(const vector<float> &costs, float frame, vector<float> &qualities) const;
+};
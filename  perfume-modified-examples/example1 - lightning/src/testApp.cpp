@@ -1,14 +1,47 @@
 #include "testApp.h"
+#include "RandomGenerator.h"
+#include "SimulationClock.h"
+#include "Frustum.h"
+#include "FlowField.h"
+#include "Colliders.h"
+#include "JointIndex.h"
+#include "ContactDetector.h"
 
 class Tracker;
 class Particle;
 class ParticleSystem;
 
 const float trackDuration = 64.28;
+// seed for all random effects; runs with the same seed play back identically
+const int randomSeed = 1;
 ofVec3f center, center_t;
 ofVec3f campos, campos_t;
-ofVec3f offset, offset_v;
 vector<Tracker*> trackers;
+// seconds since the start, used for animating the scene; advances in fixed steps when rendering offline
+float elapsedTime;
+// advances the effects in fixed steps, independently of how often the scene is drawn
+SimulationClock simClock;
+// view volume of the current frame in scene coordinates, set in drawScene(); figures, particles and bolts outside it are not drawn
+Frustum frustum;
+// toggled with 'b': the scene is drawn once, thin and bright, into the bloom buffers, which add the glow in one post pass;
+// off, the glow comes from drawing every primitive several times in wider, fainter layers
+bool bloomMode = true;
+// slowly swirling flow the particles and the history of poses drift along
+FlowField flowField;
+// the floor and the bones of the current poses, which particles bounce off; rebuilt every frame in update()
+Colliders colliders;
+// the joints of the current poses, for finding the nearest one to a bolt; rebuilt every frame in update()
+JointIndex joints;
+// finds the limbs of different figures coming close, which fire the bolts between them; updated every frame in update()
+ContactDetector contacts;
+// bolts jump to the nearest joint in reach: along the figure itself to one at least minBoltLength away, and over to
+// the figures next to it
+const float minBoltLength = 30;
+const float selfBoltReach = 120;
+const float figureBoltReach = 400;
+// subsystems and knobs of the quality governor, in the order setup() adds them; see QualityGovernor.h
+enum { PARTICLES, BOLTS };
+enum { MAX_PARTICLES, EMISSIONS, SMALL_BOLTS, BOLT_PASSES };
 
 /* classes for handling particles */
 
@@ -16,7 +49,7 @@ vector<Tracker*> trackers;
 // class used for tracking information relevant to a particle
 class Particle {
 private:
-	ofVec3f pos;
+	ofVec3f pos, prevPos;
 	ofVec3f heading;
 	float lifespan;
 	int type;
@@ -24,6 +57,7 @@ private:
 public:
 	void init(ofVec3f pos_, ofVec3f heading_, float lifespan_, int type_) {
 		pos = pos_;
+		prevPos = pos_;
 		heading = heading_;
 		lifespan = lifespan_;
 		type = type_;
@@ -36,9 +70,16 @@ public:
 	ofVec3f getPos() {
 		return pos;
 	}
+	// position between the previous simulation step and the current one, for drawing
+	ofVec3f getPos(float alpha) {
+		return prevPos.getInterpolated(pos, alpha);
+	}
 	ofVec3f getHeading() {
 		return heading;
 	}
+	void setHeading(ofVec3f heading_) {
+		heading = heading_;
+	}
 	void setLifespan(float lifespan_) {
 		lifespan = lifespan_;
 	}
@@ -51,50 +92,185 @@ public:
 	void setType(int type_) {
 		type = type_;
 	}
+
+	// move along the heading, carried along by drift on top of it, and age by the given number of motion capture frames
+	void move(float amount, const ofVec3f &drift) {
+		prevPos = pos;
+		pos += (heading + drift) * amount;
+		lifespan -= amount;
+	}
+};
+
+// scene-wide limit on the number of particles, shared by the particle systems of all figures, so the most particles
+// there can be (and the cost of drawing them) does not grow with the number of figures.  When the budget is full, a
+// new particle takes the place of the oldest ones of the system holding the most particles for its priority: the
+// emitting system itself, unless another one holds more than its fair share.
+class ParticleBudget {
+private:
+	vector<ParticleSystem*> systems;
+	int capacity;
+
+public:
+	ParticleBudget() : capacity(10000) {}
+
+	void add(ParticleSystem *system) {
+		systems.push_back(system);
+	}
+
+	// lowering the capacity evicts the particles over it right away
+	void setCapacity(int capacity_);
+	int getCapacity() {
+		return capacity;
+	}
+	// particles in all systems together
+	int getSize();
+
+	// makes room for one more particle in the given system
+	void reserve(ParticleSystem *system);
+
+	// the system with the most particles for its priority, preferring the given one on a tie
+	ParticleSystem *findLargest(ParticleSystem *preferred);
 };
 
 // class for handling creation and updating of particles
 class ParticleSystem {
 private:
-	vector<Particle> particleVec;
+	// oldest first
+	deque<Particle> particles;
+	ParticleBudget *budget;
+	float priority;
+	int groupSize;
+	const FlowField *flow;
+	float flowStrength;
+	Colliders *colliders;
+	float bounce;
+	// the particles' positions and headings side by side, for colliding them all at once
+	vector<ofVec3f> positions, headings;
 
 public:
+	ParticleSystem() : budget(NULL), priority(1), groupSize(1), flow(NULL), flowStrength(0), colliders(NULL), bounce(0) {}
+
+	// share the given budget with the other systems.  groupSize particles emitted together are drawn together, and
+	// evicted together
+	void setup(ParticleBudget *budget_, int groupSize_ = 1) {
+		budget = budget_;
+		groupSize = groupSize_;
+		budget->add(this);
+	}
+
+	// particles drift along the flow field at strength times its velocity, in scene units per motion capture frame;
+	// pass NULL to move them along their headings only
+	void setFlow(const FlowField *flow_, float strength) {
+		flow = flow_;
+		flowStrength = strength;
+	}
+
+	// particles bounce off the given colliders, keeping bounce times the speed they hit them with; pass NULL to let
+	// them pass through everything
+	void setColliders(Colliders *colliders_, float bounce_) {
+		colliders = colliders_;
+		bounce = bounce_;
+	}
+
+	// a system with twice the priority keeps twice as many particles when the budget is full; must be above 0
+	void setPriority(float priority_) {
+		priority = priority_;
+	}
+	float getPriority() {
+		return priority;
+	}
+
 	// create a particle at a given location with a movement direction and lifespan
 	void emit(ofVec3f pos_, ofVec3f heading_, float lifespan_, int type_) {
+		if (budget != NULL)
+			budget->reserve(this);
 		Particle next;
 		next.init(pos_, heading_, lifespan_, type_);
-		particleVec.push_back(next);
+		particles.push_back(next);
 	}
 
-	// move particles according to their current direction and update their lifespan
-	void updateParticles() {
-		for (int i = 0; i < particleVec.size(); i++) {
-			particleVec[i].setPos(particleVec[i].getPos() + particleVec[i].getHeading());
-			particleVec[i].setLifespan(particleVec[i].getLifespan()-1);
+	// move particles according to their current direction and update their lifespan.  Headings and lifespans are given
+	// per motion capture frame; amount is the length of a simulation step in those frames
+	void updateParticles(float amount) {
+		for (int i = 0; i < particles.size(); i++) {
+			ofVec3f drift = flow != NULL ? flow->sample(particles[i].getPos()) * flowStrength : ofVec3f();
+			particles[i].move(amount, drift);
+		}
+		if (colliders != NULL && !particles.empty()) {
+			positions.resize(particles.size());
+			headings.resize(particles.size());
+			for (int i = 0; i < particles.size(); i++) {
+				positions[i] = particles[i].getPos();
+				headings[i] = particles[i].getHeading();
+			}
+			colliders->collide(positions, headings, bounce);
+			for (int i = 0; i < particles.size(); i++) {
+				particles[i].setPos(positions[i]);
+				particles[i].setHeading(headings[i]);
+			}
 		}
 	}
 
-	// remove particles from the system when they run out of lifespan
+	// remove particles from the system when they run out of lifespan; particles that die before older ones are hidden
+	// until those are removed
 	void checkLifespans() {
-		for (int i = 0; i < particleVec.size(); i++) {
-			if (particleVec[i].getLifespan() < 0) {
-				particleVec[i].setType(-1);
-				if (particleVec[0].getType() == -1) {
-					particleVec.erase(particleVec.begin());
-				}
-			}
+		for (int i = 0; i < particles.size(); i++) {
+			if (particles[i].getLifespan() < 0)
+				particles[i].setType(-1);
 		}
+		while (!particles.empty() && particles.front().getType() == -1)
+			particles.pop_front();
+	}
+
+	// remove the oldest group of particles to make room for new ones
+	void evictOldest() {
+		for (int i = 0; i < groupSize && !particles.empty(); i++)
+			particles.pop_front();
 	}
 
 	// getters and setters
 	size_t getSize() {
-		return particleVec.size();
+		return particles.size();
 	}
-	vector<Particle> getParticles() {
-		return particleVec;
+	deque<Particle> &getParticles() {
+		return particles;
 	}
 };
 
+void ParticleBudget::setCapacity(int capacity_) {
+	capacity = capacity_;
+	while (getSize() > capacity)
+		findLargest(NULL)->evictOldest();
+}
+
+int ParticleBudget::getSize() {
+	int size = 0;
+	for (int i = 0; i < systems.size(); i++)
+		size += systems[i]->getSize();
+	return size;
+}
+
+void ParticleBudget::reserve(ParticleSystem *system) {
+	while (getSize() >= capacity) {
+		ParticleSystem *largest = findLargest(system);
+		if (largest->getSize() == 0)
+			return;
+		largest->evictOldest();
+	}
+}
+
+ParticleSystem *ParticleBudget::findLargest(ParticleSystem *preferred) {
+	ParticleSystem *largest = preferred;
+	for (int i = 0; i < systems.size(); i++) {
+		if (largest == NULL || systems[i]->getSize() / systems[i]->getPriority() > largest->getSize() / largest->getPriority())
+			largest = systems[i];
+	}
+	return largest;
+}
+
+// the one budget all figures' particles come from
+ParticleBudget particleBudget;
+
 
 /* The Tracker class handles the motion of each figure in the scene.  Each Tracker object tracks the position data of one figure in the scene, 
    as well as visual effects related to that figure.  The Tracker also stores the position data of the other two figures, which allows the figure 
@@ -111,16 +287,31 @@ public:
 	
 	// Frames hold the set of position values in each frame of movement
 	typedef vector<ofVec3f> Frame;
-	// each track contains the position values of all frames for each figure
+	// the poses of the figure, newest first, one per capture frame; see recordFrame()
 	typedef deque<Frame> Track;
-	Track track, lTrack, rTrack;
+	Track track;
+	// poses kept in the track: five seconds of the Perfume takes
+	static const int HISTORY_FRAMES = 200;
+	// seconds since the last pose went into the track
+	float historyTime;
 	int numPoints;
 	float boltTime;
 	bool drawBolt;
 	bool leftTarget, rightTarget;
 	int placeCount, direction, segment, numBolts;
-	int modifier[1024];
-	int startIndices[64], endIndices[64];
+	// upper limits for the bolt paths generated in setupBolts()
+	static const int MAX_BOLTS = 16;
+	static const int MAX_BOLT_POINTS = 32;
+	int modifier[MAX_BOLT_POINTS + 1];
+	// random start and end joints of every bolt; the larger bolts only use them when the figures are out of reach
+	int startIndices[MAX_BOLTS], endIndices[MAX_BOLTS];
+	// end joints of the bolts along this figure; see updateTargets()
+	int selfTargets[MAX_BOLTS];
+	// the joints of this figure and of the figure the larger bolts fire at that are nearest to each other; see
+	// updateTargets()
+	int figureStarts[MAX_BOLTS], figureTargets[MAX_BOLTS];
+	// offset of each connecting point of a bolt from the straight line between its endpoints, indexed by [bolt][point]
+	ofVec3f boltPaths[MAX_BOLTS][MAX_BOLT_POINTS + 1];
 	
 	struct Buffer
 	{
@@ -130,17 +321,44 @@ public:
 	typedef vector<Buffer> BufferArray;
 	vector<BufferArray> buffer;
 	ParticleSystem particleHandler;
+	RandomGenerator rng;
+	// separate stream for the flicker of line widths and point sizes, so drawing more or less often does not change the effects
+	RandomGenerator jitter;
+	// the current pose of the figure, uploaded once per new frame and shared by every layer drawn in drawFigure()
+	ofVbo figureVbo;
+	int figureVertices;
 	Frame startPoints, lPoints, rPoints;
+	// bounding sphere of the current pose
+	ofVec3f boundsCenter;
+	float boundsRadius;
+	// times the particles and bolts, and sets how many of them there are
+	QualityGovernor *quality;
 	
 	// initialize values
-	void setup(ofxBvh *o, int id_)
+	void setup(ofxBvh *o, int id_, QualityGovernor *quality_)
 	{
 		bvh = o;
+		quality = quality_;
 		boltTime = 0;
 		drawBolt = false;
 		placeCount = 0;
+		numBolts = 0;
+		leftTarget = rightTarget = false;
 		modifier[0] = 0;
+		for (int n = 0; n < MAX_BOLTS; n++) {
+			startIndices[n] = endIndices[n] = 0;
+			selfTargets[n] = figureStarts[n] = figureTargets[n] = 0;
+		}
 		id = id_;
+		rng.setSeed(randomSeed, id);
+		particleHandler.setup(&particleBudget);
+		particleHandler.setFlow(&flowField, 0.4);
+		particleHandler.setColliders(&colliders, 0.5);
+		jitter.setSeed(randomSeed, 100 + id);
+		ofAddListener(contacts.contactBegan, this, &Tracker::contactBegan);
+		figureVertices = 0;
+		historyTime = 0;
+		boundsRadius = 0;
 	}
 	// set which figures are to the left and right of this figure
 	void setBvhL(ofxBvh *o) {
@@ -155,71 +373,117 @@ public:
 	{
 		if (bvh->isFrameNew())
 		{
-			// add the position data in the current frame to the tracker
-			Frame f, lF, rF;
-			addFrame(&f, bvh, &track);
-			// also keep track of the position data of the other two figures
-			addFrame(&lF, bvhL, &lTrack);
-			addFrame(&rF, bvhR, &rTrack);	
-			startPoints = track[0];
-			lPoints = lTrack[0];
-			rPoints = rTrack[0];
+			// the current pose of this figure, and of the other two
+			getFrame(&startPoints, bvh);
+			getFrame(&lPoints, bvhL);
+			getFrame(&rPoints, bvhR);
+			uploadFigure();
+			updateBounds();
+		}
+	}
 
-			modifyVertices();
-			cacheVertices();
-			handleParticles();
+	// advance the particles and bolts by one fixed simulation step of stepTime seconds
+	void step(float stepTime)
+	{
+		// the history of poses, and what is emitted with it, moves on once per capture frame, whatever rate the takes
+		// were resampled to for drawing
+		historyTime += stepTime;
+		if (startPoints.empty())
+			historyTime = 0;
+		while (historyTime >= getCaptureFrameTime()) {
+			historyTime -= getCaptureFrameTime();
+			recordFrame();
 		}
+
+		quality->begin(PARTICLES);
+		particleHandler.updateParticles(stepTime / getCaptureFrameTime());
+		particleHandler.checkLifespans();
+		quality->end(PARTICLES);
+
+		if (startPoints.empty())
+			return;
+
+		quality->begin(BOLTS);
+		handleBolts();
+
+		// sparks where the bolts drawn in drawBolts() meet the figures
+		for (int n = 0; n < getNumSmallBolts(); n++)
+			emitSparks(startPoints, startIndices[n], selfTargets[n], 30);
+		if (drawBolt) {
+			if (leftTarget) {
+				for (int n = 0; n < numBolts; n++)
+					emitSparks(lPoints, figureStarts[n], figureTargets[n], 2);
+			}
+
+			if (rightTarget) {
+				for (int n = 0; n < numBolts; n++)
+					emitSparks(rPoints, figureStarts[n], figureTargets[n], 2);
+			}
+		}
+		quality->end(BOLTS);
 	}
 
-	// draw the elements in the scene
+	// number of the short bolts along the figure itself, as many as the governor allows
+	int getNumSmallBolts() {
+		return quality->get(SMALL_BOLTS);
+	}
+
+	// draw the figure; the particles and bolts are drawn in passes of their own, so each can be timed for the governor
 	void draw()
 	{
 		glEnable(GL_POLYGON_OFFSET_FILL);
 		glPolygonOffset(1, 1);
 
-		drawParticles();
-		drawFigure();
-		handleBolts();
+		// line widths and point sizes reach past the joints, so the sphere is given some room
+		if (frustum.intersects(boundsCenter, boundsRadius + 50))
+			drawFigure();
 
+		glDisable(GL_POLYGON_OFFSET_FILL);
+		glPolygonOffset(0, 0);
+		glDisable(GL_LIGHT0);
+		glDisable(GL_LIGHT1);
+	}
+
+	// draw the "lightning bolts" set up in handleBolts()
+	void drawBolts()
+	{
 		int fade = 100-boltTime;
 		ofVec3f mid, last;
 		int widths[16];
 		ofColor colors[16];
-		widths[0] = 3+rand()%3;
-		widths[1] = 5+rand()%2;
+		widths[0] = 3+jitter.nextInt(3);
+		widths[1] = 5+jitter.nextInt(2);
 		widths[2] = 10;
 		colors[0] = ofColor(255, 255, 255, 110-fade);
 		colors[1] = ofColor(100, 100, 225, 20);
 		colors[2] = ofColor(0, 20, 225, 100-fade);
+		// without bloom every pass draws all the layers of a bolt again, as many as the governor allows; with bloom the
+		// intensity is only a brightness and costs nothing
+		int passes = quality->get(BOLT_PASSES);
+		int smallIntensity = bloomMode ? 2 : MIN(2, passes);
+		int largeIntensity = bloomMode ? 8 : passes;
 		// draw "lightning bolts" using the values assigned above
-		for (int n = 0; n < 5; n++)
-			renderBolt(last, mid, numPoints, fade, startPoints, startIndices[n], endIndices[n], widths, colors, 30, 2, 1);
+		for (int n = 0; n < getNumSmallBolts(); n++)
+			renderBolt(last, mid, numPoints, fade, startPoints, startIndices[n], selfTargets[n], n, widths, colors, smallIntensity, 1);
 		// determine which figures to connect larger bolts to
 		if (drawBolt) {
 			if (leftTarget) {
 				for (int n = 0; n < numBolts; n++)
-					renderBolt(last, mid, numPoints, fade, lPoints, startIndices[n], endIndices[n], widths, colors, 2, 8, 1);	
+					renderBolt(last, mid, numPoints, fade, lPoints, figureStarts[n], figureTargets[n], 5+n, widths, colors, largeIntensity, 1);	
 			}
 
 			if (rightTarget) {
 				for (int n = 0; n < numBolts; n++)
-					renderBolt(last, mid, numPoints, fade, rPoints, startIndices[n], endIndices[n], widths, colors, 2, 8, 1);
+					renderBolt(last, mid, numPoints, fade, rPoints, figureStarts[n], figureTargets[n], 7+n, widths, colors, largeIntensity, 1);
 			}
-			// activate lighting when a larger bolt appears
-			showLighting();
 		}
-
-		drawFloor();
-		glDisable(GL_POLYGON_OFFSET_FILL);
-		glPolygonOffset(0, 0);
-		glDisable(GL_LIGHT0);
-		glDisable(GL_LIGHT1);
 	}
 	
 	/* Tracker updating functions: except for the code for updating particles, these are taken directly from the original code's update() function. */
 
-	// adds the current position values of the figure to a Track container 
-	void addFrame(Frame* f, ofxBvh *o, Track* track_) {
+	// fills a Frame with the current position values of a figure
+	void getFrame(Frame* f, ofxBvh *o) {
+		f->clear();
 		for (int i = 0; i < o->getNumJoints(); i++)
 		{
 			const ofxBvhJoint *j = o->getJoint(i);
@@ -230,9 +494,25 @@ public:
 				f->push_back(j->getChildren().at(n)->getPosition());
 			}
 		}
-		track_->push_front(*f);	
-		if (track_->size() > 200)
-			track_->pop_back();
+	}
+
+	// adds the current pose to the figure's Track and moves the older ones along; once per capture frame, with the
+	// particles emitted around the head
+	void recordFrame() {
+		track.push_front(startPoints);
+		if (track.size() > HISTORY_FRAMES)
+			track.pop_back();
+		modifyVertices();
+		cacheVertices();
+		quality->begin(PARTICLES);
+		handleParticles();
+		quality->end(PARTICLES);
+	}
+
+	// seconds per frame of the take as captured; particle headings and lifespans, and the pose history, are given in
+	// these frames.  Without a take, one frame per simulation step
+	float getCaptureFrameTime() {
+		return bvh->getSourceFrameTime() > 0 ? bvh->getSourceFrameTime() : simClock.getStepTime();
 	}
 
 	// applies gravity modifiers to the position data in Frames older than the current one; not currently used
@@ -250,10 +530,11 @@ public:
 					
 				// gravity
 				f.y -= -2.5 * (1 - sin(pow(delta, 2) * PI));
-				f.y += ofNoise(v.y * 0.0001 + offset.y) * 1.4;
-					
-				f.x += ofSignedNoise(v.x * 0.0001 + offset.x) * 3;
-				f.z += ofSignedNoise(v.z * 0.0001 + offset.z) * 3;
+				// drift along the flow field, upwards on average
+				ofVec3f flow = flowField.sample(v);
+				f.x += flow.x * 3;
+				f.y += 0.7 + flow.y * 0.7;
+				f.z += flow.z * 3;
 					
 				if (v.y < 0)
 				{
@@ -275,6 +556,31 @@ public:
 		}
 	}
 
+	// a sphere around every joint of the current pose, from their average and the farthest one from it
+	void updateBounds() {
+		if (startPoints.empty())
+			return;
+		boundsCenter.set(0, 0, 0);
+		for (int i = 0; i < startPoints.size(); i++)
+			boundsCenter += startPoints[i];
+		boundsCenter /= startPoints.size();
+		boundsRadius = 0;
+		for (int i = 0; i < startPoints.size(); i++)
+			boundsRadius = MAX(boundsRadius, boundsCenter.distance(startPoints[i]));
+	}
+
+	// copies the current pose of this figure into its vertex buffer
+	void uploadFigure() {
+		const Frame &f = startPoints;
+		if (f.empty())
+			return;
+		if (f.size() != figureVertices) {
+			figureVbo.setVertexData(&f[0], f.size(), GL_DYNAMIC_DRAW);
+			figureVertices = f.size();
+		}
+		else figureVbo.updateVertexData(&f[0], f.size());
+	}
+
 	// stores the positions of the vertices in this figure's Track
 	void cacheVertices() {
 		// cache vertexes
@@ -316,29 +622,27 @@ public:
 		}
 	}
 
-	// emit particles around the heads of the figures and update properties of existing particles
+	// emit particles around the heads of the figures, as many as the governor allows; the particle budget decides how
+	// many there can be in total
 	void handleParticles() {
-		if (particleHandler.getSize() < 10000) {
-			for (int j = 0; j < 8; j++) {
-				ofVec3f next;
-				// index 21 holds the position of the top of the figure
-				next.x = track[0][21].x + rand()%20-10;
-				next.y = track[0][21].y + rand()%20-10;
-				next.z = track[0][21].z + rand()%20-10;
-				particleHandler.emit(next, ofVec3f(rand()%1-1,0.5,rand()%1), 20, 1);
-				next.x = track[0][21].x + rand()%4-2;
-				next.y = track[0][21].y + rand()%4-2;
-				next.z = track[0][21].z + rand()%4-2;
-				particleHandler.emit(next, ofVec3f(0,0.5,0), 5, 1);
-			}
+		for (int j = 0; j < (int)quality->get(EMISSIONS); j++) {
+			ofVec3f next;
+			// index 21 holds the position of the top of the figure
+			next.x = track[0][21].x + rng.nextInt(20)-10;
+			next.y = track[0][21].y + rng.nextInt(20)-10;
+			next.z = track[0][21].z + rng.nextInt(20)-10;
+			particleHandler.emit(next, ofVec3f(rng.nextInt(1)-1,0.5,rng.nextInt(1)), 20, 1);
+			next.x = track[0][21].x + rng.nextInt(4)-2;
+			next.y = track[0][21].y + rng.nextInt(4)-2;
+			next.z = track[0][21].z + rng.nextInt(4)-2;
+			particleHandler.emit(next, ofVec3f(0,0.5,0), 5, 1);
 		}
-		particleHandler.updateParticles();
 	}
 
 	/* drawing functions */
 	// draw an openGL point
 	void drawPoint(int size, ofColor color, ofVec3f pos) {
-		glPointSize(size);
+		Antialiasing::pointSize(size);
 		glBegin(GL_POINTS);
 		ofSetColor(color);
 		glVertex3fv(pos.getPtr());
@@ -346,8 +650,8 @@ public:
 	}
 
 	// draw an openGL line strip
-	void drawLineStrip(int width, ofColor color, ofVec3f pos1, ofVec3f pos2) {
-		glLineWidth(width);
+	void drawLineStrip(int width, const ofColor &color, const ofVec3f &pos1, const ofVec3f &pos2) {
+		Antialiasing::lineWidth(width);
 		glBegin(GL_LINE_STRIP);
 		ofSetColor(color);
 		glVertex3fv(pos1.getPtr());
@@ -355,61 +659,63 @@ public:
 		glEnd();
 	}
 
+	// draw an openGL line strip in a color scaled by brightness; the bloom buffer keeps components above 1
+	void drawBrightLine(int width, const ofColor &color, float brightness, const ofVec3f &pos1, const ofVec3f &pos2) {
+		Antialiasing::lineWidth(width);
+		glBegin(GL_LINE_STRIP);
+		glColor4f(color.r / 255.0 * brightness, color.g / 255.0 * brightness, color.b / 255.0 * brightness, color.a / 255.0);
+		glVertex3fv(pos1.getPtr());
+		glVertex3fv(pos2.getPtr());
+		glEnd();
+	}
+
 	// draw the existing particles
-	void drawParticles() {
-		particleHandler.checkLifespans();
-		vector<Particle> current = particleHandler.getParticles();
+	void drawParticles(float alpha) {
+		deque<Particle> &current = particleHandler.getParticles();
 		for (int j = 0; j < current.size(); j++) {
 			if (current[j].getType() == 1) {
-				drawPoint(5, ofColor(230, 230, 230, 50), current[j].getPos());
-				drawPoint(10, ofColor(70, 100, 200, 25), current[j].getPos());
-				drawPoint(15, ofColor(70, 100, 200, 25), current[j].getPos());
+				ofVec3f pos = current[j].getPos(alpha);
+				if (!frustum.intersects(pos, 20))
+					continue;
+				if (bloomMode) {
+					drawPoint(4, ofColor(190, 205, 245, 110), pos);
+					continue;
+				}
+				drawPoint(5, ofColor(230, 230, 230, 50), pos);
+				drawPoint(10, ofColor(70, 100, 200, 25), pos);
+				drawPoint(15, ofColor(70, 100, 200, 25), pos);
 			}
 		}
 	}
 
-	// draws the figure this Tracker is handling.  Taken from the original code.
+	// draws the figure this Tracker is handling.  Adapted from the original code; every layer is drawn from the figure's vertex buffer.
 	void drawFigure() {
-		if (!track.empty())
+		if (figureVertices > 0 && bloomMode)
 		{
-			Frame &f = track[0];
-			
-			glLineWidth(1+rand()%3);
+			// the lines and the joints once each; the bloom pass spreads them into the halo the layers below draw
+			Antialiasing::lineWidth(1+jitter.nextInt(3));
+			ofSetColor(160, 190, 240, 200);
+			figureVbo.draw(GL_LINES, 0, figureVertices);
+			Antialiasing::pointSize(6-jitter.nextInt(2));
+			ofSetColor(200, 220, 255, 150);
+			figureVbo.draw(GL_POINTS, 0, figureVertices);
+		}
+		else if (figureVertices > 0)
+		{
+			Antialiasing::lineWidth(1+jitter.nextInt(3));
 			ofSetColor(222, 222, 222, 120);
-			glBegin(GL_LINES);
-			for (int n = 0; n < f.size(); n += 2)
-			{
-				ofVec3f &v1 = f[n];
-				ofVec3f &v2 = f[n + 1];
-				
-				glVertex3fv(v1.getPtr());
-				glVertex3fv(v2.getPtr());
-			}
-			glEnd();
+			figureVbo.draw(GL_LINES, 0, figureVertices);
 			// draw another set of lines for visual effect
-			glLineWidth(10-rand()%2);
+			Antialiasing::lineWidth(10-jitter.nextInt(2));
 			ofSetColor(70, 120, 222, 100);
-			glBegin(GL_LINES);
-			for (int n = 0; n < f.size(); n += 2)
-			{
-				ofVec3f &v1 = f[n];
-				ofVec3f &v2 = f[n + 1];
-				
-				glVertex3fv(v1.getPtr());
-				glVertex3fv(v2.getPtr());
-			}
-			glEnd();
+			figureVbo.draw(GL_LINES, 0, figureVertices);
 			// draw points at the joints of the figure
-			for (int n = 0; n < f.size(); n++)
-			{
-				ofVec3f &v1 = f[n];
-				drawPoint(10-rand()%2, ofColor(255, 255, 255, 55), v1);
-			}
-			for (int n = 0; n < f.size(); n++)
-			{
-				ofVec3f &v1 = f[n];
-				drawPoint(15-rand()%2, ofColor(70, 120, 222, 100), v1);
-			}
+			Antialiasing::pointSize(10-jitter.nextInt(2));
+			ofSetColor(255, 255, 255, 55);
+			figureVbo.draw(GL_POINTS, 0, figureVertices);
+			Antialiasing::pointSize(15-jitter.nextInt(2));
+			ofSetColor(70, 120, 222, 100);
+			figureVbo.draw(GL_POINTS, 0, figureVertices);
 		}
 	}
 
@@ -418,17 +724,19 @@ public:
 		int numPoints_: the number of connecting points to be used in drawing a bolt
 		int boltTime_: the length of time the next bolts created will be displayed for */
 	void setupBolts(int numPoints_, int boltTime_) {
-		numBolts = rand()%2+1;
+		numBolts = rng.nextInt(2)+1;
 		numPoints = numPoints_;
+		if (numPoints > MAX_BOLT_POINTS)
+			numPoints = MAX_BOLT_POINTS;
 		boltTime = boltTime_;
 		placeCount = 0;
 		segment = 0;
 		// store randomized indices, which can be used to draw "lightning bolts" between random points on this figure and another one
-		for (int i = 0; i < startPoints.size(); i++) {
-			startIndices[i] = rand()%startPoints.size();
-			endIndices[i] = rand()%startPoints.size();
+		for (int i = 0; i < MAX_BOLTS; i++) {
+			startIndices[i] = rng.nextInt(startPoints.size());
+			endIndices[i] = rng.nextInt(startPoints.size());
 		}
-		if (rand()%2 == 0)
+		if (rng.nextInt(2) == 0)
 			direction = 1;
 		else direction = -1;
 		// store a set of "modifiers" that will be used to draw a jagged "lightning bolt"-like line by changing the y value of points along the line
@@ -439,36 +747,81 @@ public:
 				if (segment%(numPoints/3) == 0 && i != 1) { 
 					direction *= -1;
 					segment = 0;
-					modifier[i] = (rand()%20)*direction;
+					modifier[i] = rng.nextInt(20)*direction;
 				}
-				else modifier[i] += (rand()%10)*direction;
+				else modifier[i] += rng.nextInt(10)*direction;
 				if (abs(modifier[i] > 100))
 					modifier[i] = modifier[i-1];
 			}
 		}
+		// generate the jagged path of every bolt once, so drawing only has to follow the current positions of the bolt's endpoints
+		for (int n = 0; n < MAX_BOLTS; n++) {
+			rng.fill(&boltPaths[n][1], numPoints, 0, 5);
+			for (int i = 1; i <= numPoints; i++)
+				boltPaths[n][i].y += modifier[i];
+		}
+		updateTargets();
 	}
 
-	// determines when "lightning bolts" will be drawn
-	void handleBolts() {
-		// random chance of determining that bolts should be drawn
-		if (!drawBolt && rand()%80 == 0) {
-			drawBolt = true;
-			if (rand()%3 == 0) {
-				leftTarget = true;
-				rightTarget = false;
-			}
-			else if (rand()%3 == 1) {
-				rightTarget = true;
-				leftTarget = false;
-			}
-			else {
-				leftTarget = true;
-				rightTarget = true;
+	// points the bolts at the joints nearest to their start joints in the current poses, from the joint index update()
+	// builds every frame; called again when new bolts are set up
+	void updateTargets() {
+		if (startPoints.empty())
+			return;
+		for (int n = 0; n < getNumSmallBolts(); n++)
+			selfTargets[n] = findTarget(startIndices[n], id, selfBoltReach, endIndices[n]);
+		// the larger bolts fire between the joints nearest to each other, first of all the limbs in contact
+		if (drawBolt) {
+			int other = getFigure(leftTarget ? bvhL : bvhR);
+			int found = joints.findNearestPairs(id, other, figureBoltReach, figureStarts, figureTargets, numBolts);
+			for (int n = found; n < numBolts; n++) {
+				figureStarts[n] = startIndices[n];
+				figureTargets[n] = endIndices[n];
 			}
 		}
+	}
+
+	// the joint of the given figure nearest to the given joint of this one, or fallback when none is in reach
+	int findTarget(int start, int figure, float reach, int fallback) {
+		int nearest = joints.findNearest(startPoints[start], figure, figure == id ? minBoltLength : 0, reach);
+		return nearest >= 0 ? nearest : fallback;
+	}
+
+	// number of the figure moving with the given motion, as the joint index knows it
+	int getFigure(const ofxBvh *o) {
+		for (int i = 0; i < trackers.size(); i++) {
+			if (trackers[i]->bvh == o)
+				return trackers[i]->id;
+		}
+		return -1;
+	}
+
+	// a limb of this figure came close to one of the figure to its left or right: the larger bolts fire across to it,
+	// from a new set of bolts that updateTargets() starts at the joints nearest to it, the limb that touched among
+	// them.  Contacts while bolts are shown are left out.
+	void contactBegan(BoneContact &contact) {
+		int other;
+		if (contact.figureA == id)
+			other = contact.figureB;
+		else if (contact.figureB == id)
+			other = contact.figureA;
+		else return;
+		if (drawBolt)
+			return;
+		leftTarget = other == getFigure(bvhL);
+		rightTarget = other == getFigure(bvhR);
+		if (!leftTarget && !rightTarget)
+			return;
+		drawBolt = true;
+		// handleBolts() sets up the new bolts in the next step
+		boltTime = 0;
+	}
+
+	// determines when "lightning bolts" will be drawn; the larger ones are set off by contactBegan()
+	void handleBolts() {
 		// generate new information for a set of bolts
 		if (boltTime <= 0) {
-			setupBolts(20+rand()%4-2, numPoints+40+rand()%10);
+			setupBolts(20+rng.nextInt(4)-2, numPoints+40+rng.nextInt(10));
 		}
 		else {
 			boltTime--;
@@ -488,105 +841,139 @@ public:
 		int fade: modifier for alpha values when drawing lines, to make them fade away over time
 		Frame target: the set of positions that this bolt can connect to
 		int startIndex, endIndex: indices that determine which point in this figure will be the start of the bolt and which one in the target will be the endpoint 
+		int bolt: which of the paths generated in setupBolts() to follow
 		int widths[]: set of values to determine widths of the lines used for drawing the bolt
 		ofColor colors[]: set of colors to use when drawing the bolt
-		int sparkMod: determines chance of particles appearing at the start and end points of the bolt; higher causes a lower chance
 		int intensity: determines how many overlapping lines to draw for the bolt - the bolt will appear brighter as this increases
 		int positionMod: allows the position of the bolt to be changed by a factor if desired */
-	void renderBolt(ofVec3f last, ofVec3f mid, int numPoints_, int fade, Frame target, int startIndex, int endIndex, int widths[], ofColor colors[], int sparkMod, int intensity, int positionMod) {
+	void renderBolt(ofVec3f last, ofVec3f mid, int numPoints_, int fade, const Frame &target, int startIndex, int endIndex, int bolt, int widths[], ofColor colors[], int intensity, int positionMod) {
+		// a target on a figure with fewer joints
+		if (startIndex >= startPoints.size() || endIndex < 0 || endIndex >= target.size())
+			return;
+		// skip the bolt if the sphere through its endpoints, widened by how far the jagged path strays from the straight line, is off screen
+		ofVec3f a = startPoints[startIndex], b = target[endIndex];
+		a.y *= positionMod;
+		b.y *= positionMod;
+		if (!frustum.intersects((a + b) * 0.5, a.distance(b) * 0.5 + 120))
+			return;
+
+		// with bloom, halfway between the white core and the blue outer layer, and as bright as all the layers together
+		ofColor core((colors[0].r + colors[2].r) / 2, (colors[0].g + colors[2].g) / 2, (colors[0].b + colors[2].b) / 2, colors[0].a);
+
 		for (int i = 1; i <= numPoints_; i++) {
-			// emit particles where the bolt begins
-			if (rand()%sparkMod == 0)
-				particleHandler.emit(startPoints[startIndex], ofVec3f(rand()%2-1,rand()%2-1,rand()%2-1), 8, 1);
 			// set the starting point for the first segment of the bolt
 			if (i == 1) {
 				last = startPoints[startIndex];
 				last.y *= positionMod;
 			}
 
-			// determine the position of the next point to draw a line to, based on values generated in setupBolts()
-			mid.x = startPoints[startIndex].x + float(i)/numPoints*(target[endIndex].x-startPoints[startIndex].x) + rand()%5;
-			mid.y = startPoints[startIndex].y*positionMod + float(i)/numPoints*(target[endIndex].y-startPoints[startIndex].y)*positionMod + modifier[i] + rand()%5;
-			mid.z = startPoints[startIndex].z + float(i)/numPoints*(target[endIndex].z-startPoints[startIndex].z) + rand()%5;
+			// determine the position of the next point to draw a line to, based on the path generated in setupBolts()
+			const ofVec3f &start = startPoints[startIndex];
+			const ofVec3f &end = target[endIndex];
+			const ofVec3f &jag = boltPaths[bolt][i];
+			float t = float(i)/numPoints;
+			mid.x = start.x + t*(end.x-start.x) + jag.x;
+			mid.y = start.y*positionMod + t*(end.y-start.y)*positionMod + jag.y;
+			mid.z = start.z + t*(end.z-start.z) + jag.z;
 
 			// draw lines (multiple for visual effect) between the last point and the next point
-			for (int j = 0; j < intensity; j++) {
-				drawLineStrip(widths[0], colors[0], last, mid);
-				drawLineStrip(widths[1], colors[1], last, mid);
-				drawLineStrip(widths[2], colors[2], last, mid);
+			if (bloomMode) {
+				drawBrightLine(widths[0], core, intensity, last, mid);
+			}
+			else {
+				for (int j = 0; j < intensity; j++) {
+					drawLineStrip(widths[0], colors[0], last, mid);
+					drawLineStrip(widths[1], colors[1], last, mid);
+					drawLineStrip(widths[2], colors[2], last, mid);
+				}
 			}
 			// set the endpoint of this line segment as the starting point for the next segment
 			last = mid;
 			// stop drawing segments when the bolt has not existed for very long - this "animates" the drawing of the bolt
 			if (i > placeCount)
 				break;
-			// emit particles where the bolt ends if the bolt is close to its final point
-			if (i > numPoints - 5 && rand()%sparkMod == 0) {
+		}
+	}
+
+	/* emits particles where a bolt begins, and where it ends once it has been drawn out close to its final point.  Called every simulation step 
+	   for each bolt that draw() renders, with the same target and indices.
+		int sparkMod: determines chance of particles appearing at the start and end points of the bolt; higher causes a lower chance */
+	void emitSparks(const Frame &target, int startIndex, int endIndex, int sparkMod) {
+		if (startIndex >= startPoints.size() || endIndex < 0 || endIndex >= target.size())
+			return;
+		for (int i = 1; i <= numPoints; i++) {
+			if (rng.nextInt(sparkMod) == 0)
+				particleHandler.emit(startPoints[startIndex], ofVec3f(rng.nextInt(2)-1,rng.nextInt(2)-1,rng.nextInt(2)-1), 8, 1);
+			if (i > placeCount)
+				break;
+			if (i > numPoints - 5 && rng.nextInt(sparkMod) == 0) {
 				for (int j = 0; j < 3; j++)
-					particleHandler.emit(target[endIndex], ofVec3f(rand()%2-1,rand()%2-1,rand()%2-1), 8, 1);
+					particleHandler.emit(target[endIndex], ofVec3f(rng.nextInt(2)-1,rng.nextInt(2)-1,rng.nextInt(2)-1), 8, 1);
 			}
 		}
 	}
 
-	// enable openGL lighting with a given set of parameters
-	void showLighting() {
-		glEnable(GL_COLOR_MATERIAL);
-		glEnable(GL_LIGHT0);
-		glEnable(GL_LIGHT1);
-
-		// Create light components
-		GLfloat lightPos[] = {0.0f, 50.0f, -50.0f, 0.0f};
-		GLfloat lightPos1[] = {0.0f, 50.0f, -50.0f, 1.0f};
-		GLfloat ambientLight[] = { 0.0f, 0.0f, 0.0f, 1.0f };
-		GLfloat diffuseLight[] = { 0.0f, 0.0f, 0.0f, 0.5f };
-		GLfloat specularLight[] = { 0.2f, 0.2f, 0.2f, 0.5f };
-		GLfloat ambientLight1[] = { 0.0f, 0.0f, 0.0f, 1.0f };
-		GLfloat diffuseLight1[] = { 0.2f, 0.2f, 0.2f, 1.0f };
-		GLfloat specularLight1[] = { 0.2f, 0.2f, 0.2f, 1.0f };
-		GLfloat direction[] = {0, -1, 0};
-
-		// Assign created components to lights
-		glLightfv(GL_LIGHT0, GL_POSITION, lightPos);
-		glLightfv(GL_LIGHT0, GL_AMBIENT, ambientLight);
-		glLightfv(GL_LIGHT0, GL_DIFFUSE, diffuseLight);
-		glLightfv(GL_LIGHT0, GL_SPECULAR, specularLight);
-		glLightf(GL_LIGHT0, GL_SPOT_CUTOFF, 100.0);
-		glLightfv(GL_LIGHT0, GL_SPOT_DIRECTION, direction);
-		glLightf(GL_LIGHT0, GL_SPOT_EXPONENT, 2.0);
-
-		glLightfv(GL_LIGHT1, GL_POSITION, lightPos);
-		glLightfv(GL_LIGHT1, GL_AMBIENT, ambientLight1);
-		glLightfv(GL_LIGHT1, GL_DIFFUSE, diffuseLight1);
-		glLightfv(GL_LIGHT1, GL_SPECULAR, specularLight1);
-	}
-
-	// draw a plane at y = 0 to show the effect of lighting
-	void drawFloor() {
-		ofSetColor(10, 10, 10, 10);
-		float mcolor[] = { 1.0f, 0.0f, 0.0f, 1.0f };
-		float specReflection[] = {1.0f, 1.0f, 1.0f};
-		float diffuse[] = {1.0f, 1.0f, 1.0f};
-		float ambient[] = {0.0f, 0.0f, 0.0f};
-		glMaterialfv(GL_FRONT, GL_SPECULAR, specReflection);
-		
-		glMaterialfv(GL_FRONT, GL_AMBIENT, ambient);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, diffuse);
+};
 
-		glBegin(GL_QUADS);
-		glVertex3f(-10000.0f, 0.0f, 10000.0f);              // Top Left
-        glVertex3f(10000.0f, 0.0f, 10000.0f);              // Top Right
-        glVertex3f(10000.0f, 0.0f, -10000.0f);              // Bottom Right
-		glVertex3f(-10000.0f, 0.0f, -10000.0f);             // Bottom Left            
-		glNormal3fv(ofVec3f(0.0f, 1.0f, 0.0f).getPtr());
-		glEnd();	
-	}
+// enable openGL lighting with a given set of parameters; used for the floor
+void showLighting() {
+	glEnable(GL_COLOR_MATERIAL);
+	glEnable(GL_LIGHT0);
+	glEnable(GL_LIGHT1);
+
+	// Create light components
+	GLfloat lightPos[] = {0.0f, 50.0f, -50.0f, 0.0f};
+	GLfloat lightPos1[] = {0.0f, 50.0f, -50.0f, 1.0f};
+	GLfloat ambientLight[] = { 0.0f, 0.0f, 0.0f, 1.0f };
+	GLfloat diffuseLight[] = { 0.0f, 0.0f, 0.0f, 0.5f };
+	GLfloat specularLight[] = { 0.2f, 0.2f, 0.2f, 0.5f };
+	GLfloat ambientLight1[] = { 0.0f, 0.0f, 0.0f, 1.0f };
+	GLfloat diffuseLight1[] = { 0.2f, 0.2f, 0.2f, 1.0f };
+	GLfloat specularLight1[] = { 0.2f, 0.2f, 0.2f, 1.0f };
+	GLfloat direction[] = {0, -1, 0};
+
+	// Assign created components to lights
+	glLightfv(GL_LIGHT0, GL_POSITION, lightPos);
+	glLightfv(GL_LIGHT0, GL_AMBIENT, ambientLight);
+	glLightfv(GL_LIGHT0, GL_DIFFUSE, diffuseLight);
+	glLightfv(GL_LIGHT0, GL_SPECULAR, specularLight);
+	glLightf(GL_LIGHT0, GL_SPOT_CUTOFF, 100.0);
+	glLightfv(GL_LIGHT0, GL_SPOT_DIRECTION, direction);
+	glLightf(GL_LIGHT0, GL_SPOT_EXPONENT, 2.0);
+
+	glLightfv(GL_LIGHT1, GL_POSITION, lightPos);
+	glLightfv(GL_LIGHT1, GL_AMBIENT, ambientLight1);
+	glLightfv(GL_LIGHT1, GL_DIFFUSE, diffuseLight1);
+	glLightfv(GL_LIGHT1, GL_SPECULAR, specularLight1);
+}
+
+// draw a plane at y = 0 to show the effect of lighting; once per frame for all figures
+void drawFloor() {
+	ofSetColor(10, 10, 10, 10);
+	float mcolor[] = { 1.0f, 0.0f, 0.0f, 1.0f };
+	float specReflection[] = {1.0f, 1.0f, 1.0f};
+	float diffuse[] = {1.0f, 1.0f, 1.0f};
+	float ambient[] = {0.0f, 0.0f, 0.0f};
+	glMaterialfv(GL_FRONT, GL_SPECULAR, specReflection);
 	
-};
+	glMaterialfv(GL_FRONT, GL_AMBIENT, ambient);
+	glMaterialfv(GL_FRONT, GL_DIFFUSE, diffuse);
+
+	glBegin(GL_QUADS);
+	glVertex3f(-10000.0f, 0.0f, 10000.0f);              // Top Left
+	glVertex3f(10000.0f, 0.0f, 10000.0f);              // Top Right
+	glVertex3f(10000.0f, 0.0f, -10000.0f);              // Bottom Right
+	glVertex3f(-10000.0f, 0.0f, -10000.0f);             // Bottom Left            
+	glNormal3fv(ofVec3f(0.0f, 1.0f, 0.0f).getPtr());
+	glEnd();	
+}
 
 /* functions for running the program in general; nearly all from the original code except for adding more figures to the bvh vector */
 //--------------------------------------------------------------
 void testApp::setup()
 {
+	ofSeedRandom(randomSeed);
+
 	ofSetFrameRate(60);
 	ofSetVerticalSync(true);
 	
@@ -607,12 +994,54 @@ void testApp::setup()
 
 	for (int i = 0; i < bvh.size(); i++)
 	{
+		// one pose per drawn frame, so playback never lands between two captured frames
+		bvh[i].resample(offline.isEnabled() ? offline.getFps() : 60);
 		bvh[i].setFrame(4);
 	}
 	
+	// figures driven by a live feed; each one plays its file until the feed has sent its skeleton
+	for (int i = 0; i < streamAddresses.size() && i < bvh.size(); i++)
+	{
+		ofxBvhStream *s = new ofxBvhStream;
+		s->open(streamAddresses[i]);
+		streams.push_back(s);
+	}
+	
 	track.loadSound("Perfume_globalsite_sound.wav");
 	track.setLoop(true);
-	track.play();
+	if (offline.isEnabled()) {
+		// render as fast as possible, without sound
+		ofSetFrameRate(0);
+		ofSetVerticalSync(false);
+		offline.start(trackDuration);
+	}
+	else {
+		track.play();
+		audioClock.setup(&track);
+	}
+	
+	antialiasing.start();
+	setupBuffers();
+	
+	// bolts are what the show is about, so they keep their density longer than the particles
+	quality.addSubsystem("particles");
+	quality.addSubsystem("bolts", 2);
+	if (stressParticles > 0) {
+		// a budget of the given size, and enough particles emitted per figure and capture frame to fill it: each
+		// emission lives for 25 capture frames in all
+		quality.addKnob(PARTICLES, stressParticles, stressParticles);
+		int emissions = ceil(stressParticles / (bvh.size() * 25.0));
+		quality.addKnob(PARTICLES, emissions, emissions);
+	}
+	else {
+		quality.addKnob(PARTICLES, 2000, 10000);
+		quality.addKnob(PARTICLES, 2, 8);
+	}
+	quality.addKnob(BOLTS, 2, 5);
+	quality.addKnob(BOLTS, 1, 8);
+	// offline renders take as long as they need, at full density
+	if (offline.isEnabled())
+		quality.setEnabled(false);
 	
 	// setup tracker
 	for (int i = 0; i < bvh.size(); i++)
@@ -620,7 +1049,7 @@ void testApp::setup()
 		ofxBvh &b = bvh[i];
 
 		Tracker *t = new Tracker;
-		t->setup(&b, i);
+		t->setup(&b, i, &quality);
 		trackers.push_back(t);
 	}
 	
@@ -631,12 +1060,11 @@ void testApp::setup()
 	trackers[1]->setBvhR(&bvh[2]);
 	trackers[2]->setBvhR(&bvh[0]);
 
-	offset.x = ofRandom(1);
-	offset.y = ofRandom(1);
-	offset.z = ofRandom(1);
-	offset_v.x = ofRandom(0.001);
-	offset_v.y = ofRandom(0.005);
-	offset_v.z = ofRandom(0.001);
+	// a coarse grid over the space the figures move in; the flow changes over four seconds
+	flowField.setup(ofVec3f(-1000, -200, -1000), ofVec3f(1000, 800, 1000), 16, 8, 16);
+	flowField.setSeed(ofRandom(1000));
+	// limbs count as touching a little before they do, as the dancers rarely quite touch
+	contacts.setMargin(30);
 	
 	campos_t.set(0, 0, -300);
 }
@@ -644,48 +1072,169 @@ void testApp::setup()
 //--------------------------------------------------------------
 void testApp::update()
 {
-	float t = (track.getPosition() * trackDuration);
-	t = t / bvh[0].getDuration();
+	quality.beginFrame();
+	// the governor sizes the scene-wide particle budget; lowering it evicts the oldest particles right away
+	particleBudget.setCapacity(quality.get(MAX_PARTICLES));
+	
+	// the antialiasing benchmark changes the mode on its own, and the resolution follows the GPU time of the last frames;
+	// the buffers follow both.  The resolution gives way to the quality governor, which thins out the effects first
+	if (!offline.isEnabled()) {
+		bool changed = antialiasing.update();
+		if (!antialiasing.isBenchmarking() && resolution.update(!quality.isCutting(), quality.isFull()))
+			changed = true;
+		if (changed)
+			setupBuffers();
+	}
+	
+	float t;
+	if (offline.isEnabled()) {
+		t = offline.getTime();
+		elapsedTime = t;
+	}
+	else {
+		// follow the music, smoothing out the coarse position reports of the sound player
+		audioClock.update();
+		t = audioClock.getTime();
+		elapsedTime = ofGetElapsedTimef();
+	}
+	flowField.update(elapsedTime);
 	
 	center_t.set(0, 0, 0);
 	
 	for (int i = 0; i < bvh.size(); i++)
 	{
-		bvh[i].setPosition(t);
+		if (i < streams.size())
+			streams[i]->update(bvh[i]);
+		if (!bvh[i].isLive())
+			bvh[i].setTime(t);
 		bvh[i].update();
 		
 		center_t += bvh[i].getJoint(0)->getPosition();
 	}
 	
 	center_t /= 3;
-	center += (center_t - center) * 0.01;
 	
 	for (int i = 0; i < trackers.size(); i++)
 	{
 		trackers[i]->update();
 	}
 	
-	offset += offset_v;
+	// the bodies the particles bounce off, in this frame's poses
+	quality.begin(PARTICLES);
+	colliders.clear();
+	for (int i = 0; i < trackers.size(); i++)
+		colliders.addSegments(trackers[i]->startPoints, 6);
+	colliders.build();
+	quality.end(PARTICLES);
+	
+	// --stress-particles: how long the collisions took, averaged over a second
+	if (stressParticles > 0 && ofGetFrameNum() % 60 == 0) {
+		ofLogNotice("testApp", ofToString(particleBudget.getSize()) + " particles, " + ofToString(colliders.getNumTested() / 60)
+			+ " collided per frame in " + ofToString(colliders.getTime() / 60, 3) + " ms");
+		colliders.resetTiming();
+	}
+	
+	// bolts follow the joints nearest to them
+	quality.begin(BOLTS);
+	joints.clear();
+	for (int i = 0; i < trackers.size(); i++)
+		joints.add(trackers[i]->startPoints, trackers[i]->id);
+	joints.build();
+	for (int i = 0; i < trackers.size(); i++)
+		trackers[i]->updateTargets();
+	// limbs of different figures coming close fire bolts between them, through Tracker::contactBegan()
+	contacts.clear();
+	for (int i = 0; i < trackers.size(); i++)
+		contacts.addFigure(trackers[i]->startPoints, 6, trackers[i]->id);
+	contacts.update();
+	quality.end(BOLTS);
+	
+	// advance the effects in fixed steps, however often the scene is drawn
+	int steps = simClock.advance(elapsedTime);
+	for (int s = 0; s < steps; s++)
+	{
+		for (int i = 0; i < trackers.size(); i++)
+		{
+			trackers[i]->step(simClock.getStepTime());
+		}
+		
+		center += (center_t - center) * 0.01;
+		campos += (campos_t - campos) * 0.01;
+	}
 	
 	cam.setPosition(campos.x, campos.y, campos.z);
 	cam.lookAt(ofVec3f(0, 0, 0));
-	campos += (campos_t - campos) * 0.01;
 }
 
 //--------------------------------------------------------------
 void testApp::draw(){
+	// the GPU is idle during update(); the frame's GPU time starts here
+	quality.beginFrameDraw();
+	if (offline.isEnabled()) {
+		if (offline.isDone()) {
+			offline.finish();
+			ofExit();
+			return;
+		}
+		if (bloomMode) {
+			drawBloom();
+			offline.begin();
+			bloom.draw(0, 0, offline.getWidth(), offline.getHeight());
+			offline.end();
+		}
+		else {
+			offline.begin();
+			ofClear(10, 255);
+			drawScene();
+			offline.end();
+		}
+		// preview of the frame that was just rendered
+		ofSetColor(255);
+		ofDisableBlendMode();
+		offline.draw(0, 0, ofGetWidth(), ofGetHeight());
+		quality.endFrame();
+		return;
+	}
+
+	// the GPU time of everything drawn for the frame picks the resolution of the next ones
+	resolution.begin();
+
+	if (bloomMode) {
+		drawBloom();
+		bloom.draw(0, 0, ofGetWidth(), ofGetHeight());
+	}
+	else drawScene();
+	resolution.end();
+	quality.endFrame();
+	recorder.capture(ofGetElapsedTimef());
+}
+
+//--------------------------------------------------------------
+// (re)allocates the buffers the scene is drawn through, at the size of the render target and with the samples the
+// antialiasing mode needs
+void testApp::setupBuffers(){
+	// offline renders always use their full size
+	float scale = offline.isEnabled() ? 1 : resolution.getScale();
+	int width = (offline.isEnabled() ? offline.getWidth() : ofGetWidth()) * scale;
+	int height = (offline.isEnabled() ? offline.getHeight() : ofGetHeight()) * scale;
+	if (!bloom.setup(width, height, antialiasing.getNumSamples()))
+		bloomMode = false;
+}
+
+//--------------------------------------------------------------
+// draw the scene into the bloom buffers and run the glow passes; bloom.draw() then composites it into the target
+void testApp::drawBloom(){
+	bloom.begin();
+	ofClear(10, 255);
+	drawScene();
+	bloom.end();
+}
+
+//--------------------------------------------------------------
+void testApp::drawScene(){
 	glDisable(GL_DEPTH_TEST);
 	glShadeModel(GL_SMOOTH);
-	
-	ofEnableSmoothing();
-	
-	glEnable(GL_LINE_SMOOTH);
-	glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
 	glLineWidth(1);
-
-	// smooth particle
-	glEnable(GL_POINT_SMOOTH);
-	glHint(GL_POINT_SMOOTH_HINT, GL_NICEST);
 	
 	ofEnableBlendMode(OF_BLENDMODE_ADD);
 
@@ -694,9 +1243,17 @@ void testApp::draw(){
 	
 	cam.begin();
 	
+	// the same transform as the one applied below, followed by the camera's
+	frustum.setup(ofMatrix4x4::newTranslationMatrix(ofVec3f(-center.x, -100, -center.z))
+		* ofMatrix4x4::newRotationMatrix(elapsedTime * 20, ofVec3f(0, 1, 0))
+		* cam.getModelViewProjectionMatrix());
+	
+	// lines and points are antialiased as chosen with 'a' or --antialiasing
+	antialiasing.begin();
+	
 	ofPushMatrix();
 	{
-		glRotatef(ofGetElapsedTimef() * 20, 0, 1, 0);
+		glRotatef(elapsedTime * 20, 0, 1, 0);
 		glTranslatef(-center.x, -100, -center.z);
 		
 		ofSetColor(50);
@@ -715,10 +1272,37 @@ void testApp::draw(){
 		}*/
 		
 		ofSetColor(ofColor::white, 80);
+		// one pass for each kind of effect, so the governor can time them separately
+		quality.beginDraw(PARTICLES);
+		for (int i = 0; i < trackers.size(); i++)
+		{
+			trackers[i]->drawParticles(simClock.getAlpha());
+		}
+		quality.endDraw(PARTICLES);
 		for (int i = 0; i < trackers.size(); i++)
 		{
 			trackers[i]->draw();
 		}
+		quality.beginDraw(BOLTS);
+		for (int i = 0; i < trackers.size(); i++)
+		{
+			trackers[i]->drawBolts();
+		}
+		quality.endDraw(BOLTS);
+		antialiasing.end();
+
+		// the floor is lit while any figure shows a larger bolt
+		bool lit = false;
+		for (int i = 0; i < trackers.size(); i++)
+		{
+			if (trackers[i]->drawBolt)
+				lit = true;
+		}
+		if (lit)
+			showLighting();
+		drawFloor();
+		glDisable(GL_LIGHT0);
+		glDisable(GL_LIGHT1);
 	}
 	ofPopMatrix();
 	
@@ -728,8 +1312,57 @@ void testApp::draw(){
 	
 }
 
+//--------------------------------------------------------------
+void testApp::exit(){
+	recorder.stop();
+	offline.finish();
+	
+	for (int i = 0; i < streams.size(); i++)
+		delete streams[i];
+	streams.clear();
+}
+
 //--------------------------------------------------------------
 void testApp::keyPressed(int key){
+	// record the window to a video file in the data folder
+	if (key == 'r') {
+		if (recorder.isCapturing()) {
+			recorder.stop();
+			if (recorder.getNumDropped() > 0)
+				ofLogWarning("testApp", "recording dropped " + ofToString(recorder.getNumDropped()) + " frames");
+		}
+		else {
+			string path = ofToDataPath("recording-" + ofToString(ofGetUnixTime()) + ".mp4", true);
+			// the frames repeated or left out as the frame rate varies, so the video plays at 60 frames per second
+			recorder.start(ofGetWidth(), ofGetHeight(), new EncoderSink(path, 60), 60);
+		}
+		return;
+	}
+
+	if (key == 'a') {
+		antialiasing.nextMode();
+		setupBuffers();
+		ofLogNotice("testApp", "antialiasing: " + antialiasing.getModeName());
+		return;
+	}
+
+	if (key == 'd') {
+		resolution.setEnabled(!resolution.isEnabled());
+		setupBuffers();
+		return;
+	}
+
+	if (key == 'g') {
+		quality.setEnabled(!quality.isEnabled());
+		ofLogNotice("testApp", string("quality governor ") + (quality.isEnabled() ? "on" : "off"));
+		return;
+	}
+
+	if (key == 'b') {
+		bloomMode = !bloomMode && bloom.isAllocated();
+		return;
+	}
+
 	campos_t.x = ofRandom(-600, 600);
 	campos_t.z = ofRandom(-600, 600);
 	campos_t.y = ofRandom(-100, 200);
@@ -761,6 +1394,8 @@ void testApp::mouseReleased(int x, int y, int button){
 
 //--------------------------------------------------------------
 void testApp::windowResized(int w, int h){
+	if (!offline.isEnabled())
+		setupBuffers();
 }
 
 //--------------------------------------------------------------
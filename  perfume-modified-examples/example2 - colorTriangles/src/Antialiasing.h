@@ -0,0 +1,78 @@
+#pragma once
+
+#include "ofMain.h"
+
+// Edge antialiasing for the lines and points the scene is drawn with, in one of three ways:
+//
+//   smooth   GL_LINE_SMOOTH and GL_POINT_SMOOTH with NICEST hints, as the examples always did.  Many drivers draw
+//            these on slow paths or in software, and core profiles don't have them.
+//   msaa     the scene buffer is multisampled (see Bloom::setup()) and lines and points are drawn aliased; the
+//            samples are resolved when the buffer is read.  Only the offscreen buffers are multisampled, not the window.
+//   shader   lines and points are drawn a pixel wider and a shader fades their edges by the distance of each fragment
+//            from the center line or point.  Wide lines are filled with the attributes of their center line, so the
+//            interpolated window position of the vertices gives that distance.
+//
+// Between begin() and end(), set sizes with lineWidth() and pointSize() instead of glLineWidth() and glPointSize(),
+// so the shader knows them.  From the command line:
+//
+//   example [--antialiasing smooth|msaa|shader] [--samples 4] [--aa-benchmark 600]
+//
+// --aa-benchmark draws the given number of frames in each mode with vertical sync off, and logs the mean frame time of
+// each, to compare the modes on a driver.
+class Antialiasing
+{
+public:
+
+	enum Mode
+	{
+		SMOOTH, MULTISAMPLE, SHADER, NUM_MODES
+	};
+
+	Antialiasing() : mode(MULTISAMPLE), samples(4), shaderLoaded(false), benchmarkFrames(0), frame(0) {}
+
+	// reads the options above from the command line
+	void setup(int argc, char *argv[]);
+	// compiles the shader and falls back to smooth if the chosen mode is not supported; needs a GL context
+	void start();
+
+	Mode getMode() const { return mode; }
+	string getModeName() const { return getModeName(mode); }
+	static string getModeName(Mode mode);
+	// unsupported modes are skipped
+	void setMode(Mode mode);
+	void nextMode();
+
+	// samples the scene buffers should be allocated with: 0 unless the mode is msaa
+	int getNumSamples() const { return mode == MULTISAMPLE ? samples : 0; }
+
+	// antialias what is drawn in between
+	void begin();
+	void end();
+
+	static void lineWidth(float width);
+	static void pointSize(float size);
+
+	// call once per frame; returns true when the benchmark changed the mode, so the scene buffers have to be reallocated
+	bool update();
+	bool isBenchmarking() const { return benchmarkFrames > 0; }
+
+protected:
+
+	Mode mode;
+	int samples;
+
+	ofShader shader;
+	bool shaderLoaded;
+
+	// frames per mode, and the frame of the current mode; the first few frames after a switch are not counted
+	int benchmarkFrames;
+	int frame;
+	double frameTimes[NUM_MODES];
+	Mode benchmarkStart;
+
+	// the instance between begin() and end(), for the static size functions
+	static Antialiasing *active;
+
+	bool isSupported(Mode mode) const;
+	void logBenchmark();
+};
@@ -0,0 +1,199 @@
+#include "Bloom.h"
+
+// The buffers use rectangle textures, as ofFbo does by default, so texture coordinates are in pixels of the source.
+
+static const char *vertexSource =
+	"#version 120\n"
+	"void main() {\n"
+	"	gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+	"	gl_Position = ftransform();\n"
+	"}\n";
+
+// averages a 4x4 block of the source with four bilinear taps, keeping only what is brighter than the threshold;
+// below it the glow fades in quadratically over the width of the knee, so there is no hard edge
+static const char *downsampleSource =
+	"#version 120\n"
+	"#extension GL_ARB_texture_rectangle : enable\n"
+	"uniform sampler2DRect tex0;\n"
+	"uniform float threshold;\n"
+	"uniform float knee;\n"
+	"void main() {\n"
+	"	vec2 p = gl_TexCoord[0].st;\n"
+	"	vec3 c = texture2DRect(tex0, p + vec2(-1.0, -1.0)).rgb;\n"
+	"	c += texture2DRect(tex0, p + vec2(1.0, -1.0)).rgb;\n"
+	"	c += texture2DRect(tex0, p + vec2(-1.0, 1.0)).rgb;\n"
+	"	c += texture2DRect(tex0, p + vec2(1.0, 1.0)).rgb;\n"
+	"	c *= 0.25;\n"
+	"	float brightness = max(c.r, max(c.g, c.b));\n"
+	"	float soft = clamp(brightness - threshold + knee, 0.0, 2.0 * knee);\n"
+	"	soft = soft * soft / (4.0 * knee + 0.0001);\n"
+	"	c *= max(soft, brightness - threshold) / max(brightness, 0.0001);\n"
+	"	gl_FragColor = vec4(c, 1.0);\n"
+	"}\n";
+
+// one direction of a 9 tap gaussian, in 5 bilinear taps
+static const char *blurSource =
+	"#version 120\n"
+	"#extension GL_ARB_texture_rectangle : enable\n"
+	"uniform sampler2DRect tex0;\n"
+	"uniform vec2 direction;\n"
+	"void main() {\n"
+	"	vec2 p = gl_TexCoord[0].st;\n"
+	"	vec2 d1 = direction * 1.3846153846;\n"
+	"	vec2 d2 = direction * 3.2307692308;\n"
+	"	vec3 c = texture2DRect(tex0, p).rgb * 0.2270270270;\n"
+	"	c += (texture2DRect(tex0, p + d1).rgb + texture2DRect(tex0, p - d1).rgb) * 0.3162162162;\n"
+	"	c += (texture2DRect(tex0, p + d2).rgb + texture2DRect(tex0, p - d2).rgb) * 0.0702702703;\n"
+	"	gl_FragColor = vec4(c, 1.0);\n"
+	"}\n";
+
+// adds the glow to the scene and maps the result to the displayable range; dark values pass through nearly unchanged
+static const char *compositeSource =
+	"#version 120\n"
+	"#extension GL_ARB_texture_rectangle : enable\n"
+	"uniform sampler2DRect tex0;\n"
+	"uniform sampler2DRect glow;\n"
+	"uniform vec2 glowScale;\n"
+	"uniform float strength;\n"
+	"uniform float exposure;\n"
+	"void main() {\n"
+	"	vec2 p = gl_TexCoord[0].st;\n"
+	"	vec3 c = texture2DRect(tex0, p).rgb + texture2DRect(glow, p * glowScale).rgb * strength;\n"
+	"	gl_FragColor = vec4(1.0 - exp(-c * exposure), 1.0);\n"
+	"}\n";
+
+bool Bloom::setup(int width, int height, int numSamples)
+{
+	if (width == this->width && height == this->height && numSamples == samples)
+		return true;
+
+	if (!downsampleShader.isLoaded())
+	{
+		if (!loadShader(downsampleShader, downsampleSource) || !loadShader(blurShader, blurSource)
+			|| !loadShader(compositeShader, compositeSource))
+		{
+			ofLogError("Bloom", "could not compile the shaders");
+			this->width = this->height = 0;
+			return false;
+		}
+	}
+
+	this->width = width;
+	this->height = height;
+	samples = numSamples;
+
+	// half floats, so overlapping additive primitives keep adding up past white; the samples are resolved into the
+	// texture the chain reads
+	scene.allocate(width, height, GL_RGBA16F_ARB, numSamples);
+
+	ofFbo::Settings settings;
+	settings.internalformat = GL_RGBA16F_ARB;
+	settings.useDepth = false;
+	settings.useStencil = false;
+
+	for (int i = 0; i < NUM_LEVELS; i++)
+	{
+		settings.width = MAX(1, width >> (i + 1));
+		settings.height = MAX(1, height >> (i + 1));
+		levels[i].allocate(settings);
+		temp[i].allocate(settings);
+	}
+
+	return true;
+}
+
+bool Bloom::loadShader(ofShader& shader, const char *fragment)
+{
+	return shader.setupShaderFromSource(GL_VERTEX_SHADER, vertexSource)
+		&& shader.setupShaderFromSource(GL_FRAGMENT_SHADER, fragment)
+		&& shader.linkProgram();
+}
+
+void Bloom::begin()
+{
+	scene.begin();
+
+	glClampColorARB(GL_CLAMP_VERTEX_COLOR_ARB, GL_FALSE);
+	glClampColorARB(GL_CLAMP_FRAGMENT_COLOR_ARB, GL_FALSE);
+}
+
+void Bloom::end()
+{
+	glClampColorARB(GL_CLAMP_VERTEX_COLOR_ARB, GL_TRUE);
+	glClampColorARB(GL_CLAMP_FRAGMENT_COLOR_ARB, GL_FIXED_ONLY_ARB);
+
+	scene.end();
+
+	ofPushStyle();
+	ofDisableBlendMode();
+	ofSetColor(255);
+
+	// the bright parts of the scene, then every level from the one above it
+	downsample(scene, levels[0], threshold, knee);
+	for (int i = 1; i < NUM_LEVELS; i++)
+		downsample(levels[i - 1], levels[i], 0, 0);
+
+	for (int i = 0; i < NUM_LEVELS; i++)
+		blur(i);
+
+	// add each level to the one above it, from the smallest up, so levels[0] ends up with the sum of all of them
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+	for (int i = NUM_LEVELS - 1; i > 0; i--)
+	{
+		levels[i - 1].begin();
+		levels[i].draw(0, 0, levels[i - 1].getWidth(), levels[i - 1].getHeight());
+		levels[i - 1].end();
+	}
+
+	ofPopStyle();
+}
+
+void Bloom::downsample(ofFbo& source, ofFbo& target, float threshold, float knee)
+{
+	target.begin();
+	downsampleShader.begin();
+	downsampleShader.setUniform1f("threshold", threshold);
+	downsampleShader.setUniform1f("knee", knee);
+	source.draw(0, 0, target.getWidth(), target.getHeight());
+	downsampleShader.end();
+	target.end();
+}
+
+void Bloom::blur(int level)
+{
+	ofFbo &a = levels[level];
+	ofFbo &b = temp[level];
+
+	blurShader.begin();
+
+	b.begin();
+	blurShader.setUniform2f("direction", 1, 0);
+	a.draw(0, 0);
+	b.end();
+
+	a.begin();
+	blurShader.setUniform2f("direction", 0, 1);
+	b.draw(0, 0);
+	a.end();
+
+	blurShader.end();
+}
+
+void Bloom::draw(float x, float y, float w, float h)
+{
+	ofPushStyle();
+	ofDisableBlendMode();
+	ofSetColor(255);
+
+	compositeShader.begin();
+	compositeShader.setUniformTexture("glow", levels[0].getTextureReference(), 1);
+	compositeShader.setUniform2f("glowScale", levels[0].getWidth() / width, levels[0].getHeight() / height);
+	// the levels add up to NUM_LEVELS times the brightness of a wide, even glow
+	compositeShader.setUniform1f("strength", strength / NUM_LEVELS);
+	compositeShader.setUniform1f("exposure", exposure);
+	scene.draw(x, y, w, h);
+	compositeShader.end();
+
+	ofPopStyle();
+}
@@ -0,0 +1,155 @@
+#include "Colliders.h"
+
+void Colliders::clear()
+{
+	capsules.clear();
+	hash.clear();
+}
+
+void Colliders::addCapsule(const ofVec3f &a, const ofVec3f &b, float radius)
+{
+	Capsule c;
+	c.a = a;
+	c.b = b;
+	c.radius = radius;
+	capsules.push_back(c);
+
+	ofVec3f r(radius, radius, radius);
+	hash.insert(capsules.size() - 1, ofVec3f(MIN(a.x, b.x), MIN(a.y, b.y), MIN(a.z, b.z)) - r, ofVec3f(MAX(a.x, b.x), MAX(a.y, b.y), MAX(a.z, b.z)) + r);
+}
+
+void Colliders::addSegments(const vector<ofVec3f> &segments, float radius)
+{
+	for (int i = 0; i + 1 < segments.size(); i += 2)
+		addCapsule(segments[i], segments[i + 1], radius);
+}
+
+void Colliders::build()
+{
+	hash.build();
+
+	int n = hash.getNumEntries();
+	ax.resize(n); ay.resize(n); az.resize(n);
+	dx.resize(n); dy.resize(n); dz.resize(n);
+	inverseLengths.resize(n);
+	inverseRadii.resize(n);
+	radii.resize(n);
+	for (int j = 0; j < n; j++)
+	{
+		const Capsule &c = capsules[hash.getItem(j)];
+		ofVec3f d = c.b - c.a;
+		float length = d.lengthSquared();
+		ax[j] = c.a.x; ay[j] = c.a.y; az[j] = c.a.z;
+		dx[j] = d.x; dy[j] = d.y; dz[j] = d.z;
+		// a zero length capsule is a sphere around a
+		inverseLengths[j] = length > 0 ? 1 / length : 0;
+		inverseRadii[j] = 1 / (c.radius * c.radius);
+		radii[j] = c.radius;
+	}
+}
+
+int Colliders::collide(vector<ofVec3f> &positions, vector<ofVec3f> &velocities, float bounce)
+{
+	unsigned long long started = ofGetElapsedTimeMicros();
+	int count = positions.size();
+	int hits = 0;
+
+	if (floor)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			if (positions[i].y < floorHeight)
+			{
+				positions[i].y = floorHeight;
+				if (velocities[i].y < 0)
+					velocities[i].y *= -bounce;
+				hits++;
+			}
+		}
+	}
+
+	int numBuckets = hash.getNumBuckets();
+	if (count > 0 && hash.getNumEntries() > 0)
+	{
+		// counting sort of the points by bucket
+		buckets.resize(count);
+		bucketStarts.assign(numBuckets + 1, 0);
+		for (int i = 0; i < count; i++)
+		{
+			buckets[i] = hash.getBucket(positions[i]);
+			bucketStarts[buckets[i] + 1]++;
+		}
+		for (int b = 0; b < numBuckets; b++)
+			bucketStarts[b + 1] += bucketStarts[b];
+
+		order.resize(count);
+		px.resize(count); py.resize(count); pz.resize(count);
+		vector<int> next(bucketStarts.begin(), bucketStarts.end() - 1);
+		for (int i = 0; i < count; i++)
+		{
+			int k = next[buckets[i]]++;
+			order[k] = i;
+			px[k] = positions[i].x; py[k] = positions[i].y; pz[k] = positions[i].z;
+		}
+
+		// how far inside a capsule each point is, relative to its radius: the squared distance to the closest point on
+		// the segment over the squared radius, below 1 inside.  The deepest capsule pushes the point out
+		depths.assign(count, 1);
+		ts.resize(count);
+		deepest.assign(count, -1);
+		for (int b = 0; b < numBuckets; b++)
+		{
+			int p0 = bucketStarts[b], p1 = bucketStarts[b + 1];
+			if (p0 == p1)
+				continue;
+			int first;
+			int n = hash.queryBucket(b, first);
+			for (int j = first; j < first + n; j++)
+			{
+				float cx = ax[j], cy = ay[j], cz = az[j];
+				float ex = dx[j], ey = dy[j], ez = dz[j];
+				float inverseLength = inverseLengths[j], inverseRadius = inverseRadii[j];
+				for (int k = p0; k < p1; k++)
+				{
+					float qx = px[k] - cx, qy = py[k] - cy, qz = pz[k] - cz;
+					float t = (qx * ex + qy * ey + qz * ez) * inverseLength;
+					t = t < 0 ? 0 : (t > 1 ? 1 : t);
+					qx -= ex * t; qy -= ey * t; qz -= ez * t;
+					float depth = (qx * qx + qy * qy + qz * qz) * inverseRadius;
+					bool deeper = depth < depths[k];
+					depths[k] = deeper ? depth : depths[k];
+					ts[k] = deeper ? t : ts[k];
+					deepest[k] = deeper ? j : deepest[k];
+				}
+			}
+		}
+
+		for (int k = 0; k < count; k++)
+		{
+			int j = deepest[k];
+			if (j < 0)
+				continue;
+
+			int i = order[k];
+			float t = ts[k];
+			ofVec3f closest(ax[j] + dx[j] * t, ay[j] + dy[j] * t, az[j] + dz[j] * t);
+			ofVec3f normal = positions[i] - closest;
+			float distance = normal.length();
+			// exactly on the bone: out sideways
+			if (distance > 0)
+				normal /= distance;
+			else
+				normal.set(0, 1, 0);
+
+			positions[i] = closest + normal * radii[j];
+			float into = velocities[i].dot(normal);
+			if (into < 0)
+				velocities[i] -= normal * (into * (1 + bounce));
+			hits++;
+		}
+	}
+
+	time += ofGetElapsedTimeMicros() - started;
+	tested += count;
+	return hits;
+}
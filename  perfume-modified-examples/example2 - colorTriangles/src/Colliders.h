@@ -0,0 +1,85 @@
+#pragma once
+
+#include "ofMain.h"
+#include "SpatialHash.h"
+
+// Keeps particles out of the floor and the dancers' bodies.  A body is a set of capsules around the bones of its
+// current pose, added again every frame; a spatial hash finds the few capsules near a particle, so the cost grows with
+// the number of particles and not with particles times bones.
+//
+// The particles of a system are tested together: they are sorted by the hash bucket they fall in, and every capsule
+// of a bucket is tested against all of its particles in one loop.  build() copies the capsules into arrays in bucket
+// order, so a bucket's capsules lie side by side and the loop reads nothing through an index.  The loop has no
+// branches, so the compiler can vectorize it across the particles; it is still correct, and no slower than testing
+// one particle at a time, where it does not.
+//
+//   colliders.clear();
+//   colliders.addSegments(bones, 8);        // for every figure
+//   colliders.build();
+//   ...
+//   colliders.collide(positions, velocities, 0.5);
+class Colliders
+{
+public:
+
+	Colliders() : floor(true), floorHeight(0), time(0), tested(0) { hash.setCellSize(40); }
+
+	// a horizontal plane nothing passes below
+	void setFloor(bool enabled, float height = 0) { floor = enabled; floorHeight = height; }
+	// edge length of the hash cells; about the length of a bone works best
+	void setCellSize(float size) { hash.setCellSize(size); }
+
+	void clear();
+	// a capsule of the given radius around the segment from a to b
+	void addCapsule(const ofVec3f &a, const ofVec3f &b, float radius);
+	// a capsule around every pair of points, as the bone segments Tracker keeps for a pose
+	void addSegments(const vector<ofVec3f> &segments, float radius);
+	// call after adding the capsules and before collide()
+	void build();
+
+	// moves the points inside the floor or a capsule out to its surface and reflects the part of their velocities that
+	// points into it, scaled by bounce; returns how many times a point was pushed out
+	int collide(vector<ofVec3f> &positions, vector<ofVec3f> &velocities, float bounce);
+
+	int getNumCapsules() const { return capsules.size(); }
+
+	// milliseconds spent in collide() and points it tested since the last resetTiming(), for profiling
+	float getTime() const { return time / 1000.0f; }
+	int getNumTested() const { return tested; }
+	void resetTiming() { time = 0; tested = 0; }
+
+protected:
+
+	struct Capsule
+	{
+		ofVec3f a, b;
+		float radius;
+	};
+
+	bool floor;
+	float floorHeight;
+
+	// as added
+	vector<Capsule> capsules;
+	// as the hash lists them, a capsule once for every bucket it is in: start point, the segment to the end point, one
+	// over its squared length and one over the squared radius
+	vector<float> ax, ay, az;
+	vector<float> dx, dy, dz;
+	vector<float> inverseLengths;
+	vector<float> inverseRadii;
+	vector<float> radii;
+
+	SpatialHash hash;
+
+	// the points of the last collide() by bucket: the bucket of each point, where each bucket's points start, the
+	// points' numbers in that order and their coordinates, and how deep they are in which capsule so far
+	vector<unsigned int> buckets;
+	vector<int> bucketStarts;
+	vector<int> order;
+	vector<float> px, py, pz;
+	vector<float> depths, ts;
+	vector<int> deepest;
+
+	unsigned long long time;
+	int tested;
+};
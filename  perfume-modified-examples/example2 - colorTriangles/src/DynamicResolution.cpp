@@ -0,0 +1,83 @@
+#include "DynamicResolution.h"
+
+const float DynamicResolution::SCALES[NUM_LEVELS] = { 1, 0.85, 0.7, 0.6, 0.5 };
+
+// frames in a row over the budget before the resolution drops
+static const int FRAMES_OVER = 8;
+// frames in a row with room to spare before it rises again
+static const int FRAMES_UNDER = 90;
+// the predicted time at the level above has to stay under this fraction of the budget
+static const float HEADROOM = 0.85;
+// frames to ignore after a change, while the timer still reports frames drawn at the old size
+static const int SETTLE_FRAMES = 20;
+
+void DynamicResolution::setup(int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (string(argv[i]) == "--gpu-budget" && i + 1 < argc)
+		{
+			float ms = ofToFloat(argv[++i]);
+			if (ms > 0)
+				budget = ms / 1000;
+			else
+				enabled = false;
+		}
+	}
+}
+
+void DynamicResolution::setEnabled(bool enabled)
+{
+	this->enabled = enabled;
+	setLevel(0);
+}
+
+void DynamicResolution::setLevel(int level)
+{
+	this->level = level;
+	over = under = 0;
+	settle = SETTLE_FRAMES;
+}
+
+bool DynamicResolution::update(bool mayDrop, bool mayRise)
+{
+	if (!isEnabled())
+		return false;
+
+	float time = timer.getTime();
+	if (time <= 0)
+		return false;
+
+	smoothed = smoothed > 0 ? smoothed + (time - smoothed) * 0.2 : time;
+
+	if (settle > 0)
+	{
+		settle--;
+		return false;
+	}
+
+	over = mayDrop && smoothed > budget ? over + 1 : 0;
+
+	// the cost of a frame is mostly in its pixels
+	if (level > 0)
+	{
+		float ratio = SCALES[level - 1] / SCALES[level];
+		under = mayRise && smoothed * ratio * ratio < budget * HEADROOM ? under + 1 : 0;
+	}
+
+	if (over >= FRAMES_OVER && level < NUM_LEVELS - 1)
+	{
+		setLevel(level + 1);
+		ofLogVerbose("DynamicResolution", "scale " + ofToString(getScale(), 2) + ", gpu " + ofToString(smoothed * 1000, 1) + " ms");
+		return true;
+	}
+
+	if (under >= FRAMES_UNDER && level > 0)
+	{
+		setLevel(level - 1);
+		ofLogVerbose("DynamicResolution", "scale " + ofToString(getScale(), 2) + ", gpu " + ofToString(smoothed * 1000, 1) + " ms");
+		return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,266 @@
+#include "FrameCapture.h"
+
+#ifdef TARGET_WIN32
+#define popen _popen
+#define pclose _pclose
+#define PIPE_WRITE_MODE "wb"
+#else
+#define PIPE_WRITE_MODE "w"
+#endif
+
+//--------------------------------------------------------------
+bool EncoderSink::open(int width, int height)
+{
+	// frames arrive bottom row first, so the encoder flips them
+	if (command.empty())
+	{
+		command = "ffmpeg -y -f rawvideo -pix_fmt rgba -s " + ofToString(width) + "x" + ofToString(height)
+			+ " -r " + ofToString(fps) + " -i - -vf vflip -c:v libx264 -preset fast -pix_fmt yuv420p \"" + path + "\"";
+	}
+
+	pipe = popen(command.c_str(), PIPE_WRITE_MODE);
+	if (!pipe)
+	{
+		ofLogError("EncoderSink", "could not start encoder: " + command);
+		return false;
+	}
+
+	return true;
+}
+
+void EncoderSink::write(const unsigned char *pixels, int width, int height, int /*frame*/)
+{
+	fwrite(pixels, 1, width * height * 4, pipe);
+}
+
+void EncoderSink::close()
+{
+	if (pipe)
+		pclose(pipe);
+	pipe = NULL;
+}
+
+//--------------------------------------------------------------
+void ImageSequenceSink::write(const unsigned char *pixels, int width, int height, int frame)
+{
+	char name[1024];
+	if (pattern.size() > 1000) return;
+	sprintf(name, pattern.c_str(), frame);
+
+	image.setFromPixels(pixels, width, height, OF_IMAGE_COLOR_ALPHA);
+	image.mirror(true, false);
+	ofSaveImage(image, name);
+}
+
+//--------------------------------------------------------------
+FrameCapture::FrameCapture(int numBuffers) : numBuffers(max(numBuffers, 2)), width(0), height(0),
+	blocking(false), fps(0), startTime(0), sink(NULL), queued(0), captured(0), dropped(0), scheduled(0),
+	carriedFirst(0), carriedCount(0)
+{
+}
+
+FrameCapture::~FrameCapture()
+{
+	stop();
+}
+
+bool FrameCapture::start(int width, int height, FrameSink *sink, float fps)
+{
+	stop();
+
+	if (!sink->open(width, height))
+	{
+		delete sink;
+		return false;
+	}
+
+	this->width = width;
+	this->height = height;
+	this->sink = sink;
+	this->fps = fps;
+
+	queued = 0;
+	captured = 0;
+	dropped = 0;
+	scheduled = 0;
+	firstFrames.assign(numBuffers, 0);
+	frameCounts.assign(numBuffers, 1);
+	carriedCount = 0;
+
+	pbos.resize(numBuffers);
+	glGenBuffers(numBuffers, &pbos[0]);
+	for (int i = 0; i < numBuffers; i++)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, width * height * 4, NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	// one spare image lets the sink fall behind by a frame without anything being dropped
+	for (int i = 0; i < numBuffers + 1; i++)
+	{
+		Image *image = new Image;
+		image->pixels.resize(width * height * 4);
+		images.push_back(image);
+		freeImages.push_back(image);
+	}
+
+	startThread(true, false);
+
+	return true;
+}
+
+void FrameCapture::stop()
+{
+	if (!sink) return;
+
+	// collect the reads that are still in flight
+	for (int i = max(0, queued - (numBuffers - 1)); i < queued; i++)
+		readBuffer(i);
+
+	// let the sink write everything that is queued before stopping the thread
+	while (true)
+	{
+		lock();
+		bool empty = pendingImages.empty();
+		unlock();
+
+		if (empty) break;
+		ofSleepMillis(1);
+	}
+
+	waitForThread(true);
+
+	sink->close();
+	delete sink;
+	sink = NULL;
+
+	glDeleteBuffers(pbos.size(), &pbos[0]);
+	pbos.clear();
+
+	for (int i = 0; i < images.size(); i++)
+		delete images[i];
+	images.clear();
+	freeImages.clear();
+	pendingImages.clear();
+
+	ofLogNotice("FrameCapture", ofToString(captured) + " frames captured, " + ofToString(dropped) + " dropped");
+}
+
+void FrameCapture::capture(float time)
+{
+	if (!sink) return;
+
+	// the output frames this one fills: those up to its time at a constant rate, which can be none
+	int count = 1;
+	if (fps > 0)
+	{
+		if (queued == 0)
+			startTime = time;
+		count = (int)floor((time - startTime) * fps) + 1 - scheduled;
+		if (count <= 0) return;
+	}
+	firstFrames[queued % numBuffers] = scheduled;
+	frameCounts[queued % numBuffers] = count;
+	scheduled += count;
+
+	// start an asynchronous copy of this frame
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[queued % numBuffers]);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	queued++;
+
+	// the oldest copy in the ring has had numBuffers - 1 frames to complete
+	if (queued >= numBuffers)
+		readBuffer(queued - numBuffers);
+}
+
+void FrameCapture::readBuffer(int index)
+{
+	// with the output frames of any frames dropped before
+	int first = carriedCount > 0 ? carriedFirst : firstFrames[index % numBuffers];
+	int count = carriedCount + frameCounts[index % numBuffers];
+	carriedFirst = first;
+	carriedCount = count;
+
+	Image *image = NULL;
+
+	while (true)
+	{
+		lock();
+		if (!freeImages.empty())
+		{
+			image = freeImages.front();
+			freeImages.pop_front();
+		}
+		unlock();
+
+		if (image || !blocking) break;
+		ofSleepMillis(1);
+	}
+
+	// the sink is too slow to keep up; skip this frame rather than stall drawing, and let the next one fill its place
+	if (!image)
+	{
+		dropped++;
+		return;
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[index % numBuffers]);
+	const unsigned char *pixels = (const unsigned char*)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+	if (pixels)
+	{
+		memcpy(&image->pixels[0], pixels, image->pixels.size());
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	lock();
+	if (pixels)
+	{
+		image->frame = first;
+		image->count = count;
+		pendingImages.push_back(image);
+	}
+	else freeImages.push_back(image);
+	unlock();
+
+	if (pixels)
+	{
+		captured++;
+		carriedCount = 0;
+	}
+	else
+		dropped++;
+}
+
+void FrameCapture::threadedFunction()
+{
+	while (isThreadRunning())
+	{
+		Image *image = NULL;
+
+		lock();
+		if (!pendingImages.empty())
+		{
+			image = pendingImages.front();
+			pendingImages.pop_front();
+		}
+		unlock();
+
+		if (!image)
+		{
+			ofSleepMillis(1);
+			continue;
+		}
+
+		for (int i = 0; i < image->count; i++)
+			sink->write(&image->pixels[0], width, height, image->frame + i);
+
+		lock();
+		freeImages.push_back(image);
+		unlock();
+	}
+}
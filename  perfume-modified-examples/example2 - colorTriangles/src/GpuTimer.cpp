@@ -0,0 +1,57 @@
+#include "GpuTimer.h"
+
+GpuTimer::~GpuTimer()
+{
+	if (allocated)
+		glDeleteQueries(NUM_INTERVALS * 2, &queries[0][0]);
+}
+
+void GpuTimer::begin()
+{
+	measuring = false;
+
+	if (!isSupported()) return;
+
+	if (!allocated)
+	{
+		glGenQueries(NUM_INTERVALS * 2, &queries[0][0]);
+		allocated = true;
+	}
+
+	collect();
+
+	if (head - tail >= NUM_INTERVALS) return;
+
+	glQueryCounter(queries[head % NUM_INTERVALS][0], GL_TIMESTAMP);
+	measuring = true;
+}
+
+void GpuTimer::end()
+{
+	if (!measuring) return;
+
+	glQueryCounter(queries[head % NUM_INTERVALS][1], GL_TIMESTAMP);
+	head++;
+	measuring = false;
+}
+
+void GpuTimer::collect()
+{
+	while (tail != head)
+	{
+		GLuint *interval = queries[tail % NUM_INTERVALS];
+
+		// the end of an interval is written after its start
+		GLint available = 0;
+		glGetQueryObjectiv(interval[1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) break;
+
+		GLuint64 start, stop;
+		glGetQueryObjectui64v(interval[0], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(interval[1], GL_QUERY_RESULT, &stop);
+
+		// nanoseconds
+		time = (stop - start) / 1000000000.0;
+		tail++;
+	}
+}
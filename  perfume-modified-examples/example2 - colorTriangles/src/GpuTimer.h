@@ -0,0 +1,39 @@
+#pragma once
+
+#include "ofMain.h"
+
+// Measures how long the GPU takes for the commands issued between begin() and end(), without waiting for it.  Each
+// interval is marked with a pair of timestamp queries that are read back a few frames later, once the GPU has passed
+// them, so getTime() lags the frame being drawn by that much.  Timers can be nested and overlap.
+//
+// Without ARB_timer_query the timer measures nothing and getTime() stays 0.
+class GpuTimer
+{
+public:
+
+	GpuTimer() : head(0), tail(0), measuring(false), time(0), allocated(false) {}
+	virtual ~GpuTimer();
+
+	void begin();
+	void end();
+
+	// seconds the most recent finished interval took on the GPU
+	float getTime() const { return time; }
+
+	static bool isSupported() { return GLEW_ARB_timer_query; }
+
+protected:
+
+	// intervals that can be in flight; when all of them are, begin() skips the interval instead of waiting
+	static const int NUM_INTERVALS = 4;
+
+	GLuint queries[NUM_INTERVALS][2];
+	// intervals are started at head and read back at tail; both only ever increase
+	unsigned int head, tail;
+	bool measuring;
+	float time;
+	bool allocated;
+
+	// reads back the intervals the GPU has finished
+	void collect();
+};
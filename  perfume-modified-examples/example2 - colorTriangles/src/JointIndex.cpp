@@ -0,0 +1,112 @@
+#include "JointIndex.h"
+
+void JointIndex::clear()
+{
+	positions.clear();
+	figures.clear();
+	indices.clear();
+	hash.clear();
+}
+
+void JointIndex::add(const vector<ofVec3f> &points, int figure)
+{
+	for (int i = 0; i < points.size(); i++)
+	{
+		hash.insert(positions.size(), points[i], points[i]);
+		positions.push_back(points[i]);
+		figures.push_back(figure);
+		indices.push_back(i);
+	}
+}
+
+void JointIndex::build()
+{
+	hash.build();
+}
+
+int JointIndex::findNearest(const ofVec3f &position, int figure, float minDistance, float maxDistance) const
+{
+	float distance;
+	int nearest = search(position, figure, minDistance, maxDistance, distance);
+	return nearest >= 0 ? indices[nearest] : -1;
+}
+
+int JointIndex::findNearestPairs(int figure, int other, float maxDistance, int *from, int *to, int count) const
+{
+	// the nearest joint of other to every joint of figure, by their numbers in the index
+	vector< pair<float, pair<int, int> > > pairs;
+	for (int i = 0; i < positions.size(); i++)
+	{
+		if (figures[i] != figure)
+			continue;
+		float distance;
+		int nearest = search(positions[i], other, 0, maxDistance, distance);
+		if (nearest >= 0)
+			pairs.push_back(make_pair(distance, make_pair(i, nearest)));
+	}
+	sort(pairs.begin(), pairs.end());
+
+	vector<int> starts(count);
+	int n = 0;
+	for (int k = 0; k < pairs.size() && n < count; k++)
+	{
+		// a joint is in the segments once for every bone at it, so the same point comes up more than once
+		int i = pairs[k].second.first;
+		bool taken = false;
+		for (int m = 0; m < n && !taken; m++)
+			taken = positions[i] == positions[starts[m]];
+		if (taken)
+			continue;
+		starts[n] = i;
+		from[n] = indices[i];
+		to[n] = indices[pairs[k].second.second];
+		n++;
+	}
+	return n;
+}
+
+int JointIndex::search(const ofVec3f &position, int figure, float minDistance, float maxDistance, float &distance) const
+{
+	float cellSize = hash.getCellSize();
+	int cx = hash.getCell(position.x), cy = hash.getCell(position.y), cz = hash.getCell(position.z);
+	int shells = ceil(maxDistance / cellSize);
+
+	float min2 = minDistance * minDistance;
+	float best = maxDistance * maxDistance;
+	int nearest = -1;
+	for (int r = 0; r <= shells; r++)
+	{
+		// the cells at r steps from the point's cell along some axis; inside the faces of the shell only the two
+		// cells at either end of each row
+		for (int z = cz - r; z <= cz + r; z++)
+		{
+			for (int y = cy - r; y <= cy + r; y++)
+			{
+				bool face = abs(z - cz) == r || abs(y - cy) == r;
+				for (int x = cx - r; x <= cx + r; x += face ? 1 : 2 * r)
+				{
+					const int *items;
+					int n = hash.queryCell(x, y, z, items);
+					for (int k = 0; k < n; k++)
+					{
+						int i = items[k];
+						if (figures[i] != figure)
+							continue;
+						float d = position.squareDistance(positions[i]);
+						if (d >= min2 && d <= best)
+						{
+							best = d;
+							nearest = i;
+						}
+					}
+				}
+			}
+		}
+
+		// everything in the next shell is at least r cells away
+		if (nearest >= 0 && best <= (r * cellSize) * (r * cellSize))
+			break;
+	}
+	distance = best;
+	return nearest;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "ofMain.h"
+#include "SpatialHash.h"
+
+// Finds the joint of a figure nearest to a point, for bolts that jump to whatever is closest.  The joints of all
+// figures go into one spatial hash every frame, and a search looks at the cells around the point in growing shells
+// until no farther cell can hold anything closer, so each search only touches the joints near the point, however many
+// figures there are.
+//
+//   joints.clear();
+//   joints.add(pose, figure);               // for every figure
+//   joints.build();
+//   ...
+//   int i = joints.findNearest(point, figure, 0, 400);     // pose[i], or -1 if nothing is in reach
+//   int n = joints.findNearestPairs(figure, other, 400, from, to, 4);
+class JointIndex
+{
+public:
+
+	JointIndex() { hash.setCellSize(100); }
+
+	// edge length of the hash cells; searches are quickest when most of them end in the first shell
+	void setCellSize(float size) { hash.setCellSize(size); }
+
+	void clear();
+	// the joint positions of one figure, found again by the figure's number and their index in points
+	void add(const vector<ofVec3f> &points, int figure);
+	// call after adding the figures and before searching
+	void build();
+
+	// index of the joint of the given figure nearest to position, at least minDistance from it (to skip the joint at
+	// position itself) and at most maxDistance; -1 if there is none
+	int findNearest(const ofVec3f &position, int figure, float minDistance, float maxDistance) const;
+	// the pairs of a joint of figure and a joint of other nearest to each other, at most maxDistance apart and at most
+	// count of them, each from a different joint of figure: from[i] and to[i], nearest first.  Returns their number
+	int findNearestPairs(int figure, int other, float maxDistance, int *from, int *to, int count) const;
+
+protected:
+
+	vector<ofVec3f> positions;
+	vector<int> figures;
+	vector<int> indices;
+
+	SpatialHash hash;
+
+	// findNearest() by the number of the joint in the index, and its squared distance
+	int search(const ofVec3f &position, int figure, float minDistance, float maxDistance, float &distance) const;
+};
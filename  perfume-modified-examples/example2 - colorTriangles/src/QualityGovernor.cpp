@@ -0,0 +1,202 @@
+#include "QualityGovernor.h"
+
+// weight of the newest frame in the smoothed times
+static const float SMOOTHING = 0.1;
+// fraction of the way to a lower quality taken every frame, and to a higher one
+static const float DROP_RATE = 0.2;
+static const float RECOVER_RATE = 0.01;
+// fraction of the budget the qualities are picked to fill, leaving room for frames that cost more than the average
+static const float HEADROOM = 0.9;
+// the cost at full quality is estimated from the cost at the current one, which says little near quality 0
+static const float MIN_QUALITY = 0.05;
+// quality that counts as full for isFull(), as the recovery only approaches 1
+static const float FULL_QUALITY = 0.98;
+
+QualityGovernor::~QualityGovernor()
+{
+	for (int i = 0; i < subsystems.size(); i++)
+		delete subsystems[i];
+}
+
+void QualityGovernor::setup(int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (string(argv[i]) == "--frame-budget" && i + 1 < argc)
+		{
+			float ms = ofToFloat(argv[++i]);
+			if (ms > 0)
+				budget = ms / 1000;
+			else
+				setEnabled(false);
+		}
+	}
+}
+
+int QualityGovernor::addSubsystem(const string &name, float priority)
+{
+	Subsystem *s = new Subsystem;
+	s->name = name;
+	s->priority = priority;
+	s->quality = 1;
+	s->cpu = s->gpu = 0;
+	s->frameCpu = s->start = 0;
+	s->drawn = false;
+	subsystems.push_back(s);
+	return subsystems.size() - 1;
+}
+
+int QualityGovernor::addKnob(int subsystem, float min, float max)
+{
+	Knob k;
+	k.subsystem = subsystem;
+	k.min = min;
+	k.max = max;
+	knobs.push_back(k);
+	return knobs.size() - 1;
+}
+
+void QualityGovernor::setEnabled(bool enabled)
+{
+	this->enabled = enabled;
+	for (int i = 0; i < subsystems.size(); i++)
+		subsystems[i]->quality = 1;
+}
+
+float QualityGovernor::get(int knob) const
+{
+	const Knob &k = knobs[knob];
+	return k.min + (k.max - k.min) * subsystems[k.subsystem]->quality;
+}
+
+void QualityGovernor::beginFrame()
+{
+	frameStart = ofGetElapsedTimeMicros();
+	for (int i = 0; i < subsystems.size(); i++)
+	{
+		subsystems[i]->frameCpu = 0;
+		subsystems[i]->drawn = false;
+	}
+}
+
+void QualityGovernor::beginFrameDraw()
+{
+	frameTimer.begin();
+	drawing = true;
+}
+
+bool QualityGovernor::isFull() const
+{
+	if (!enabled)
+		return true;
+	for (int i = 0; i < subsystems.size(); i++)
+	{
+		if (subsystems[i]->quality < FULL_QUALITY)
+			return false;
+	}
+	return true;
+}
+
+void QualityGovernor::begin(int subsystem)
+{
+	subsystems[subsystem]->start = ofGetElapsedTimeMicros();
+}
+
+void QualityGovernor::end(int subsystem)
+{
+	Subsystem *s = subsystems[subsystem];
+	s->frameCpu += ofGetElapsedTimeMicros() - s->start;
+}
+
+void QualityGovernor::beginDraw(int subsystem)
+{
+	begin(subsystem);
+	subsystems[subsystem]->timer.begin();
+}
+
+void QualityGovernor::endDraw(int subsystem)
+{
+	Subsystem *s = subsystems[subsystem];
+	s->timer.end();
+	s->drawn = true;
+	end(subsystem);
+}
+
+void QualityGovernor::endFrame()
+{
+	if (drawing)
+		frameTimer.end();
+	drawing = false;
+	cutting = false;
+	// beginFrame() was not called
+	if (frameStart == 0)
+		return;
+
+	cpuFrame += ((ofGetElapsedTimeMicros() - frameStart) / 1000000.0 - cpuFrame) * SMOOTHING;
+	gpuFrame += (frameTimer.getTime() - gpuFrame) * SMOOTHING;
+
+	vector<float> cpuCosts(subsystems.size()), gpuCosts(subsystems.size());
+	for (int i = 0; i < subsystems.size(); i++)
+	{
+		Subsystem *s = subsystems[i];
+		s->cpu += (s->frameCpu / 1000000.0 - s->cpu) * SMOOTHING;
+		// the timer keeps the last interval it measured, which is stale for a subsystem that was not drawn
+		s->gpu += ((s->drawn ? s->timer.getTime() : 0) - s->gpu) * SMOOTHING;
+		cpuCosts[i] = s->cpu;
+		gpuCosts[i] = s->gpu;
+	}
+
+	if (!enabled)
+		return;
+
+	vector<float> cpuQualities, gpuQualities;
+	fit(cpuCosts, cpuFrame, cpuQualities);
+	fit(gpuCosts, gpuFrame, gpuQualities);
+
+	for (int i = 0; i < subsystems.size(); i++)
+	{
+		Subsystem *s = subsystems[i];
+		float target = MIN(cpuQualities[i], gpuQualities[i]);
+		if (target < s->quality)
+			cutting = true;
+		s->quality += (target - s->quality) * (target < s->quality ? DROP_RATE : RECOVER_RATE);
+	}
+}
+
+void QualityGovernor::fit(const vector<float> &costs, float frame, vector<float> &qualities) const
+{
+	qualities.assign(subsystems.size(), 1);
+
+	// what each subsystem would cost at full quality, taking its cost to follow its quality
+	vector<float> full(subsystems.size());
+	float governed = 0, fullTotal = 0, maxLevel = 0;
+	for (int i = 0; i < subsystems.size(); i++)
+	{
+		governed += costs[i];
+		full[i] = costs[i] / MAX(subsystems[i]->quality, MIN_QUALITY);
+		fullTotal += full[i];
+		maxLevel = MAX(maxLevel, 1 / subsystems[i]->priority);
+	}
+
+	// the rest of the frame does not scale; the subsystems get what it leaves
+	float available = budget * HEADROOM - MAX(frame - governed, 0.0f);
+	if (fullTotal <= available)
+		return;
+
+	// every subsystem gets the same level times its priority, up to 1; find the highest level that fits
+	float low = 0, high = maxLevel;
+	for (int n = 0; n < 16; n++)
+	{
+		float level = (low + high) / 2;
+		float cost = 0;
+		for (int i = 0; i < subsystems.size(); i++)
+			cost += full[i] * MIN(level * subsystems[i]->priority, 1.0f);
+		if (cost > available)
+			high = level;
+		else
+			low = level;
+	}
+
+	for (int i = 0; i < subsystems.size(); i++)
+		qualities[i] = MIN(low * subsystems[i]->priority, 1.0f);
+}
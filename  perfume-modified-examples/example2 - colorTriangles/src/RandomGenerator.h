@@ -0,0 +1,84 @@
+#pragma once
+
+#include "ofMain.h"
+
+// Small seeded random number generator (PCG32) used by the visual effects in place of rand().
+// Each Tracker owns its own generator, so effects can be updated in parallel and a run can be
+// reproduced exactly by using the same seed.
+class RandomGenerator
+{
+public:
+
+	RandomGenerator(uint64_t seed = 0, uint64_t stream = 0) { setSeed(seed, stream); }
+
+	// different streams give independent sequences for the same seed
+	void setSeed(uint64_t seed, uint64_t stream = 0)
+	{
+		state = 0;
+		inc = (stream << 1) | 1;
+		next();
+		state += seed;
+		next();
+	}
+
+	// uniformly distributed 32 bit value
+	inline uint32_t next()
+	{
+		uint64_t old = state;
+		state = old * 6364136223846793005ULL + inc;
+
+		uint32_t xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+		uint32_t rot = (uint32_t)(old >> 59);
+		return (xorshifted >> rot) | (xorshifted << ((0u - rot) & 31));
+	}
+
+	// integer in [0, range); replaces rand() % range
+	inline int nextInt(int range)
+	{
+		if (range <= 0) return 0;
+		return (int)(((uint64_t)next() * (uint32_t)range) >> 32);
+	}
+
+	// float in [0, 1)
+	inline float nextFloat()
+	{
+		return (next() >> 8) * (1.0f / 16777216.0f);
+	}
+
+	// float in [min, max)
+	inline float nextFloat(float min, float max)
+	{
+		return min + nextFloat() * (max - min);
+	}
+
+	// batch versions for filling buffers of jitter values in one call
+	void fill(int *values, int count, int range)
+	{
+		for (int i = 0; i < count; i++)
+			values[i] = nextInt(range);
+	}
+
+	void fill(float *values, int count, float min, float max)
+	{
+		const float scale = (max - min) * (1.0f / 16777216.0f);
+
+		for (int i = 0; i < count; i++)
+			values[i] = min + (next() >> 8) * scale;
+	}
+
+	void fill(vector<float>& values, float min, float max)
+	{
+		if (!values.empty())
+			fill(&values[0], values.size(), min, max);
+	}
+
+	void fill(ofVec3f *values, int count, float min, float max)
+	{
+		fill(values->getPtr(), count * 3, min, max);
+	}
+
+protected:
+
+	uint64_t state;
+	uint64_t inc;
+};
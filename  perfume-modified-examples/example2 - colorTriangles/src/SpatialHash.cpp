@@ -0,0 +1,71 @@
+#include "SpatialHash.h"
+
+// fewest buckets; there are at least twice as many as entries, so few cells share one
+static const unsigned int MIN_BUCKETS = 64;
+
+unsigned int SpatialHash::hashCell(int x, int y, int z)
+{
+	return (x * 73856093u) ^ (y * 19349663u) ^ (z * 83492791u);
+}
+
+void SpatialHash::clear()
+{
+	entries.clear();
+	sorted.clear();
+	start.clear();
+}
+
+void SpatialHash::insert(int item, const ofVec3f &min, const ofVec3f &max)
+{
+	int x0 = getCell(min.x), y0 = getCell(min.y), z0 = getCell(min.z);
+	int x1 = getCell(max.x), y1 = getCell(max.y), z1 = getCell(max.z);
+	for (int z = z0; z <= z1; z++)
+	{
+		for (int y = y0; y <= y1; y++)
+		{
+			for (int x = x0; x <= x1; x++)
+			{
+				Entry e;
+				e.hash = hashCell(x, y, z);
+				e.item = item;
+				entries.push_back(e);
+			}
+		}
+	}
+}
+
+void SpatialHash::build()
+{
+	unsigned int buckets = MIN_BUCKETS;
+	while (buckets < entries.size() * 2)
+		buckets *= 2;
+	mask = buckets - 1;
+
+	// counting sort by bucket
+	start.assign(buckets + 1, 0);
+	for (int i = 0; i < entries.size(); i++)
+		start[(entries[i].hash & mask) + 1]++;
+	for (int i = 0; i < buckets; i++)
+		start[i + 1] += start[i];
+
+	sorted.resize(entries.size());
+	vector<int> next(start.begin(), start.end() - 1);
+	for (int i = 0; i < entries.size(); i++)
+		sorted[next[entries[i].hash & mask]++] = entries[i].item;
+}
+
+int SpatialHash::query(const ofVec3f &point, const int *&items) const
+{
+	return queryCell(getCell(point.x), getCell(point.y), getCell(point.z), items);
+}
+
+int SpatialHash::queryCell(int x, int y, int z, const int *&items) const
+{
+	if (start.empty())
+		return 0;
+	unsigned int bucket = hashCell(x, y, z) & mask;
+	int count = start[bucket + 1] - start[bucket];
+	if (count > 0)
+		items = &sorted[start[bucket]];
+	return count;
+}
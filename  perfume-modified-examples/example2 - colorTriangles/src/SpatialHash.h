@@ -0,0 +1,64 @@
+#pragma once
+
+#include "ofMain.h"
+
+// Finds the items near a point without looking at the others.  Space is divided into cubic cells and every item is
+// listed in each cell its bounding box touches.  The cells are hashed into buckets, so the grid needs no bounds and no
+// memory for empty space; items of other cells sharing a bucket come up as candidates too and have to be told apart by
+// an exact test.  Building the hash and each query take constant time per item, so it can be rebuilt every frame.
+//
+//   hash.clear();
+//   hash.insert(i, boxMin, boxMax);         // for every item
+//   hash.build();
+//   ...
+//   const int *items;
+//   int n = hash.query(point, items);       // items[0] to items[n - 1] may be near the point
+class SpatialHash
+{
+public:
+
+	SpatialHash() : cellSize(50), mask(0) {}
+
+	// edge length of the cells; about the size of the items works best
+	void setCellSize(float cellSize) { this->cellSize = cellSize; }
+	float getCellSize() const { return cellSize; }
+
+	void clear();
+	void insert(int item, const ofVec3f &min, const ofVec3f &max);
+	// sorts the inserted items into their buckets; call before querying
+	void build();
+
+	// the items in the bucket of the point's cell; returns their number.  items stays valid until the next clear().
+	int query(const ofVec3f &point, const int *&items) const;
+	// the same for the cell with the given coordinates, for searching the cells around a point
+	int queryCell(int x, int y, int z, const int *&items) const;
+
+	// coordinate of the cell a coordinate along any axis falls in
+	int getCell(float coordinate) const { return (int)floor(coordinate / cellSize); }
+
+	// the buckets themselves, for going through many points bucket by bucket: the items of a bucket are those at
+	// first to first + count - 1 in the order getItem() gives, so data kept in that order lies side by side
+	int getNumBuckets() const { return start.empty() ? 0 : mask + 1; }
+	unsigned int getBucket(const ofVec3f &point) const { return hashCell(getCell(point.x), getCell(point.y), getCell(point.z)) & mask; }
+	int queryBucket(unsigned int bucket, int &first) const { first = start[bucket]; return start[bucket + 1] - first; }
+	int getNumEntries() const { return sorted.size(); }
+	int getItem(int i) const { return sorted[i]; }
+
+protected:
+
+	struct Entry
+	{
+		unsigned int hash;
+		int item;
+	};
+
+	float cellSize;
+	vector<Entry> entries;
+	// the items of bucket i are sorted[start[i]] to sorted[start[i + 1] - 1]
+	vector<int> start;
+	vector<int> sorted;
+	// number of buckets minus one; the count is a power of two
+	unsigned int mask;
+
+	static unsigned int hashCell(int x, int y, int z);
+};
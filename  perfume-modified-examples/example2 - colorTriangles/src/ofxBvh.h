@@ -35,9 +35,17 @@ public:
 	
 	inline ofxBvh* getBvh() const { return bvh; }
 	
+	// position of this joint in ofxBvh::getJoint(int); parents always come before their children
+	inline int getIndex() const { return index; }
+	
+	// the lowest level of detail (see ofxBvh::setLevelOfDetail()) at which the joint is no longer evaluated
+	inline int getSkipLevel() const { return skip_level; }
+	
 protected:
 
 	string name;
+	int index;
+	int skip_level;
 	ofVec3f initial_offset;
 	ofVec3f offset;
 	
@@ -52,20 +60,140 @@ protected:
 	vector<CHANNEL> channel_type;
 };
 
+// the transform of one joint in one frame, relative to its parent
+struct ofxBvhJointPose
+{
+	ofVec3f translate;
+	ofQuaternion rotate;
+};
+
+// one ofxBvhJointPose per joint, in the order of ofxBvh::getJoint(int)
+typedef vector<ofxBvhJointPose> ofxBvhPose;
+
+// Compressed in-memory motion of one take.  Each joint has a rotation and a translation track, and each track only
+// keeps the keyframes needed to reproduce every frame within a tolerance by interpolating between them.  Rotation
+// keys are quantized to 48 bits with the smallest-three encoding; translation keys are stored as 16 bit differences
+// to the previous key, with the absolute value of every few keys so decoding never has to start from the beginning.
+// Any frame can be decoded on its own: finding the keys around it is a binary search per track.
+class ofxBvhMotion
+{
+public:
+	
+	ofxBvhMotion() : num_frames(0), frame_time(0), rotation_tolerance(0.5), distance_tolerance(0.2) {}
+	
+	// largest error of a decoded joint against the frames it was compressed from, in degrees and in bvh units;
+	// applies to the next compress()
+	void setTolerance(float degrees, float distance);
+	
+	void compress(const vector<ofxBvhPose>& frames, float frame_time);
+	void decompress(vector<ofxBvhPose>& frames) const;
+	void clear();
+	
+	// fractional frames are interpolated between the frames around them
+	void getPose(float frame, ofxBvhPose& pose) const;
+	void getJointPose(int joint, float frame, ofxBvhJointPose& pose) const;
+	
+	bool empty() const { return num_frames == 0; }
+	int getNumFrames() const { return num_frames; }
+	int getNumJoints() const { return rotations.size(); }
+	float getFrameTime() const { return frame_time; }
+	
+	// bytes held by the tracks, and what the same frames take as a vector of ofxBvhPose
+	int getMemoryUsage() const;
+	int getUncompressedSize() const;
+	
+protected:
+	
+	// keys are stored as frame numbers
+	static const int MAX_FRAMES = 65536;
+	
+	// the absolute value is kept for every ANCHOR_INTERVAL-th translation key
+	static const int ANCHOR_INTERVAL = 16;
+	
+	struct RotationTrack
+	{
+		vector<unsigned short> keys;
+		// three words per key, see encodeRotation()
+		vector<unsigned short> values;
+	};
+	
+	struct TranslationTrack
+	{
+		vector<unsigned short> keys;
+		float step;
+		// x, y and z in multiples of step
+		vector<int> anchors;
+		vector<short> deltas;
+	};
+	
+	int num_frames;
+	float frame_time;
+	
+	float rotation_tolerance;
+	float distance_tolerance;
+	
+	vector<RotationTrack> rotations;
+	vector<TranslationTrack> translations;
+	
+	static void encodeRotation(const ofVec4f& q, unsigned short *value);
+	static ofVec4f decodeRotation(const unsigned short *value);
+	static int findKey(const vector<unsigned short>& keys, float frame);
+	
+	void compressRotations(const vector<ofxBvhPose>& frames, int joint, RotationTrack& track) const;
+	void compressTranslations(const vector<ofxBvhPose>& frames, int joint, TranslationTrack& track) const;
+	ofVec3f getTranslationKey(const TranslationTrack& track, int key) const;
+};
+
+// Draws the joints of any number of ofxBvh as camera facing discs with a single draw call.
+// The billboard orientation comes from the modelview matrix passed to begin(), so nothing is read back from GL.
+class ofxBvhRenderer
+{
+public:
+	
+	ofxBvhRenderer(int resolution = 12);
+	
+	void begin(const ofMatrix4x4& modelview);
+	void add(const ofxBvh& bvh);
+	void end();
+	// releases the vertex buffer; call while the GL context is still there
+	void clear();
+	
+protected:
+	
+	int resolution;
+	vector<ofVec2f> circle;
+	
+	ofVec3f right, up;
+	
+	vector<ofVec3f> vertices;
+	vector<ofFloatColor> colors;
+	ofVbo vbo;
+	
+	void addDisc(const ofVec3f& center, float radius, const ofFloatColor& color);
+};
+
 class ofxBvh
 {
 public:
 	
-	ofxBvh() : root(NULL), total_channels(0), rate(1), loop(false),
-		playing(false), play_head(0), need_update(false) {}
+	ofxBvh() : total_channels(0), root(NULL), current_frame(0), source_frame_time(0), rate(1),
+		playing(false), play_head(0), loop(false), need_update(false), live(false), lod(0) {}
 	
 	virtual ~ofxBvh();
 	
 	void load(string path);
 	void unload();
+	
+	// for live input (see ofxBvhStream): sets up the skeleton from the HIERARCHY section of a bvh stream, without any
+	// frames, after which the pose is set one frame at a time with setFrameData()
+	bool loadHierarchy(const string& data);
+	void setFrameData(const float *channels, int num_channels);
+	bool isLive() const { return live; }
+	int getNumChannels() const { return total_channels; }
 
 	void update();
 	void draw();
+	void draw(const ofMatrix4x4& modelview);
 	
 	bool isFrameNew();
 	
@@ -77,22 +205,57 @@ public:
 	bool isLoop();
 	
 	void setRate(float rate);
+	
+	// converts the loaded take to the given frame rate, interpolating rotations along the shortest arc and averaging
+	// them when reducing the rate.  Done once after load(), so playback at the rate the scene is drawn at never has to
+	// blend between frames.  The take is compressed again afterwards, so its error can grow to twice the tolerance
+	void resample(float fps);
+	
+	// error tolerance of the compressed motion (see ofxBvhMotion), for the next load() or resample()
+	void setTolerance(float degrees, float distance) { motion.setTolerance(degrees, distance); }
+	const ofxBvhMotion& getMotion() const { return motion; }
 
+	// seeking only moves a cursor into the loaded frames; the pose is recomputed in update() if the frame changed
+	void setTime(float seconds);
+	float getTime();
+	
 	void setFrame(int index);
 	int getFrame();
 	
+	// position as a fraction of the duration
 	void setPosition(float pos);
 	float getPosition();
 	
 	float getDuration();
 	
+	int getNumFrames() const { return motion.getNumFrames(); }
+	float getFrameTime() const { return frame_time; }
+	// frame time of the take as captured, which resample() leaves alone; 0 before a take is loaded
+	float getSourceFrameTime() const { return source_frame_time; }
+	
+	// evaluates the global matrix of every joint at the given frame without changing the current pose
+	void evaluateFrame(int index, vector<ofMatrix4x4>& global_matrices) const;
+	
+	// level of detail for distant figures.  At level 1 the joints at the ends of the limbs - head, wrists or hands,
+	// toes and fingers - are no longer evaluated, at level 2 neither are the joints in the middle of the chest chain.
+	// Skipped joints are not decoded and keep their rest pose relative to their parent, so the number and order of
+	// joints never changes
+	static const int NUM_LEVELS_OF_DETAIL = 3;
+	
+	void setLevelOfDetail(int level);
+	int getLevelOfDetail() const { return lod; }
+	// joints with channels that are evaluated at the current level; end sites have none and are not counted
+	int getNumEvaluatedJoints() const;
+	
 	const int getNumJoints() const { return joints.size(); }
-	const ofxBvhJoint* getJoint(int index);
-	const ofxBvhJoint* getJoint(string name);
+	const ofxBvhJoint* getJoint(int index) const;
+	const ofxBvhJoint* getJoint(string name) const;
 	
 protected:
 	
 	typedef vector<float> FrameData;
+	typedef ofxBvhJointPose JointPose;
+	typedef ofxBvhPose Pose;
 	
 	int total_channels;
 	
@@ -100,11 +263,14 @@ protected:
 	vector<ofxBvhJoint*> joints;
 	map<string, ofxBvhJoint*> jointMap;
 	
-	vector<FrameData> frames;
-	FrameData currentFrame;
+	// frames are decoded from their channels once when the take is loaded, and kept compressed
+	ofxBvhMotion motion;
+	int current_frame;
+	Pose current_pose;
 	
 	int num_frames;
 	float frame_time;
+	float source_frame_time;
 	
 	float rate;
 	
@@ -115,10 +281,58 @@ protected:
 	bool need_update;
 	bool frame_new;
 	
+	bool live;
+	Pose live_frame;
+	
+	int lod;
+	
+	// for draw(); one per figure rather than one shared by all, so its buffer goes with the figure, while the GL
+	// context is still there, and not after it at exit
+	ofxBvhRenderer renderer;
+	
 	void parseHierarchy(const string& data);
 	ofxBvhJoint* parseJoint(int& index, vector<string> &tokens, ofxBvhJoint *parent);
-	void updateJoint(int& index, const FrameData& frame_data, ofxBvhJoint *joint);
+	static int getSkipLevel(const ofxBvhJoint *joint);
+	void readPose(const float *channels, Pose& pose) const;
+	void decodeFrame(int index, Pose& pose) const;
+	void updateJoints(const Pose& pose);
+	static void getJointMatrix(const JointPose& pose, ofMatrix4x4& matrix);
 	
 	void parseMotion(const string& data);
 	
-};
\ No newline at end of file
+	void seekFrame(int index);
+	
+};
+
+// Playback clock that follows an ofSoundPlayer, for driving ofxBvh::setPosition() in sync with the music.
+// The player only reports its position once per audio buffer, so between reports the clock runs on the frame timer,
+// and the difference to each new report is slewed out over a few frames instead of jumping.  Differences larger than
+// the maximum drift (the sound looped or was seeked) are applied at once.
+class ofxBvhAudioClock
+{
+public:
+	
+	ofxBvhAudioClock() : player(NULL), time(0), drift(0), last_report(-1),
+		slew_rate(4), max_drift(0.25) {}
+	
+	void setup(ofSoundPlayer *player);
+	void update();
+	
+	// seconds into the sound
+	float getTime() const { return time; }
+	
+	// fraction of the drift corrected per second, and the drift in seconds above which the clock jumps
+	void setSlewRate(float rate) { slew_rate = rate; }
+	void setMaxDrift(float seconds) { max_drift = seconds; }
+	
+protected:
+	
+	ofSoundPlayer *player;
+	
+	float time;
+	float drift;
+	int last_report;
+	
+	float slew_rate;
+	float max_drift;
+};
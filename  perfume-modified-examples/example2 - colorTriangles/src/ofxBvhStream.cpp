@@ -0,0 +1,392 @@
+#include "ofxBvhStream.h"
+
+#ifdef TARGET_WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <io.h>
+#define OFXBVH_MEMORY_BARRIER() MemoryBarrier()
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <unistd.h>
+#define OFXBVH_MEMORY_BARRIER() __sync_synchronize()
+#endif
+
+ofxBvhStream::ofxBvhStream() : source(SOURCE_STDIN), port(0), fd(-1), connected(false),
+	in_header(false), num_channels(0), reader_version(0), header_version(0), applied_version(0),
+	head(0), tail(0), latency(0), max_latency(0), last_update(0), interval(0), received(0), skipped(0), dropped(0), late(0)
+{
+}
+
+ofxBvhStream::~ofxBvhStream()
+{
+	close();
+}
+
+bool ofxBvhStream::open(string address)
+{
+	close();
+
+	if (address == "-")
+	{
+		source = SOURCE_STDIN;
+	}
+	else if (address.compare(0, 6, "tcp://") == 0)
+	{
+		string rest = address.substr(6);
+		size_t colon = rest.rfind(':');
+
+		if (colon == string::npos)
+		{
+			ofLogError("ofxBvhStream", "missing port in " + address);
+			return false;
+		}
+
+		source = SOURCE_TCP;
+		host = rest.substr(0, colon);
+		port = ofToInt(rest.substr(colon + 1));
+	}
+	else if (address.compare(0, 7, "unix://") == 0)
+	{
+#ifdef TARGET_WIN32
+		ofLogError("ofxBvhStream", "unix sockets are not supported on this platform");
+		return false;
+#else
+		source = SOURCE_UNIX;
+		path = address.substr(7);
+#endif
+	}
+	else
+	{
+		ofLogError("ofxBvhStream", "unknown address " + address);
+		return false;
+	}
+
+#ifdef TARGET_WIN32
+	WSADATA wsa;
+	WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+
+	head = tail = 0;
+	header.clear();
+	header_version = applied_version = reader_version = 0;
+	num_channels = 0;
+
+	latency = max_latency = 0;
+	last_update = 0;
+	interval = 0;
+	received = skipped = dropped = late = 0;
+
+	startThread(true, false);
+
+	return true;
+}
+
+void ofxBvhStream::close()
+{
+	if (!isThreadRunning()) return;
+
+	// reads wait with a timeout, so the thread notices it was stopped; only a blocking read of stdin on windows can't
+	bool wait = true;
+#ifdef TARGET_WIN32
+	wait = source != SOURCE_STDIN;
+#endif
+
+	if (wait)
+		waitForThread(true);
+	else
+		stopThread();
+
+	ofLogNotice("ofxBvhStream", ofToString(received) + " frames received, " + ofToString(skipped) + " skipped, "
+		+ ofToString(dropped) + " dropped, max latency " + ofToString(max_latency * 1000, 2) + " ms, "
+		+ ofToString(late) + " late");
+}
+
+bool ofxBvhStream::update(ofxBvh& bvh)
+{
+	unsigned long long now = ofGetElapsedTimeMicros();
+	interval = last_update > 0 ? (now - last_update) / 1000000.0f : 0;
+	last_update = now;
+
+	string new_header;
+
+	lock();
+	if (header_version != applied_version)
+	{
+		new_header = header;
+		applied_version = header_version;
+	}
+	unlock();
+
+	if (!new_header.empty())
+		bvh.loadHierarchy(new_header);
+
+	unsigned int h = head;
+	OFXBVH_MEMORY_BARRIER();
+	unsigned int t = tail;
+
+	if (h == t) return false;
+
+	// only the newest frame matters; everything before it is released unseen
+	const Slot &slot = ring[(h - 1) % RING_SIZE];
+	bool changed = false;
+
+	if (slot.version == applied_version)
+	{
+		bvh.setFrameData(slot.channels, slot.num_channels);
+
+		latency = (now - slot.received) / 1000000.0f;
+		max_latency = MAX(max_latency, latency);
+		// received before the last update() and still not applied by it
+		if (interval > 0 && latency > interval)
+			late++;
+		ofLogVerbose("ofxBvhStream", "latency " + ofToString(latency * 1000, 2) + " ms, "
+			+ ofToString(interval * 1000, 2) + " ms since the last update");
+		changed = true;
+	}
+
+	skipped += h - t - 1;
+
+	OFXBVH_MEMORY_BARRIER();
+	tail = h;
+
+	return changed;
+}
+
+bool ofxBvhStream::connect()
+{
+	if (source == SOURCE_STDIN)
+	{
+		fd = 0;
+		return true;
+	}
+
+	if (source == SOURCE_TCP)
+	{
+		struct addrinfo hints, *info;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+
+		if (getaddrinfo(host.c_str(), ofToString(port).c_str(), &hints, &info) != 0)
+			return false;
+
+		fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+		bool ok = fd >= 0 && ::connect(fd, info->ai_addr, info->ai_addrlen) == 0;
+		freeaddrinfo(info);
+
+		if (!ok) disconnect();
+		return ok;
+	}
+
+#ifndef TARGET_WIN32
+	if (source == SOURCE_UNIX)
+	{
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		bool ok = fd >= 0 && ::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+
+		if (!ok) disconnect();
+		return ok;
+	}
+#endif
+
+	return false;
+}
+
+void ofxBvhStream::disconnect()
+{
+	if (fd >= 0 && source != SOURCE_STDIN)
+	{
+#ifdef TARGET_WIN32
+		closesocket(fd);
+#else
+		::close(fd);
+#endif
+	}
+
+	fd = -1;
+}
+
+// returns the number of bytes read, 0 if nothing arrived for a while, or -1 when the input is closed
+int ofxBvhStream::readSome(char *buffer, int size)
+{
+#ifdef TARGET_WIN32
+	if (source == SOURCE_STDIN)
+	{
+		int n = _read(0, buffer, size);
+		return n > 0 ? n : -1;
+	}
+#endif
+
+	fd_set set;
+	FD_ZERO(&set);
+	FD_SET(fd, &set);
+
+	struct timeval timeout;
+	timeout.tv_sec = 0;
+	timeout.tv_usec = 100000;
+
+	int ready = select(fd + 1, &set, NULL, NULL, &timeout);
+	if (ready < 0) return -1;
+	if (ready == 0) return 0;
+
+#ifdef TARGET_WIN32
+	int n = recv(fd, buffer, size, 0);
+#else
+	int n = read(fd, buffer, size);
+#endif
+
+	return n > 0 ? n : -1;
+}
+
+void ofxBvhStream::readLine(const string& line)
+{
+	// a new HIERARCHY section can start at any time, e.g. when the sender restarts
+	if (line.compare(0, 9, "HIERARCHY") == 0)
+	{
+		in_header = true;
+		header_text.clear();
+	}
+
+	if (in_header)
+	{
+		header_text += line;
+		header_text += "\n";
+
+		if (line.compare(0, 6, "MOTION") == 0)
+		{
+			in_header = false;
+
+			// count the channels, so frames can be checked before they are queued
+			istringstream tokens(header_text);
+			string token;
+			int channels = 0;
+
+			while (tokens >> token)
+			{
+				int n = 0;
+				if (token == "CHANNELS" && tokens >> n)
+					channels += n;
+			}
+
+			if (channels <= 0 || channels > MAX_CHANNELS || header_text.find("ROOT") == string::npos)
+			{
+				ofLogError("ofxBvhStream", "invalid bvh header");
+				num_channels = 0;
+				return;
+			}
+
+			num_channels = channels;
+
+			lock();
+			header = header_text;
+			reader_version = ++header_version;
+			unlock();
+		}
+
+		return;
+	}
+
+	// Frames: and Frame Time: follow MOTION; the timing of a live feed comes from the feed itself
+	if (line.empty() || line.compare(0, 5, "Frame") == 0)
+		return;
+
+	pushFrame(line);
+}
+
+void ofxBvhStream::pushFrame(const string& line)
+{
+	if (num_channels == 0) return;
+
+	unsigned int h = head;
+	unsigned int t = tail;
+	OFXBVH_MEMORY_BARRIER();
+
+	if (h - t >= RING_SIZE)
+	{
+		dropped++;
+		return;
+	}
+
+	Slot &slot = ring[h % RING_SIZE];
+
+	const char *p = line.c_str();
+	char *end;
+	int n = 0;
+
+	while (n < MAX_CHANNELS)
+	{
+		float v = strtod(p, &end);
+		if (end == p) break;
+
+		slot.channels[n++] = v;
+		p = end;
+	}
+
+	// incomplete or malformed line
+	if (n != num_channels) return;
+
+	slot.num_channels = n;
+	slot.version = reader_version;
+	slot.received = ofGetElapsedTimeMicros();
+
+	OFXBVH_MEMORY_BARRIER();
+	head = h + 1;
+
+	received++;
+}
+
+void ofxBvhStream::threadedFunction()
+{
+	char buffer[4096];
+
+	while (isThreadRunning())
+	{
+		if (!connect())
+		{
+			// the sender is not up yet
+			ofSleepMillis(500);
+			continue;
+		}
+
+		connected = true;
+		in_header = false;
+		pending.clear();
+
+		while (isThreadRunning())
+		{
+			int n = readSome(buffer, sizeof(buffer));
+			if (n < 0) break;
+
+			for (int i = 0; i < n; i++)
+			{
+				char c = buffer[i];
+
+				if (c == '\n')
+				{
+					readLine(pending);
+					pending.clear();
+				}
+				else if (c != '\r')
+				{
+					pending += c;
+				}
+			}
+		}
+
+		connected = false;
+		disconnect();
+
+		// stdin does not come back once it is closed
+		if (source == SOURCE_STDIN)
+			break;
+	}
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxBvh.h"
+
+// Live motion input for ofxBvh.  A reader thread consumes a bvh stream - the HIERARCHY section once, then one MOTION
+// line per frame - from a local TCP socket, a UNIX domain socket or stdin, and passes complete frames to the main
+// thread through a lock-free single producer / single consumer ring.  update() poses the bvh with the newest complete
+// frame and skips any older ones, so a frame waits for the next update() at most, not for a queue of older ones.
+// Every update() measures how long its frame waited against the time since the update() before it; a frame that
+// waited longer than that was missed by an update() and counts as late.
+//
+//   stream.open("tcp://127.0.0.1:7001");   // or "unix:///tmp/bvh.sock", or "-" for stdin
+//   ...
+//   stream.update(bvh);                     // before bvh.update()
+//
+// When the connection drops the stream reconnects and accepts a new HIERARCHY section.  tools/bvhreplay.cpp streams
+// the files in data/bvhfiles for testing.
+class ofxBvhStream : public ofThread
+{
+public:
+
+	ofxBvhStream();
+	virtual ~ofxBvhStream();
+
+	bool open(string address);
+	void close();
+
+	// applies the newest complete frame; returns true if the pose changed
+	bool update(ofxBvh& bvh);
+
+	bool isConnected() const { return connected; }
+
+	// seconds from a frame being received until update() applied it, for the last frame and the worst one since open()
+	float getLatency() const { return latency; }
+	float getMaxLatency() const { return max_latency; }
+	// seconds between the last two calls of update(), the most a frame should wait
+	float getUpdateInterval() const { return interval; }
+	// frames that waited longer than the interval before the update() that applied them
+	int getNumLate() const { return late; }
+
+	int getNumReceived() const { return received; }
+	// older frames that update() skipped because a newer one was already waiting
+	int getNumSkipped() const { return skipped; }
+	// frames the reader could not queue because the ring was full
+	int getNumDropped() const { return dropped; }
+
+protected:
+
+	enum Source
+	{
+		SOURCE_TCP, SOURCE_UNIX, SOURCE_STDIN
+	};
+
+	Source source;
+	string host;
+	int port;
+	string path;
+
+	int fd;
+	volatile bool connected;
+
+	// reader side parsing state
+	bool in_header;
+	string header_text;
+	string pending;
+	int num_channels;
+	int reader_version;
+
+	// the latest HIERARCHY section, guarded by the thread's lock; the version changes with every new header
+	string header;
+	int header_version;
+	int applied_version;
+
+	static const int RING_SIZE = 64;
+	static const int MAX_CHANNELS = 512;
+
+	struct Slot
+	{
+		float channels[MAX_CHANNELS];
+		int num_channels;
+		int version;
+		unsigned long long received;
+	};
+
+	// slots are written by the reader at head and released by the main thread at tail; both only ever increase
+	Slot ring[RING_SIZE];
+	volatile unsigned int head, tail;
+
+	float latency, max_latency;
+	unsigned long long last_update;
+	float interval;
+	int received, skipped, dropped, late;
+
+	bool connect();
+	void disconnect();
+	int readSome(char *buffer, int size);
+	void readLine(const string& line);
+	void pushFrame(const string& line);
+
+	void threadedFunction();
+};
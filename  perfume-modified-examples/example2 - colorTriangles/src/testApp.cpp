@@ -1,21 +1,55 @@
 #include "testApp.h"
+#include "RandomGenerator.h"
+#include "SimulationClock.h"
+#include "Frustum.h"
+#include "FlowField.h"
+#include "Colliders.h"
+#include "JointIndex.h"
 
 class Tracker;
 class Particle;
 class ParticleSystem;
 
 const float trackDuration = 64.28;
+// seed for all random effects; runs with the same seed play back identically
+const int randomSeed = 1;
+// projected height in pixels below which a figure drops to the next level of detail (see Tracker::updateLod())
+const float lodScreenSizes[] = { 260, 110 };
+// a figure only returns to a finer level once it is this much larger than the threshold, so it doesn't flicker between two
+const float lodHysteresis = 1.15;
 ofVec3f center, center_t;
 ofVec3f campos, campos_t;
-ofVec3f offset, offset_v;
 vector<Tracker*> trackers;
+// seconds since the start, used for animating the scene; advances in fixed steps when rendering offline
+float elapsedTime;
+// advances the effects in fixed steps, independently of how often the scene is drawn
+SimulationClock simClock;
+// view volume of the current frame in scene coordinates, set in drawScene(); figures, particles, bolts and dancers outside it are not drawn
+Frustum frustum;
+// toggled with 'b': the scene is drawn once, thin and bright, into the bloom buffers, which add the glow in one post pass;
+// off, the glow comes from drawing every primitive several times in wider, fainter layers
+bool bloomMode = true;
+// slowly swirling flow the particles and the history of poses drift along
+FlowField flowField;
+// the floor and the bones of the current poses, which particles bounce off; rebuilt every frame in update()
+Colliders colliders;
+// the joints of the current poses, for finding the nearest one to a bolt; rebuilt every frame in update()
+JointIndex joints;
+// bolts jump to the nearest joint in reach: along the figure itself to one at least minBoltLength away, and over to
+// the figures next to it; the figures are stretched four times across
+const float minBoltLength = 120;
+const float selfBoltReach = 480;
+const float figureBoltReach = 1600;
+// subsystems and knobs of the quality governor, in the order setup() adds them; see QualityGovernor.h
+enum { PARTICLES, BOLTS, CROWD };
+enum { MAX_PARTICLES, EMISSIONS, SMALL_BOLTS, BOLT_PASSES, CROWD_SIZE };
 
 //--------------------------------------------------------------
 
 // class used for tracking information relevant to a particle
 class Particle {
 private:
-	ofVec3f pos;
+	ofVec3f pos, prevPos;
 	ofVec3f heading;
 	float lifespan;
 	int type;
@@ -23,6 +57,7 @@ private:
 public:
 	void init(ofVec3f pos_, ofVec3f heading_, float lifespan_, int type_) {
 		pos = pos_;
+		prevPos = pos_;
 		heading = heading_;
 		lifespan = lifespan_;
 		type = type_;
@@ -35,9 +70,16 @@ public:
 	ofVec3f getPos() {
 		return pos;
 	}
+	// position between the previous simulation step and the current one, for drawing
+	ofVec3f getPos(float alpha) {
+		return prevPos.getInterpolated(pos, alpha);
+	}
 	ofVec3f getHeading() {
 		return heading;
 	}
+	void setHeading(ofVec3f heading_) {
+		heading = heading_;
+	}
 	void setLifespan(float lifespan_) {
 		lifespan = lifespan_;
 	}
@@ -50,52 +92,187 @@ public:
 	void setType(int type_) {
 		type = type_;
 	}
+
+	// move along the heading, carried along by drift on top of it, and age by the given number of motion capture frames
+	void move(float amount, const ofVec3f &drift) {
+		prevPos = pos;
+		pos += (heading + drift) * amount;
+		lifespan -= amount;
+	}
 };
 
 //--------------------------------------------------------------
 
+// scene-wide limit on the number of particles, shared by the particle systems of all figures, so the most particles
+// there can be (and the cost of drawing them) does not grow with the number of figures.  When the budget is full, a
+// new particle takes the place of the oldest ones of the system holding the most particles for its priority: the
+// emitting system itself, unless another one holds more than its fair share.
+class ParticleBudget {
+private:
+	vector<ParticleSystem*> systems;
+	int capacity;
+
+public:
+	ParticleBudget() : capacity(10000) {}
+
+	void add(ParticleSystem *system) {
+		systems.push_back(system);
+	}
+
+	// lowering the capacity evicts the particles over it right away
+	void setCapacity(int capacity_);
+	int getCapacity() {
+		return capacity;
+	}
+	// particles in all systems together
+	int getSize();
+
+	// makes room for one more particle in the given system
+	void reserve(ParticleSystem *system);
+
+	// the system with the most particles for its priority, preferring the given one on a tie
+	ParticleSystem *findLargest(ParticleSystem *preferred);
+};
+
 // class for handling creation and updating of particles
 class ParticleSystem {
 private:
-	vector<Particle> particleVec;
+	// oldest first
+	deque<Particle> particles;
+	ParticleBudget *budget;
+	float priority;
+	int groupSize;
+	const FlowField *flow;
+	float flowStrength;
+	Colliders *colliders;
+	float bounce;
+	// the particles' positions and headings side by side, for colliding them all at once
+	vector<ofVec3f> positions, headings;
 
 public:
+	ParticleSystem() : budget(NULL), priority(1), groupSize(1), flow(NULL), flowStrength(0), colliders(NULL), bounce(0) {}
+
+	// share the given budget with the other systems.  groupSize particles emitted together are drawn together, and
+	// evicted together
+	void setup(ParticleBudget *budget_, int groupSize_ = 1) {
+		budget = budget_;
+		groupSize = groupSize_;
+		budget->add(this);
+	}
+
+	// particles drift along the flow field at strength times its velocity, in scene units per motion capture frame;
+	// pass NULL to move them along their headings only
+	void setFlow(const FlowField *flow_, float strength) {
+		flow = flow_;
+		flowStrength = strength;
+	}
+
+	// particles bounce off the given colliders, keeping bounce times the speed they hit them with; pass NULL to let
+	// them pass through everything
+	void setColliders(Colliders *colliders_, float bounce_) {
+		colliders = colliders_;
+		bounce = bounce_;
+	}
+
+	// a system with twice the priority keeps twice as many particles when the budget is full; must be above 0
+	void setPriority(float priority_) {
+		priority = priority_;
+	}
+	float getPriority() {
+		return priority;
+	}
+
 	// create a particle at a given location with a movement direction and lifespan
 	void emit(ofVec3f pos_, ofVec3f heading_, float lifespan_, int type_) {
+		if (budget != NULL)
+			budget->reserve(this);
 		Particle next;
 		next.init(pos_, heading_, lifespan_, type_);
-		particleVec.push_back(next);
+		particles.push_back(next);
 	}
 
-	// move particles according to their current direction and update their lifespan
-	void updateParticles() {
-		for (int i = 0; i < particleVec.size(); i++) {
-			particleVec[i].setPos(particleVec[i].getPos() + particleVec[i].getHeading());
-			particleVec[i].setLifespan(particleVec[i].getLifespan()-1);
+	// move particles according to their current direction and update their lifespan.  Headings and lifespans are given
+	// per motion capture frame; amount is the length of a simulation step in those frames
+	void updateParticles(float amount) {
+		for (int i = 0; i < particles.size(); i++) {
+			ofVec3f drift = flow != NULL ? flow->sample(particles[i].getPos()) * flowStrength : ofVec3f();
+			particles[i].move(amount, drift);
+		}
+		if (colliders != NULL && !particles.empty()) {
+			positions.resize(particles.size());
+			headings.resize(particles.size());
+			for (int i = 0; i < particles.size(); i++) {
+				positions[i] = particles[i].getPos();
+				headings[i] = particles[i].getHeading();
+			}
+			colliders->collide(positions, headings, bounce);
+			for (int i = 0; i < particles.size(); i++) {
+				particles[i].setPos(positions[i]);
+				particles[i].setHeading(headings[i]);
+			}
 		}
 	}
 
-	// remove particles from the system when they run out of lifespan
+	// remove particles from the system when they run out of lifespan; particles that die before older ones are hidden
+	// until those are removed
 	void checkLifespans() {
-		for (int i = 0; i < particleVec.size(); i++) {
-			if (particleVec[i].getLifespan() < 0) {
-				particleVec[i].setType(-1);
-				if (particleVec[0].getType() == -1) {
-					particleVec.erase(particleVec.begin());
-				}
-			}
+		for (int i = 0; i < particles.size(); i++) {
+			if (particles[i].getLifespan() < 0)
+				particles[i].setType(-1);
 		}
+		while (!particles.empty() && particles.front().getType() == -1)
+			particles.pop_front();
+	}
+
+	// remove the oldest group of particles to make room for new ones
+	void evictOldest() {
+		for (int i = 0; i < groupSize && !particles.empty(); i++)
+			particles.pop_front();
 	}
 
 	// getters and setters
 	size_t getSize() {
-		return particleVec.size();
+		return particles.size();
 	}
-	vector<Particle> getParticles() {
-		return particleVec;
+	deque<Particle> &getParticles() {
+		return particles;
 	}
 };
 
+void ParticleBudget::setCapacity(int capacity_) {
+	capacity = capacity_;
+	while (getSize() > capacity)
+		findLargest(NULL)->evictOldest();
+}
+
+int ParticleBudget::getSize() {
+	int size = 0;
+	for (int i = 0; i < systems.size(); i++)
+		size += systems[i]->getSize();
+	return size;
+}
+
+void ParticleBudget::reserve(ParticleSystem *system) {
+	while (getSize() >= capacity) {
+		ParticleSystem *largest = findLargest(system);
+		if (largest->getSize() == 0)
+			return;
+		largest->evictOldest();
+	}
+}
+
+ParticleSystem *ParticleBudget::findLargest(ParticleSystem *preferred) {
+	ParticleSystem *largest = preferred;
+	for (int i = 0; i < systems.size(); i++) {
+		if (largest == NULL || systems[i]->getSize() / systems[i]->getPriority() > largest->getSize() / largest->getPriority())
+			largest = systems[i];
+	}
+	return largest;
+}
+
+// the one budget all figures' particles come from
+ParticleBudget particleBudget;
+
 //--------------------------------------------------------------
 
 /* Each Tracker object tracks the position data of one figure in the scene, as well as visual effects related to that figure.  
@@ -110,16 +287,32 @@ public:
 	
 	// Frames hold the set of position values in each frame of movement
 	typedef vector<ofVec3f> Frame;
-	// each track contains the position values of all frames for each figure
+	// the poses of the figure, newest first, one per capture frame; see recordFrame()
 	typedef deque<Frame> Track;
-	Track track, lTrack, rTrack;
+	Track track;
+	// poses kept in the track: five seconds of the Perfume takes
+	static const int HISTORY_FRAMES = 200;
+	// seconds since the last pose went into the track
+	float historyTime;
 	int numPoints;
 	float boltTime;
 	bool drawBolt;
 	bool leftTarget, rightTarget;
 	int placeCount, direction, segment, numBolts;
-	int modifier[1024];
-	int startIndices[64], endIndices[64];
+	// upper limits for the bolt paths generated in setupBolts()
+	static const int MAX_BOLTS = 16;
+	static const int MAX_BOLT_POINTS = 32;
+	int modifier[MAX_BOLT_POINTS + 1];
+	// start joint of every bolt, and a random end joint for when there is no joint in reach
+	int startIndices[MAX_BOLTS], endIndices[MAX_BOLTS];
+	// end joints of the bolts along this figure; see updateTargets()
+	int selfTargets[MAX_BOLTS];
+	// the colored bolts to the figure on the left, between the joints of the two figures nearest to each other; the
+	// target is -1 for those without a pair in reach.  See updateTargets()
+	static const int NUM_COLORED_BOLTS = 4;
+	int coloredStarts[NUM_COLORED_BOLTS], coloredTargets[NUM_COLORED_BOLTS];
+	// offset of each connecting point of a bolt from the straight line between its endpoints, indexed by [bolt][point]
+	ofVec3f boltPaths[MAX_BOLTS][MAX_BOLT_POINTS + 1];
 	
 	struct Buffer
 	{
@@ -129,17 +322,52 @@ public:
 	typedef vector<Buffer> BufferArray;
 	vector<BufferArray> buffer;
 	ParticleSystem particleHandler;
+	RandomGenerator rng;
+	// separate stream for the flicker of line widths and point sizes, so drawing more or less often does not change the effects
+	RandomGenerator jitter;
+	// the current pose of the figure, uploaded once per new frame and shared by every layer drawn in drawFigure()
+	ofVbo figureVbo;
+	int figureVertices;
 	Frame startPoints, lPoints, rPoints;
+	// level of detail, from 0 (full) to 2; distant figures emit fewer particles and draw fewer bolt layers
+	int lod;
+	// height of the figure on screen in pixels, as of the last updateLod()
+	float screenSize;
+	// bounding sphere of the current pose
+	ofVec3f boundsCenter;
+	float boundsRadius;
+	// times the particles and bolts, and sets how many of them there are
+	QualityGovernor *quality;
 	
 	// initialize values
-	void setup(ofxBvh *o, int id_)
+	void setup(ofxBvh *o, int id_, QualityGovernor *quality_)
 	{
 		bvh = o;
+		quality = quality_;
 		boltTime = 0;
 		drawBolt = false;
 		placeCount = 0;
+		numBolts = 0;
 		modifier[0] = 0;
+		for (int n = 0; n < MAX_BOLTS; n++) {
+			startIndices[n] = endIndices[n] = 0;
+			selfTargets[n] = 0;
+		}
+		for (int k = 0; k < NUM_COLORED_BOLTS; k++) {
+			coloredStarts[k] = 0;
+			coloredTargets[k] = -1;
+		}
 		id = id_;
+		rng.setSeed(randomSeed, id);
+		particleHandler.setup(&particleBudget);
+		particleHandler.setFlow(&flowField, 0.4);
+		particleHandler.setColliders(&colliders, 0.5);
+		jitter.setSeed(randomSeed, 100 + id);
+		figureVertices = 0;
+		historyTime = 0;
+		lod = 0;
+		screenSize = 0;
+		boundsRadius = 0;
 	}
 	// set which figures are to the left and right of this figure
 	void setBvhL(ofxBvh *o) {
@@ -154,69 +382,143 @@ public:
 	{
 		if (bvh->isFrameNew())
 		{
-			// add the position data in the current frame to the tracker
-			Frame f, lF, rF;
-			addFrame(&f, bvh, &track);
-			// also keep track of the position data of the other two figures
-			addFrame(&lF, bvhL, &lTrack);
-			addFrame(&rF, bvhR, &rTrack);	
-			startPoints = track[0];
-			lPoints = lTrack[0];
-			rPoints = rTrack[0];
+			// the current pose of this figure, and of the other two
+			getFrame(&startPoints, bvh);
+			getFrame(&lPoints, bvhL);
+			getFrame(&rPoints, bvhR);
+			uploadFigure();
+			updateBounds();
+		}
+	}
 
-			modifyVertices();
-			cacheVertices();
-			handleParticles();
+	// advance the particles and bolts by one fixed simulation step of stepTime seconds
+	void step(float stepTime)
+	{
+		// the history of poses, and what is emitted with it, moves on once per capture frame, whatever rate the takes
+		// were resampled to for drawing
+		historyTime += stepTime;
+		if (startPoints.empty())
+			historyTime = 0;
+		while (historyTime >= getCaptureFrameTime()) {
+			historyTime -= getCaptureFrameTime();
+			recordFrame();
 		}
+
+		quality->begin(PARTICLES);
+		particleHandler.updateParticles(stepTime / getCaptureFrameTime());
+		particleHandler.checkLifespans();
+		quality->end(PARTICLES);
+
+		if (startPoints.empty())
+			return;
+
+		quality->begin(BOLTS);
+		handleBolts();
+
+		// sparks where the bolts drawn in drawBolts() meet the figures; each level of detail halves their chance
+		for (int n = 0; n < getNumSmallBolts(); n++)
+			emitSparks(startPoints, startIndices[n], selfTargets[n], 20 << lod);
+		for (int k = 0; k < NUM_COLORED_BOLTS; k++)
+			emitSparks(lPoints, coloredStarts[k], coloredTargets[k], 100 << lod);
+		quality->end(BOLTS);
 	}
 
-	// draw the elements in the scene
+	// number of the short bolts along the figure itself, as many as the governor allows
+	int getNumSmallBolts() {
+		return quality->get(SMALL_BOLTS);
+	}
+
+	// height of the current pose on screen, from its bounding sphere; offset is the translation drawScene() applies
+	float getScreenSize(const ofCamera &cam, const ofVec3f &offset, float viewHeight) {
+		if (startPoints.empty())
+			return 0;
+		float depth = (boundsCenter + offset - cam.getPosition()).dot(cam.getLookAtDir());
+		// behind the camera
+		if (depth <= 0)
+			return 0;
+		return boundsRadius * viewHeight / (depth * tan(cam.getFov() * 0.5 * DEG_TO_RAD));
+	}
+
+	// picks the level of detail for the figure's size on screen
+	void updateLod(float screenSize_) {
+		screenSize = screenSize_;
+		int level = 0;
+		while (level < 2 && screenSize < lodScreenSizes[level] * (lod > level ? lodHysteresis : 1))
+			level++;
+		lod = level;
+		// nearer figures keep more of their particles when the budget is full
+		particleHandler.setPriority(1.0 / (1 << lod));
+	}
+
+	// draw the figure; the particles and bolts are drawn in passes of their own, so each can be timed for the governor
 	void draw()
 	{
 		glEnable(GL_POLYGON_OFFSET_FILL);
 		glPolygonOffset(1, 1);
 
-		drawParticles();
-		drawFigure();
-		handleBolts();
+		// line widths and point sizes reach past the joints, so the sphere is given some room
+		if (frustum.intersects(boundsCenter, boundsRadius + 50))
+			drawFigure();
+
+		glDisable(GL_POLYGON_OFFSET_FILL);
+		glPolygonOffset(0, 0);
+		glDisable(GL_LIGHT0);
+		glDisable(GL_LIGHT1);
+	}
 
+	// draw the "lightning bolts" set up in handleBolts() and the colored ones to the figure on the left
+	void drawBolts()
+	{
 		int fade = 100-boltTime;
 		ofVec3f mid, last;
+		// distant figures draw each bolt once, and the farthest only its bright core.  Without bloom the governor can
+		// drop the second pass of the nearest ones too; with bloom the intensity is only a brightness and costs nothing
+		int passes = quality->get(BOLT_PASSES);
+		int intensity = lod == 0 ? (bloomMode ? 2 : passes) : 1;
+		int layers = lod < 2 ? 3 : 1;
 		int widths[16];
 		ofColor colors[16];
-		widths[0] = 3+rand()%3;
-		widths[1] = 5+rand()%2;
+		widths[0] = 3+jitter.nextInt(3);
+		widths[1] = 5+jitter.nextInt(2);
 		widths[2] = 10;
 		colors[0] = ofColor(255, 255, 255, 110-fade);
 		colors[1] = ofColor(100, 100, 225, 20);
 		colors[2] = ofColor(0, 20, 225, 100-fade);
 		// draw "lightning bolts" using the values assigned above
-		for (int n = 0; n < 10; n++)
-			renderBolt(last, mid, numPoints, fade, startPoints, startIndices[n], endIndices[n], widths, colors, 20, 2, 1);
+		for (int n = 0; n < getNumSmallBolts(); n++)
+			renderBolt(last, mid, numPoints, fade, startPoints, startIndices[n], selfTargets[n], n, widths, colors, intensity, layers, 1);
 		colors[1] = ofColor(50, 50, 150, 100);
 		colors[2] = ofColor(20, 50, 170, 100);
-		renderBolt(last, mid, numPoints, 0, lPoints, 21, 21, widths, colors, 100, 2, 1);
-		renderBolt(last, mid, numPoints, 0, lPoints, 19, 19, widths, colors, 100, 2, -1);
+		renderBolt(last, mid, numPoints, 0, lPoints, coloredStarts[0], coloredTargets[0], 10, widths, colors, intensity, layers, 1);
+		renderBolt(last, mid, numPoints, 0, lPoints, coloredStarts[1], coloredTargets[1], 11, widths, colors, intensity, layers, -1);
 		colors[1] = ofColor(220, 220, 10, 50);
 		colors[2] = ofColor(220, 220, 20, 50);
-		renderBolt(last, mid, numPoints, 0, lPoints, 52, 52, widths, colors, 100, 2, -1);
+		renderBolt(last, mid, numPoints, 0, lPoints, coloredStarts[2], coloredTargets[2], 12, widths, colors, intensity, layers, -1);
 		colors[1] = ofColor(100, 230, 100, 50);
-		colors[2] = ofColor(50, 230, 50, 50);
-		renderBolt(last, mid, numPoints, 0, lPoints, 45, 45, widths, colors, 100, 2, -1);
-
-		drawFloor();
-		glDisable(GL_POLYGON_OFFSET_FILL);
-		glPolygonOffset(0, 0);
-		glDisable(GL_LIGHT0);
-		glDisable(GL_LIGHT1);
+		colors[2] = ofColor(50, 230, 50, 50);
+		renderBolt(last, mid, numPoints, 0, lPoints, coloredStarts[3], coloredTargets[3], 13, widths, colors, intensity, layers, -1);
 	}
 	
+	// a sphere around every joint of the current pose, from their average and the farthest one from it
+	void updateBounds() {
+		if (startPoints.empty())
+			return;
+		boundsCenter.set(0, 0, 0);
+		for (int i = 0; i < startPoints.size(); i++)
+			boundsCenter += startPoints[i];
+		boundsCenter /= startPoints.size();
+		boundsRadius = 0;
+		for (int i = 0; i < startPoints.size(); i++)
+			boundsRadius = MAX(boundsRadius, boundsCenter.distance(startPoints[i]));
+	}
+
 	/* Tracker updating functions: these are mostly code from the original example's update() function, broken into smaller sections.  There is a slight 
 	   modification to the code for adding Frames to the track containers to modify the positions of the last 3 figures, and code to update the particle 
 	   handler was added. */
 
-	// adds the current position values of the figure to a Track container 
-	void addFrame(Frame* f, ofxBvh *o, Track* track_) {
+	// fills a Frame with the current position values of a figure
+	void getFrame(Frame* f, ofxBvh *o) {
+		f->clear();
 		for (int i = 0; i < o->getNumJoints(); i++)
 		{
 			const ofxBvhJoint *j = o->getJoint(i);
@@ -234,9 +536,25 @@ public:
 				}
 			}
 		}
-		track_->push_front(*f);	
-		if (track_->size() > 200)
-			track_->pop_back();
+	}
+
+	// adds the current pose to the figure's Track and moves the older ones along; once per capture frame, with the
+	// particles emitted around the head
+	void recordFrame() {
+		track.push_front(startPoints);
+		if (track.size() > HISTORY_FRAMES)
+			track.pop_back();
+		modifyVertices();
+		cacheVertices();
+		quality->begin(PARTICLES);
+		handleParticles();
+		quality->end(PARTICLES);
+	}
+
+	// seconds per frame of the take as captured; particle headings and lifespans, and the pose history, are given in
+	// these frames.  Without a take, one frame per simulation step
+	float getCaptureFrameTime() {
+		return bvh->getSourceFrameTime() > 0 ? bvh->getSourceFrameTime() : simClock.getStepTime();
 	}
 
 	// applies gravity modifiers to the position data in Frames older than the current one; this is from the original code and not currently used
@@ -254,10 +572,11 @@ public:
 					
 				// gravity
 				f.y -= -2.5 * (1 - sin(pow(delta, 2) * PI));
-				f.y += ofNoise(v.y * 0.0001 + offset.y) * 1.4;
-					
-				f.x += ofSignedNoise(v.x * 0.0001 + offset.x) * 3;
-				f.z += ofSignedNoise(v.z * 0.0001 + offset.z) * 3;
+				// drift along the flow field, upwards on average
+				ofVec3f flow = flowField.sample(v);
+				f.x += flow.x * 3;
+				f.y += 0.7 + flow.y * 0.7;
+				f.z += flow.z * 3;
 					
 				if (v.y < 0)
 				{
@@ -279,6 +598,18 @@ public:
 		}
 	}
 
+	// copies the current pose of this figure into its vertex buffer
+	void uploadFigure() {
+		const Frame &f = startPoints;
+		if (f.empty())
+			return;
+		if (f.size() != figureVertices) {
+			figureVbo.setVertexData(&f[0], f.size(), GL_DYNAMIC_DRAW);
+			figureVertices = f.size();
+		}
+		else figureVbo.updateVertexData(&f[0], f.size());
+	}
+
 	// stores the positions of the vertices in this figure's Track
 	void cacheVertices() {
 		buffer.clear();
@@ -318,29 +649,28 @@ public:
 		}
 	}
 
-	// emit particles around the heads of the figures and update properties of existing particles
+	// emit particles around the heads of the figures, as many as the governor allows; the particle budget decides how
+	// many there can be in total
 	void handleParticles() {
-		if (particleHandler.getSize() < 10000) {
-			for (int j = 0; j < 12; j++) {
-				ofVec3f next;
-				// index 21 holds the position of the top of the figure
-				next.x = track[0][21].x + rand()%40-20;
-				next.y = track[0][21].y + rand()%40-20;
-				next.z = track[0][21].z + rand()%40-20;
-				particleHandler.emit(next, ofVec3f(rand()%1-1,0.5,rand()%1), 5, 1);
-				next.x = track[0][21].x + rand()%4-2;
-				next.y = track[0][21].y + rand()%4-2;
-				next.z = track[0][21].z + rand()%4-2;
-				particleHandler.emit(next, ofVec3f(0,0.5,0), 5, 1);
-			}
+		// fewer for distant figures
+		for (int j = 0; j < ((int)quality->get(EMISSIONS) >> lod); j++) {
+			ofVec3f next;
+			// index 21 holds the position of the top of the figure
+			next.x = track[0][21].x + rng.nextInt(40)-20;
+			next.y = track[0][21].y + rng.nextInt(40)-20;
+			next.z = track[0][21].z + rng.nextInt(40)-20;
+			particleHandler.emit(next, ofVec3f(rng.nextInt(1)-1,0.5,rng.nextInt(1)), 5, 1);
+			next.x = track[0][21].x + rng.nextInt(4)-2;
+			next.y = track[0][21].y + rng.nextInt(4)-2;
+			next.z = track[0][21].z + rng.nextInt(4)-2;
+			particleHandler.emit(next, ofVec3f(0,0.5,0), 5, 1);
 		}
-		particleHandler.updateParticles();
 	}
 
 	/* drawing functions */
 	// draw an openGL point
 	void drawPoint(int size, ofColor color, ofVec3f pos) {
-		glPointSize(size);
+		Antialiasing::pointSize(size);
 		glBegin(GL_POINTS);
 		ofSetColor(color);
 		glVertex3fv(pos.getPtr());
@@ -348,75 +678,80 @@ public:
 	}
 
 	// draw an openGL line strip
-	void drawLineStrip(int width, ofColor color, ofVec3f pos1, ofVec3f pos2) {
-		glLineWidth(width);
+	void drawLineStrip(int width, const ofColor &color, const ofVec3f &pos1, const ofVec3f &pos2) {
+		Antialiasing::lineWidth(width);
 		glBegin(GL_LINE_STRIP);
 		ofSetColor(color);
 		glVertex3fv(pos1.getPtr());
 		glVertex3fv(pos2.getPtr());
 		glEnd();
 	}
+
+	// draw an openGL line strip in a color scaled by brightness; the bloom buffer keeps components above 1
+	void drawBrightLine(int width, const ofColor &color, float brightness, const ofVec3f &pos1, const ofVec3f &pos2) {
+		Antialiasing::lineWidth(width);
+		glBegin(GL_LINE_STRIP);
+		glColor4f(color.r / 255.0 * brightness, color.g / 255.0 * brightness, color.b / 255.0 * brightness, color.a / 255.0);
+		glVertex3fv(pos1.getPtr());
+		glVertex3fv(pos2.getPtr());
+		glEnd();
+	}
 	
 	// draw the existing particles
-	void drawParticles() {
-		particleHandler.checkLifespans();
-		vector<Particle> current = particleHandler.getParticles();
+	void drawParticles(float alpha) {
+		deque<Particle> &current = particleHandler.getParticles();
 		for (int j = 0; j < current.size(); j++) {
 			if (current[j].getType() == 1) {
-				drawPoint(5, ofColor(230, 230, 230, 50), current[j].getPos());
-				drawPoint(10, ofColor(70, 100, 200, 25), current[j].getPos());
-				drawPoint(15, ofColor(70, 100, 200, 25), current[j].getPos());
+				ofVec3f pos = current[j].getPos(alpha);
+				if (!frustum.intersects(pos, 20))
+					continue;
+				if (bloomMode) {
+					drawPoint(4, ofColor(190, 205, 245, 110), pos);
+					continue;
+				}
+				drawPoint(5, ofColor(230, 230, 230, 50), pos);
+				drawPoint(10, ofColor(70, 100, 200, 25), pos);
+				drawPoint(15, ofColor(70, 100, 200, 25), pos);
 			}
 		}
 	}
 
-	// draws the figure this Tracker is handling.  Taken from the original code.
+	// draws the figure this Tracker is handling.  Adapted from the original code; both layers are drawn from the figure's vertex buffer.
 	void drawFigure() {
-		if (!track.empty())
+		if (figureVertices > 0 && bloomMode)
 		{
-			Frame &f = track[0];
-			
-			glLineWidth(1+rand()%3);
+			// the lines once; the bloom pass spreads them into the halo the second layer below draws
+			Antialiasing::lineWidth(1+jitter.nextInt(3));
+			ofSetColor(150, 180, 230, 110);
+			figureVbo.draw(GL_LINES, 0, figureVertices);
+		}
+		else if (figureVertices > 0)
+		{
+			Antialiasing::lineWidth(1+jitter.nextInt(3));
 			ofSetColor(222, 222, 222, 50);
-			glBegin(GL_LINES);
-			for (int n = 0; n < f.size(); n += 2)
-			{
-				ofVec3f &v1 = f[n];
-				ofVec3f &v2 = f[n + 1];
-				
-				glVertex3fv(v1.getPtr());
-				glVertex3fv(v2.getPtr());
-			}
-			glEnd();
+			figureVbo.draw(GL_LINES, 0, figureVertices);
 			// draw another set of lines for visual effect
-			glLineWidth(10-rand()%2);
+			Antialiasing::lineWidth(10-jitter.nextInt(2));
 			ofSetColor(70, 120, 222, 40);
-			glBegin(GL_LINES);
-			for (int n = 0; n < f.size(); n += 2)
-			{
-				ofVec3f &v1 = f[n];
-				ofVec3f &v2 = f[n + 1];
-				
-				glVertex3fv(v1.getPtr());
-				glVertex3fv(v2.getPtr());
-			}
-			glEnd();
+			figureVbo.draw(GL_LINES, 0, figureVertices);
 		}
 	}
 
 	// generates values that will be used to draw randomized "lightning bolts" between points on this figure and one of the other figures
 	void setupBolts(int numPoints_, int boltTime_) {
-		numBolts = rand()%2+1;
+		numBolts = rng.nextInt(2)+1;
 		numPoints = numPoints_;
+		if (numPoints > MAX_BOLT_POINTS)
+			numPoints = MAX_BOLT_POINTS;
 		boltTime = boltTime_;
 		placeCount = 0;
 		segment = 0;
 		// store randomized indices, which can be used to draw "lightning bolts" between random points on this figure and another one
-		for (int i = 0; i < startPoints.size(); i++) {
-			startIndices[i] = rand()%startPoints.size();
-			endIndices[i] = rand()%startPoints.size();
+		for (int i = 0; i < MAX_BOLTS; i++) {
+			startIndices[i] = rng.nextInt(startPoints.size());
+			endIndices[i] = rng.nextInt(startPoints.size());
 		}
-		if (rand()%2 == 0)
+		if (rng.nextInt(2) == 0)
 			direction = 1;
 		else direction = -1;
 		// store a set of "modifiers" that will be used to draw a jagged "lightning bolt"-like line by changing the y value of points along the line
@@ -427,25 +762,59 @@ public:
 				if (segment%(numPoints/3) == 0 && i != 1) { 
 					direction *= -1;
 					segment = 0;
-					modifier[i] = (rand()%20)*direction;
+					modifier[i] = rng.nextInt(20)*direction;
 				}
-				else modifier[i] += (rand()%10)*direction;
+				else modifier[i] += rng.nextInt(10)*direction;
 				if (abs(modifier[i] > 100))
 					modifier[i] = modifier[i-1];
 			}
 		}
+		// generate the jagged path of every bolt once, so drawing only has to follow the current positions of the bolt's endpoints
+		for (int n = 0; n < MAX_BOLTS; n++) {
+			rng.fill(&boltPaths[n][1], numPoints, 0, 10);
+			for (int i = 1; i <= numPoints; i++)
+				boltPaths[n][i].y += modifier[i];
+		}
+		updateTargets();
+	}
+
+	// points the bolts at the joints nearest to their start joints in the current poses, from the joint index update()
+	// builds every frame; called again when new bolts are set up
+	void updateTargets() {
+		if (startPoints.empty())
+			return;
+		for (int n = 0; n < getNumSmallBolts(); n++)
+			selfTargets[n] = findTarget(startIndices[n], id, selfBoltReach, endIndices[n]);
+		int found = joints.findNearestPairs(id, getFigure(bvhL), figureBoltReach, coloredStarts, coloredTargets, NUM_COLORED_BOLTS);
+		for (int k = found; k < NUM_COLORED_BOLTS; k++)
+			coloredTargets[k] = -1;
+	}
+
+	// the joint of the given figure nearest to the given joint of this one, or fallback when none is in reach
+	int findTarget(int start, int figure, float reach, int fallback) {
+		int nearest = joints.findNearest(startPoints[start], figure, figure == id ? minBoltLength : 0, reach);
+		return nearest >= 0 ? nearest : fallback;
+	}
+
+	// number of the figure moving with the given motion, as the joint index knows it
+	int getFigure(const ofxBvh *o) {
+		for (int i = 0; i < trackers.size(); i++) {
+			if (trackers[i]->bvh == o)
+				return trackers[i]->id;
+		}
+		return -1;
 	}
 
 	// determines when "lightning bolts" will be drawn
 	void handleBolts() {
 		// random chance of determining that bolts should be drawn
-		if (!drawBolt && rand()%100 == 0) {
+		if (!drawBolt && rng.nextInt(100) == 0) {
 			drawBolt = true;
-			if (rand()%3 == 0) {
+			if (rng.nextInt(3) == 0) {
 				leftTarget = true;
 				rightTarget = false;
 			}
-			else if (rand()%3 == 1) {
+			else if (rng.nextInt(3) == 1) {
 				rightTarget = true;
 				leftTarget = false;
 			}
@@ -456,7 +825,7 @@ public:
 		}
 		// generate new information for a set of bolts
 		if (boltTime <= 0) {
-			setupBolts(20+rand()%4-2, numPoints+40+rand()%10);
+			setupBolts(20+rng.nextInt(4)-2, numPoints+40+rng.nextInt(10));
 		}
 		else {
 			boltTime--;
@@ -470,36 +839,63 @@ public:
 	}
 
 	// draws a "lightning bolt" as a series of line segments between random points determined in setupBolts()
-	void renderBolt(ofVec3f last, ofVec3f mid, int numPoints_, int fade, Frame target, int startIndex, int endIndex, int widths[], ofColor colors[], int sparkMod, int intensity, int positionMod) {
+	void renderBolt(ofVec3f last, ofVec3f mid, int numPoints_, int fade, const Frame &target, int startIndex, int endIndex, int bolt, int widths[], ofColor colors[], int intensity, int layers, int positionMod) {
+		// a target on a figure with fewer joints
+		if (startIndex >= startPoints.size() || endIndex < 0 || endIndex >= target.size())
+			return;
+		// skip the bolt if the sphere through its endpoints, widened by how far the jagged path strays from the straight line, is off screen
+		ofVec3f a = startPoints[startIndex], b = target[endIndex];
+		a.y *= positionMod;
+		b.y *= positionMod;
+		if (!frustum.intersects((a + b) * 0.5, a.distance(b) * 0.5 + 120))
+			return;
+
+		// with bloom, halfway between the white core and the colored outer layer, and as bright as all the layers together
+		ofColor core((colors[0].r + colors[2].r) / 2, (colors[0].g + colors[2].g) / 2, (colors[0].b + colors[2].b) / 2, colors[0].a);
+
 		for (int i = 1; i <= numPoints_; i++) {
-			// emit particles where the bolt begins
-			if (rand()%sparkMod == 0)
-				particleHandler.emit(startPoints[startIndex], ofVec3f(rand()%2-1,rand()%2-1,rand()%2-1), 5, 1);
 			// set the starting point for the first segment of the bolt
 			if (i == 1) {
 				last = startPoints[startIndex];
 				last.y *= positionMod;
 			}
 
-			// determine the position of the next point to draw a line to, based on values generated in setupBolts()
-			mid.x = startPoints[startIndex].x + float(i)/numPoints*(target[endIndex].x-startPoints[startIndex].x) + rand()%10;
-			mid.y = startPoints[startIndex].y*positionMod + float(i)/numPoints*(target[endIndex].y-startPoints[startIndex].y)*positionMod + modifier[i] + rand()%10;
-			mid.z = startPoints[startIndex].z + float(i)/numPoints*(target[endIndex].z-startPoints[startIndex].z) + rand()%10;
+			// determine the position of the next point to draw a line to, based on the path generated in setupBolts()
+			const ofVec3f &start = startPoints[startIndex];
+			const ofVec3f &end = target[endIndex];
+			const ofVec3f &jag = boltPaths[bolt][i];
+			float t = float(i)/numPoints;
+			mid.x = start.x + t*(end.x-start.x) + jag.x;
+			mid.y = start.y*positionMod + t*(end.y-start.y)*positionMod + jag.y;
+			mid.z = start.z + t*(end.z-start.z) + jag.z;
 
 			// draw lines (multiple for visual effect) between the last point and the next point
-			for (int j = 0; j < intensity; j++) {
-				drawLineStrip(widths[0], colors[0], last, mid);
-				drawLineStrip(widths[1], colors[1], last, mid);
-				drawLineStrip(widths[2], colors[2], last, mid);
+			if (bloomMode) {
+				drawBrightLine(widths[0], core, intensity, last, mid);
+			}
+			else {
+				for (int j = 0; j < intensity; j++) {
+					for (int k = 0; k < layers; k++)
+						drawLineStrip(widths[k], colors[k], last, mid);
+				}
 			}
 			// set the endpoint of this line segment as the starting point for the next segment
 			last = mid;
 			// stop drawing segments when the bolt has not existed for very long - this "animates" the drawing of the bolt (not used in this version)
 			//if (i > placeCount)
 				//break;
-			// emit particles where the bolt ends if the bolt is close to its final point
-			if (i > numPoints - 5 && rand()%sparkMod == 0)
-				particleHandler.emit(target[endIndex], ofVec3f(rand()%2-1,rand()%2-1,rand()%2-1), 5, 1);
+		}
+	}
+
+	// emits particles where a bolt begins and near its final point; called every simulation step for each bolt that draw() renders
+	void emitSparks(const Frame &target, int startIndex, int endIndex, int sparkMod) {
+		if (startIndex >= startPoints.size() || endIndex < 0 || endIndex >= target.size())
+			return;
+		for (int i = 1; i <= numPoints; i++) {
+			if (rng.nextInt(sparkMod) == 0)
+				particleHandler.emit(startPoints[startIndex], ofVec3f(rng.nextInt(2)-1,rng.nextInt(2)-1,rng.nextInt(2)-1), 5, 1);
+			if (i > numPoints - 5 && rng.nextInt(sparkMod) == 0)
+				particleHandler.emit(target[endIndex], ofVec3f(rng.nextInt(2)-1,rng.nextInt(2)-1,rng.nextInt(2)-1), 5, 1);
 		}
 	}
 
@@ -533,33 +929,274 @@ public:
 		glLightfv(GL_LIGHT1, GL_SPOT_DIRECTION, direction);
 		glLightf(GL_LIGHT1, GL_SPOT_EXPONENT, 2.0);
 	}
+	
+};
+
+// draw a plane at y = 0 to show the effect of lighting; once per frame for all figures
+void drawFloor() {
+	ofSetColor(10, 10, 10, 10);
+	float mcolor[] = { 1.0f, 0.0f, 0.0f, 1.0f };
+	float specReflection[] = {1.0f, 1.0f, 1.0f};
+	float diffuse[] = {1.0f, 1.0f, 1.0f};
+	float ambient[] = {0.5f, 0.5f, 0.5f};
+	glMaterialfv(GL_FRONT, GL_SPECULAR, specReflection);
+	glMaterialfv(GL_FRONT, GL_AMBIENT, ambient);
+	glMaterialfv(GL_FRONT, GL_DIFFUSE, diffuse);
+
+	glBegin(GL_QUADS);
+	glVertex3f(-10000.0f, 0.0f, 10000.0f);              // Top Left
+	glVertex3f(10000.0f, 0.0f, 10000.0f);              // Top Right
+	glVertex3f(10000.0f, 0.0f, -10000.0f);              // Bottom Right
+	glVertex3f(-10000.0f, 0.0f, -10000.0f);             // Bottom Left            
+	glNormal3fv(ofVec3f(0.0f, 1.0f, 0.0f).getPtr());
+	glEnd();	
+}
+
+//--------------------------------------------------------------
+
+/* The Crowd draws many copies of the figures from a few shared poses.  Every dancer in the crowd plays one of the source motions with its own
+   transform (mirror, scale and offset) and time shift.  Each distinct source/frame pair in use is evaluated once and uploaded to a vertex buffer
+   that every dancer using that pose draws from, so adding dancers adds draw calls but no extra forward kinematics.  A live source has no
+   frames to share: its dancers share one pose that follows the source's current joints, taken again every frame. */
+class Crowd
+{
+public:
+
+	// frame of the pose of a live source, which is never cached
+	static const int LIVE_FRAME = -1;
+
+	struct Dancer
+	{
+		int source;
+		ofVec3f scale;		// negative components mirror the figure
+		ofVec3f offset;
+		float timeShift;	// seconds added to the scene time
+		int pose;			// index of the pose this dancer uses in the current frame
+	};
+
+	struct Pose
+	{
+		int source, frame;
+		bool used;
+		ofVbo vbo;
+		int vertices;
+		// bounding sphere of the joints, before the dancer's transform
+		ofVec3f boundsCenter;
+		float boundsRadius;
+	};
+
+	vector<ofxBvh*> sources;
+	vector<Dancer> dancers;
+	// poses are kept between frames, so a pose that is still current is not evaluated again; a deque, so a pose stays
+	// where it is as more are added
+	deque<Pose> poses;
+	vector<ofMatrix4x4> globals;
+	vector<ofVec3f> segments;
+
+	void addSource(ofxBvh *o) {
+		sources.push_back(o);
+	}
 
-	// draw a plane at y = 0 to show the effect of lighting
-	void drawFloor() {
-		ofSetColor(10, 10, 10, 10);
-		float mcolor[] = { 1.0f, 0.0f, 0.0f, 1.0f };
-		float specReflection[] = {1.0f, 1.0f, 1.0f};
-		float diffuse[] = {1.0f, 1.0f, 1.0f};
-		float ambient[] = {0.5f, 0.5f, 0.5f};
-		glMaterialfv(GL_FRONT, GL_SPECULAR, specReflection);
-		glMaterialfv(GL_FRONT, GL_AMBIENT, ambient);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, diffuse);
-
-		glBegin(GL_QUADS);
-		glVertex3f(-10000.0f, 0.0f, 10000.0f);              // Top Left
-        glVertex3f(10000.0f, 0.0f, 10000.0f);              // Top Right
-        glVertex3f(10000.0f, 0.0f, -10000.0f);              // Bottom Right
-		glVertex3f(-10000.0f, 0.0f, -10000.0f);             // Bottom Left            
-		glNormal3fv(ofVec3f(0.0f, 1.0f, 0.0f).getPtr());
-		glEnd();	
+	// frees the poses' vertex buffers; call while the GL context still exists, as the crowd outlives it
+	void clear() {
+		poses.clear();
+		for (int i = 0; i < dancers.size(); i++)
+			dancers[i].pose = -1;
+	}
+
+	void addDancer(int source, ofVec3f scale, ofVec3f offset, float timeShift) {
+		Dancer d;
+		d.source = source;
+		d.scale = scale;
+		d.offset = offset;
+		d.timeShift = timeShift;
+		d.pose = -1;
+		dancers.push_back(d);
+	}
+
+	// assign the first count dancers the pose they need at the given time (in seconds), evaluating only poses that are
+	// not cached yet; the others are not drawn
+	void update(float time, int count) {
+		for (int i = 0; i < poses.size(); i++)
+			poses[i].used = false;
+
+		count = MIN(count, (int)dancers.size());
+		for (int i = count; i < dancers.size(); i++)
+			dancers[i].pose = -1;
+
+		// keep the poses that are still current; a live one once more from the current joints
+		for (int i = 0; i < count; i++) {
+			Dancer &d = dancers[i];
+			d.pose = findPose(d.source, getFrame(d, time));
+			if (d.pose < 0)
+				continue;
+			if (poses[d.pose].frame == LIVE_FRAME && !poses[d.pose].used)
+				evaluatePose(poses[d.pose], d.source, LIVE_FRAME);
+			poses[d.pose].used = true;
+		}
+		// evaluate the remaining ones into poses that are no longer needed
+		for (int i = 0; i < count; i++) {
+			Dancer &d = dancers[i];
+			if (d.pose >= 0)
+				continue;
+			int frame = getFrame(d, time);
+			d.pose = findPose(d.source, frame);
+			if (d.pose < 0) {
+				d.pose = freePose();
+				evaluatePose(poses[d.pose], d.source, frame);
+			}
+			poses[d.pose].used = true;
+		}
+	}
+
+	// draw every dancer with the same lines as Tracker::drawFigure()
+	void draw() {
+		if (bloomMode) {
+			Antialiasing::lineWidth(2);
+			ofSetColor(150, 180, 230, 110);
+			drawDancers();
+			return;
+		}
+		Antialiasing::lineWidth(2);
+		ofSetColor(222, 222, 222, 50);
+		drawDancers();
+		Antialiasing::lineWidth(10);
+		ofSetColor(70, 120, 222, 40);
+		drawDancers();
+	}
+
+	void drawDancers() {
+		for (int i = 0; i < dancers.size(); i++) {
+			const Dancer &d = dancers[i];
+			if (d.pose < 0)
+				continue;
+			// the pose's bounding sphere moved and scaled with the dancer
+			Pose &pose = poses[d.pose];
+			float scale = MAX(fabs(d.scale.x), MAX(fabs(d.scale.y), fabs(d.scale.z)));
+			if (!frustum.intersects(d.offset + pose.boundsCenter * d.scale, pose.boundsRadius * scale + 50))
+				continue;
+			ofPushMatrix();
+			glTranslatef(d.offset.x, d.offset.y, d.offset.z);
+			glScalef(d.scale.x, d.scale.y, d.scale.z);
+			pose.vbo.draw(GL_LINES, 0, pose.vertices);
+			ofPopMatrix();
+		}
+	}
+
+	// frame of the dancer's source motion at the given time, looping the motion; LIVE_FRAME for a live source, which
+	// has no recorded frames to shift through
+	int getFrame(const Dancer &d, float time) {
+		ofxBvh *o = sources[d.source];
+		if (o->isLive() || o->getNumFrames() == 0)
+			return LIVE_FRAME;
+		float t = fmod(time + d.timeShift, o->getDuration());
+		if (t < 0)
+			t += o->getDuration();
+		return t / o->getFrameTime();
+	}
+
+	int findPose(int source, int frame) {
+		for (int i = 0; i < poses.size(); i++) {
+			if (poses[i].source == source && poses[i].frame == frame)
+				return i;
+		}
+		return -1;
+	}
+
+	int freePose() {
+		for (int i = 0; i < poses.size(); i++) {
+			if (!poses[i].used)
+				return i;
+		}
+		poses.push_back(Pose());
+		Pose &pose = poses.back();
+		pose.source = -1;
+		pose.frame = -1;
+		pose.used = false;
+		pose.vertices = 0;
+		pose.boundsRadius = 0;
+		return poses.size() - 1;
+	}
+
+	// evaluate one frame of a source motion, or the current pose of a live one, and upload its bone segments to the
+	// pose's vertex buffer
+	void evaluatePose(Pose &pose, int source, int frame) {
+		ofxBvh *o = sources[source];
+		if (frame == LIVE_FRAME) {
+			// as ofxBvh::update() left the joints
+			globals.resize(o->getNumJoints());
+			for (int i = 0; i < o->getNumJoints(); i++)
+				globals[i] = o->getJoint(i)->getGlobalMatrix();
+		}
+		else o->evaluateFrame(frame, globals);
+
+		segments.clear();
+		for (int i = 0; i < o->getNumJoints(); i++) {
+			const ofxBvhJoint *j = o->getJoint(i);
+			for (int n = 0; n < j->getChildren().size(); n++) {
+				segments.push_back(globals[i].getTranslation());
+				segments.push_back(globals[j->getChildren().at(n)->getIndex()].getTranslation());
+			}
+		}
+
+		pose.source = source;
+		pose.frame = frame;
+		if (segments.empty())
+			return;
+
+		pose.boundsCenter.set(0, 0, 0);
+		for (int i = 0; i < segments.size(); i++)
+			pose.boundsCenter += segments[i];
+		pose.boundsCenter /= segments.size();
+		pose.boundsRadius = 0;
+		for (int i = 0; i < segments.size(); i++)
+			pose.boundsRadius = MAX(pose.boundsRadius, pose.boundsCenter.distance(segments[i]));
+
+		if (segments.size() != pose.vertices) {
+			pose.vbo.setVertexData(&segments[0], segments.size(), GL_DYNAMIC_DRAW);
+			pose.vertices = segments.size();
+		}
+		else pose.vbo.updateVertexData(&segments[0], segments.size());
 	}
-	
 };
 
+Crowd crowd;
+// toggled with 'c': surrounds the figures with a crowd of dancers
+bool crowdMode = false;
+// toggled with 's': frame rate and the level of detail of every figure
+bool showStats = false;
+
+// draws the stats overlay in the top left corner of the window
+void drawStats(const vector<ofxBvh> &bvh, const DynamicResolution &resolution, const QualityGovernor &quality) {
+	string text = "fps " + ofToString(ofGetFrameRate(), 1) + "\n";
+	text += "gpu " + ofToString(resolution.getGpuTime() * 1000, 1) + " ms, scale " + ofToString(resolution.getScale(), 2) + "\n";
+	text += "\nsubsystem  quality  cpu ms  gpu ms\n";
+	for (int i = 0; i < quality.getNumSubsystems(); i++) {
+		char line[64];
+		sprintf(line, "%-9s  %7.2f  %6.2f  %6.2f\n", quality.getName(i).c_str(), quality.getQuality(i),
+			quality.getCpuTime(i) * 1000, quality.getGpuTime(i) * 1000);
+		text += line;
+	}
+	text += "\nparticles " + ofToString(particleBudget.getSize()) + " of " + ofToString(particleBudget.getCapacity()) + "\n";
+	text += "\nfigure  lod  size  joints  particles\n";
+	for (int i = 0; i < trackers.size(); i++) {
+		Tracker *t = trackers[i];
+		char line[64];
+		sprintf(line, "%6d  %3d  %4d  %2d/%2d   %9d\n", i, t->lod, (int)t->screenSize,
+			bvh[i].getNumEvaluatedJoints(), bvh[i].getNumJoints(), (int)t->particleHandler.getSize());
+		text += line;
+	}
+	ofDisableBlendMode();
+	ofSetColor(255);
+	ofDrawBitmapString(text, 20, 20);
+}
+
 /* functions for running the program in general; nearly all from the original code except for adding more figures to the bvh vector */
 //--------------------------------------------------------------
 void testApp::setup()
-{
+{
+	ofSeedRandom(randomSeed);
+
 	ofSetFrameRate(60);
 	ofSetVerticalSync(true);
 	
@@ -582,12 +1219,57 @@ void testApp::setup()
 
 	for (int i = 0; i < bvh.size(); i++)
 	{
+		// one pose per drawn frame, so playback never lands between two captured frames
+		bvh[i].resample(offline.isEnabled() ? offline.getFps() : 60);
 		bvh[i].setFrame(4);
 	}
 	
+	// figures driven by a live feed; each one plays its file until the feed has sent its skeleton
+	for (int i = 0; i < streamAddresses.size() && i < bvh.size(); i++)
+	{
+		ofxBvhStream *s = new ofxBvhStream;
+		s->open(streamAddresses[i]);
+		streams.push_back(s);
+	}
+	
 	track.loadSound("Perfume_globalsite_sound.wav");
 	track.setLoop(true);
-	track.play();
+	if (offline.isEnabled()) {
+		// render as fast as possible, without sound
+		ofSetFrameRate(0);
+		ofSetVerticalSync(false);
+		offline.start(trackDuration);
+	}
+	else {
+		track.play();
+		audioClock.setup(&track);
+	}
+	
+	antialiasing.start();
+	setupBuffers();
+	
+	// bolts are what the show is about, so they keep their density longer than the particles, and the crowd in the
+	// background gives way first
+	quality.addSubsystem("particles");
+	quality.addSubsystem("bolts", 2);
+	quality.addSubsystem("crowd", 0.5);
+	if (stressParticles > 0) {
+		// a budget of the given size, and enough particles emitted per figure and capture frame to fill it: each
+		// emission lives for 10 capture frames in all
+		quality.addKnob(PARTICLES, stressParticles, stressParticles);
+		int emissions = ceil(stressParticles / (bvh.size() * 10.0));
+		quality.addKnob(PARTICLES, emissions, emissions);
+	}
+	else {
+		quality.addKnob(PARTICLES, 3000, 15000);
+		quality.addKnob(PARTICLES, 3, 12);
+	}
+	quality.addKnob(BOLTS, 3, 10);
+	quality.addKnob(BOLTS, 1, 2);
+	quality.addKnob(CROWD, 24, 120);
+	// offline renders take as long as they need, at full density
+	if (offline.isEnabled())
+		quality.setEnabled(false);
 	
 	// setup tracker
 	for (int i = 0; i < bvh.size(); i++)
@@ -595,7 +1277,7 @@ void testApp::setup()
 		ofxBvh &b = bvh[i];
 
 		Tracker *t = new Tracker;
-		t->setup(&b, i);
+		t->setup(&b, i, &quality);
 		trackers.push_back(t);
 	}
 	
@@ -612,12 +1294,25 @@ void testApp::setup()
 	trackers[4]->setBvhR(&bvh[5]);
 	trackers[5]->setBvhR(&bvh[4]);
 
-	offset.x = ofRandom(1);
-	offset.y = ofRandom(1);
-	offset.z = ofRandom(1);
-	offset_v.x = ofRandom(0.001);
-	offset_v.y = ofRandom(0.005);
-	offset_v.z = ofRandom(0.001);
+	// setup crowd: rings of dancers around the figures, mirrored and scaled, sharing the three motions at a few time shifts
+	for (int i = 0; i < 3; i++)
+		crowd.addSource(&bvh[i]);
+	for (int i = 0; i < 120; i++) {
+		int ring = i / 24;
+		float angle = TWO_PI * (i % 24) / 24;
+		float radius = 2400 + ring * 800;
+		float scale = 2 + ring * 0.5;
+		float mirror = (i % 2 == 0) ? 1 : -1;
+		crowd.addDancer(i % 3, ofVec3f(scale * mirror, scale, scale), ofVec3f(cos(angle) * radius, 0, sin(angle) * radius), (i % 8) * 0.5);
+	}
+
+	// a coarse grid over the space the figures move in; the flow changes over four seconds
+	flowField.setup(ofVec3f(-2000, -400, -2000), ofVec3f(2000, 800, 2000), 16, 8, 16);
+	flowField.setSeed(ofRandom(1000));
+	// the figures reach through the floor to their flipped lower halves, and so do the sparks on them
+	colliders.setFloor(false);
+	colliders.setCellSize(100);
+	joints.setCellSize(300);
 	
 	// determines starting location of camera
 	campos_t.set(1400, 600, -600);
@@ -625,15 +1320,42 @@ void testApp::setup()
 
 //--------------------------------------------------------------
 void testApp::update()
-{
-	float t = (track.getPosition() * trackDuration);
-	t = t / bvh[0].getDuration();
+{
+	quality.beginFrame();
+	// the governor sizes the scene-wide particle budget; lowering it evicts the oldest particles right away
+	particleBudget.setCapacity(quality.get(MAX_PARTICLES));
+	
+	// the antialiasing benchmark changes the mode on its own, and the resolution follows the GPU time of the last frames;
+	// the buffers follow both.  The resolution gives way to the quality governor, which thins out the effects first
+	if (!offline.isEnabled()) {
+		bool changed = antialiasing.update();
+		if (!antialiasing.isBenchmarking() && resolution.update(!quality.isCutting(), quality.isFull()))
+			changed = true;
+		if (changed)
+			setupBuffers();
+	}
+	
+	float t;
+	if (offline.isEnabled()) {
+		t = offline.getTime();
+		elapsedTime = t;
+	}
+	else {
+		// follow the music, smoothing out the coarse position reports of the sound player
+		audioClock.update();
+		t = audioClock.getTime();
+		elapsedTime = ofGetElapsedTimef();
+	}
+	flowField.update(elapsedTime);
 	
 	center_t.set(0, 0, 0);
 	
 	for (int i = 0; i < bvh.size(); i++)
 	{
-		bvh[i].setPosition(t);
+		if (i < streams.size())
+			streams[i]->update(bvh[i]);
+		if (!bvh[i].isLive())
+			bvh[i].setTime(t);
 		bvh[i].update();
 		
 		center_t += bvh[i].getJoint(0)->getPosition();
@@ -642,35 +1364,142 @@ void testApp::update()
 	}
 	
 	center_t /= 3;
-	center += (center_t - center) * 0.01;
 	
 	for (int i = 0; i < trackers.size(); i++)
 	{
 		trackers[i]->update();
 	}
 	
-	offset += offset_v;
+	// the bodies the particles bounce off, in this frame's poses
+	quality.begin(PARTICLES);
+	colliders.clear();
+	for (int i = 0; i < trackers.size(); i++)
+		colliders.addSegments(trackers[i]->startPoints, 15);
+	colliders.build();
+	quality.end(PARTICLES);
+	
+	// --stress-particles: how long the collisions took, averaged over a second
+	if (stressParticles > 0 && ofGetFrameNum() % 60 == 0) {
+		ofLogNotice("testApp", ofToString(particleBudget.getSize()) + " particles, " + ofToString(colliders.getNumTested() / 60)
+			+ " collided per frame in " + ofToString(colliders.getTime() / 60, 3) + " ms");
+		colliders.resetTiming();
+	}
+	
+	// bolts follow the joints nearest to them
+	quality.begin(BOLTS);
+	joints.clear();
+	for (int i = 0; i < trackers.size(); i++)
+		joints.add(trackers[i]->startPoints, trackers[i]->id);
+	joints.build();
+	for (int i = 0; i < trackers.size(); i++)
+		trackers[i]->updateTargets();
+	quality.end(BOLTS);
+
+	if (crowdMode) {
+		quality.begin(CROWD);
+		crowd.update(t, quality.get(CROWD_SIZE));
+		quality.end(CROWD);
+	}
+	
+	// advance the effects in fixed steps, however often the scene is drawn
+	int steps = simClock.advance(elapsedTime);
+	for (int s = 0; s < steps; s++)
+	{
+		for (int i = 0; i < trackers.size(); i++)
+		{
+			trackers[i]->step(simClock.getStepTime());
+		}
+		
+		center += (center_t - center) * 0.01;
+		campos += (campos_t - campos) * 0.005;
+	}
 	
 	cam.setPosition(campos.x, campos.y, campos.z);
 	// determine orientation of camera
 	cam.lookAt(ofVec3f(0, -50, 0));
-	campos += (campos_t - campos) * 0.005;
+
+	// level of detail of each figure from its size on screen; the bvh uses it from the next update on
+	float viewHeight = offline.isEnabled() ? offline.getHeight() : ofGetHeight();
+	for (int i = 0; i < trackers.size(); i++)
+	{
+		trackers[i]->updateLod(trackers[i]->getScreenSize(cam, ofVec3f(-center.x, -100, -center.z), viewHeight));
+		bvh[i].setLevelOfDetail(trackers[i]->lod);
+	}
 }
 
 //--------------------------------------------------------------
 void testApp::draw(){
+	// the GPU is idle during update(); the frame's GPU time starts here
+	quality.beginFrameDraw();
+	if (offline.isEnabled()) {
+		if (offline.isDone()) {
+			offline.finish();
+			ofExit();
+			return;
+		}
+		if (bloomMode) {
+			drawBloom();
+			offline.begin();
+			bloom.draw(0, 0, offline.getWidth(), offline.getHeight());
+			offline.end();
+		}
+		else {
+			offline.begin();
+			ofClear(10, 255);
+			drawScene();
+			offline.end();
+		}
+		// preview of the frame that was just rendered
+		ofSetColor(255);
+		ofDisableBlendMode();
+		offline.draw(0, 0, ofGetWidth(), ofGetHeight());
+		quality.endFrame();
+		return;
+	}
+
+	// the GPU time of everything drawn for the frame picks the resolution of the next ones
+	resolution.begin();
+
+	if (bloomMode) {
+		drawBloom();
+		bloom.draw(0, 0, ofGetWidth(), ofGetHeight());
+	}
+	else drawScene();
+	resolution.end();
+	quality.endFrame();
+	recorder.capture(ofGetElapsedTimef());
+
+	// after the capture, so recordings don't show it
+	if (showStats)
+		drawStats(bvh, resolution, quality);
+}
+
+//--------------------------------------------------------------
+// (re)allocates the buffers the scene is drawn through, at the size of the render target and with the samples the
+// antialiasing mode needs
+void testApp::setupBuffers(){
+	// offline renders always use their full size
+	float scale = offline.isEnabled() ? 1 : resolution.getScale();
+	int width = (offline.isEnabled() ? offline.getWidth() : ofGetWidth()) * scale;
+	int height = (offline.isEnabled() ? offline.getHeight() : ofGetHeight()) * scale;
+	if (!bloom.setup(width, height, antialiasing.getNumSamples()))
+		bloomMode = false;
+}
+
+//--------------------------------------------------------------
+// draw the scene into the bloom buffers and run the glow passes; bloom.draw() then composites it into the target
+void testApp::drawBloom(){
+	bloom.begin();
+	ofClear(10, 255);
+	drawScene();
+	bloom.end();
+}
+
+//--------------------------------------------------------------
+void testApp::drawScene(){
 	glDisable(GL_DEPTH_TEST);
 	glShadeModel(GL_SMOOTH);
-	
-	ofEnableSmoothing();
-	
-	glEnable(GL_LINE_SMOOTH);
-	glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
 	glLineWidth(1);
-
-	// smooth particle
-	glEnable(GL_POINT_SMOOTH);
-	glHint(GL_POINT_SMOOTH_HINT, GL_NICEST);
 	
 	ofEnableBlendMode(OF_BLENDMODE_ADD);
 
@@ -678,11 +1507,17 @@ void testApp::draw(){
 	light.setPosition(0, -500, 0);
 	
 	cam.begin();
+
+	// the same transform as the one applied below, followed by the camera's
+	frustum.setup(ofMatrix4x4::newTranslationMatrix(ofVec3f(-center.x, -100, -center.z)) * cam.getModelViewProjectionMatrix());
+	
+	// lines and points are antialiased as chosen with 'a' or --antialiasing
+	antialiasing.begin();
 	
 	ofPushMatrix();
 	{
 		// continuously rotates the camera 
-		// glRotatef(ofGetElapsedTimef() * 20, 0, 1, 0);
+		// glRotatef(elapsedTime * 20, 0, 1, 0);
 		glTranslatef(-center.x, -100, -center.z);
 		
 		ofSetColor(50);
@@ -701,10 +1536,32 @@ void testApp::draw(){
 		}*/
 		
 		ofSetColor(ofColor::white, 80);
+		// one pass for each kind of effect, so the governor can time them separately
+		quality.beginDraw(PARTICLES);
+		for (int i = 0; i < trackers.size(); i++)
+		{
+			trackers[i]->drawParticles(simClock.getAlpha());
+		}
+		quality.endDraw(PARTICLES);
 		for (int i = 0; i < trackers.size(); i++)
 		{
 			trackers[i]->draw();
 		}
+		quality.beginDraw(BOLTS);
+		for (int i = 0; i < trackers.size(); i++)
+		{
+			trackers[i]->drawBolts();
+		}
+		quality.endDraw(BOLTS);
+
+		if (crowdMode) {
+			quality.beginDraw(CROWD);
+			crowd.draw();
+			quality.endDraw(CROWD);
+		}
+		antialiasing.end();
+
+		drawFloor();
 	}
 	ofPopMatrix();
 	
@@ -714,8 +1571,69 @@ void testApp::draw(){
 	
 }
 
+//--------------------------------------------------------------
+void testApp::exit(){
+	recorder.stop();
+	offline.finish();
+	
+	for (int i = 0; i < streams.size(); i++)
+		delete streams[i];
+	streams.clear();
+
+	crowd.clear();
+}
+
 //--------------------------------------------------------------
 void testApp::keyPressed(int key){
+	// record the window to a video file in the data folder
+	if (key == 'r') {
+		if (recorder.isCapturing()) {
+			recorder.stop();
+			if (recorder.getNumDropped() > 0)
+				ofLogWarning("testApp", "recording dropped " + ofToString(recorder.getNumDropped()) + " frames");
+		}
+		else {
+			string path = ofToDataPath("recording-" + ofToString(ofGetUnixTime()) + ".mp4", true);
+			// the frames repeated or left out as the frame rate varies, so the video plays at 60 frames per second
+			recorder.start(ofGetWidth(), ofGetHeight(), new EncoderSink(path, 60), 60);
+		}
+		return;
+	}
+
+	if (key == 'c') {
+		crowdMode = !crowdMode;
+		return;
+	}
+
+	if (key == 's') {
+		showStats = !showStats;
+		return;
+	}
+
+	if (key == 'a') {
+		antialiasing.nextMode();
+		setupBuffers();
+		ofLogNotice("testApp", "antialiasing: " + antialiasing.getModeName());
+		return;
+	}
+
+	if (key == 'd') {
+		resolution.setEnabled(!resolution.isEnabled());
+		setupBuffers();
+		return;
+	}
+
+	if (key == 'g') {
+		quality.setEnabled(!quality.isEnabled());
+		ofLogNotice("testApp", string("quality governor ") + (quality.isEnabled() ? "on" : "off"));
+		return;
+	}
+
+	if (key == 'b') {
+		bloomMode = !bloomMode && bloom.isAllocated();
+		return;
+	}
+
 	campos_t.x = ofRandom(-600, 600);
 	campos_t.z = ofRandom(-600, 600);
 	campos_t.y = ofRandom(-100, 200);
@@ -747,6 +1665,8 @@ void testApp::mouseReleased(int x, int y, int button){
 
 //--------------------------------------------------------------
 void testApp::windowResized(int w, int h){
+	if (!offline.isEnabled())
+		setupBuffers();
 }
 
 //--------------------------------------------------------------
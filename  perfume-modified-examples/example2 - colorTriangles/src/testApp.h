@@ -2,13 +2,25 @@
 
 #include "ofMain.h"
 #include "ofxBvh.h"
+#include "ofxBvhStream.h"
+#include "OfflineRenderer.h"
+#include "Bloom.h"
+#include "Antialiasing.h"
+#include "DynamicResolution.h"
+#include "QualityGovernor.h"
 
 class testApp : public ofBaseApp{
 
   public:
+	testApp() : stressParticles(0) {}
+
 	void setup();
 	void update();
 	void draw();
+	void drawScene();
+	void drawBloom();
+	void setupBuffers();
+	void exit();
 
 	void keyPressed  (int key);
 	void keyReleased(int key);
@@ -21,8 +33,28 @@ class testApp : public ofBaseApp{
 	void gotMessage(ofMessage msg);
 	
 	ofSoundPlayer track;
+	ofxBvhAudioClock audioClock;
 	vector<ofxBvh> bvh;
 	
+	// --stream <address> on the command line, one per figure; see ofxBvhStream.h
+	vector<string> streamAddresses;
+	vector<ofxBvhStream*> streams;
+	
 	ofCamera cam;
 	ofLight light;
+	
+	OfflineRenderer offline;
+	// glow pass the scene is drawn through; see Bloom.h
+	Bloom bloom;
+	// how lines and points are antialiased; see Antialiasing.h
+	Antialiasing antialiasing;
+	// fraction of the window the offscreen buffers are drawn at, picked from the GPU time; see DynamicResolution.h
+	DynamicResolution resolution;
+	// scales the density of the effects to hold the frame time; see QualityGovernor.h
+	QualityGovernor quality;
+	FrameCapture recorder;
+	
+	// --stress-particles [count] on the command line: keeps this many particles, 50000 if no count is given, and logs
+	// the time spent colliding them; 0 to leave the number to the governor
+	int stressParticles;
 };
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "ofMain.h"
+
+// Screen-space glow.  The scene is drawn once into a floating point buffer, where additive blending can go past
+// white, and the glow comes from a fixed-cost post pass: the bright parts are downsampled into a chain of half
+// resolution buffers, each level is blurred with a separable gaussian, and the levels are added back up and
+// composited over the scene with a tone curve that rolls the overbright values off to white.
+//
+//   bloom.setup(ofGetWidth(), ofGetHeight());
+//   ...
+//   bloom.begin();
+//   ofClear(10, 255);
+//   drawScene();
+//   bloom.end();
+//   bloom.draw(0, 0, ofGetWidth(), ofGetHeight());
+//
+// Between begin() and end() vertex colors are not clamped, so glColor4f() with components above 1 draws overbright
+// primitives; ofSetColor() works as usual.
+class Bloom
+{
+public:
+
+	Bloom() : width(0), height(0), samples(0), threshold(0.1), knee(0.05), strength(0.8), exposure(1) {}
+
+	// allocates the buffers and compiles the shaders; needs a GL context.  Calling it again with the same size does nothing.
+	// The scene buffer is multisampled with numSamples > 0.  Returns false if the shaders could not be compiled, in which
+	// case the scene should be drawn without it.
+	bool setup(int width, int height, int numSamples = 0);
+	bool isAllocated() const { return width > 0; }
+
+	// draw the scene between begin() and end()
+	void begin();
+	void end();
+
+	// composites the scene and its glow into the current target
+	void draw(float x, float y, float w, float h);
+
+	// brightness at which pixels start to glow, and the range over which the glow fades in below it
+	void setThreshold(float threshold, float knee = 0.05) { this->threshold = threshold; this->knee = knee; }
+	// how much of the glow is added to the scene
+	void setStrength(float strength) { this->strength = strength; }
+	// scale applied before the tone curve; higher values saturate sooner
+	void setExposure(float exposure) { this->exposure = exposure; }
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+
+protected:
+
+	// each level is half the size of the one above it; the first one is half the size of the scene
+	static const int NUM_LEVELS = 5;
+
+	int width, height;
+	int samples;
+	float threshold, knee;
+	float strength;
+	float exposure;
+
+	ofFbo scene;
+	// the glow at each level, and a second buffer per level for the horizontal pass of the blur
+	ofFbo levels[NUM_LEVELS];
+	ofFbo temp[NUM_LEVELS];
+
+	ofShader downsampleShader;
+	ofShader blurShader;
+	ofShader compositeShader;
+
+	bool loadShader(ofShader& shader, const char *fragment);
+	void downsample(ofFbo& source, ofFbo& target, float threshold, float knee);
+	void blur(int level);
+};
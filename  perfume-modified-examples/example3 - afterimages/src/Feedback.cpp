@@ -0,0 +1,132 @@
+#include "Feedback.h"
+
+static const char *vertexSource =
+	"#version 120\n"
+	"void main() {\n"
+	"	gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+	"	gl_Position = ftransform();\n"
+	"}\n";
+
+// a long stall adds the frame after it at most this many times over
+static const float MAX_WEIGHT = 4;
+
+// reads the previous image from where the flow came from, so it moves along the flow, and fades it; texture
+// coordinates are in pixels, as the buffers use rectangle textures.  Added to the new frame, so it leaves alpha alone
+static const char *decaySource =
+	"#version 120\n"
+	"#extension GL_ARB_texture_rectangle : enable\n"
+	"uniform sampler2DRect tex0;\n"
+	"uniform sampler2DRect flow;\n"
+	"uniform vec2 flowScale;\n"
+	"uniform float flowAmount;\n"
+	"uniform vec2 drift;\n"
+	"uniform float decay;\n"
+	"void main() {\n"
+	"	vec2 p = gl_TexCoord[0].st;\n"
+	"	vec2 d = drift + texture2DRect(flow, p * flowScale).rg * flowAmount;\n"
+	"	gl_FragColor = vec4(texture2DRect(tex0, p - d).rgb * decay, 0.0);\n"
+	"}\n";
+
+bool Feedback::setup(int width, int height, int numSamples)
+{
+	if (width == this->width && height == this->height && numSamples == samples)
+		return true;
+
+	if (!decayShader.isLoaded())
+	{
+		if (!decayShader.setupShaderFromSource(GL_VERTEX_SHADER, vertexSource)
+			|| !decayShader.setupShaderFromSource(GL_FRAGMENT_SHADER, decaySource)
+			|| !decayShader.linkProgram())
+		{
+			ofLogError("Feedback", "could not compile the shader");
+			this->width = this->height = 0;
+			return false;
+		}
+	}
+
+	this->width = width;
+	this->height = height;
+	samples = numSamples;
+
+	// half floats, so faint trails keep fading smoothly instead of getting stuck at the lowest 8 bit step
+	ofFbo::Settings settings;
+	settings.width = width;
+	settings.height = height;
+	settings.internalformat = GL_RGBA16F_ARB;
+	settings.numSamples = numSamples;
+	settings.useDepth = false;
+	settings.useStencil = false;
+
+	for (int i = 0; i < 2; i++)
+		buffers[i].allocate(settings);
+
+	clear();
+
+	return true;
+}
+
+void Feedback::clear()
+{
+	for (int i = 0; i < 2; i++)
+	{
+		buffers[i].begin();
+		ofClear(0, 255);
+		buffers[i].end();
+	}
+}
+
+void Feedback::begin(float elapsed)
+{
+	this->elapsed = elapsed;
+	current = 1 - current;
+
+	buffers[current].begin();
+	ofClear(0, 255);
+
+	// the new frame may be brighter than white where it overlaps itself
+	glClampColorARB(GL_CLAMP_VERTEX_COLOR_ARB, GL_FALSE);
+	glClampColorARB(GL_CLAMP_FRAGMENT_COLOR_ARB, GL_FALSE);
+}
+
+void Feedback::end()
+{
+	ofFbo &previous = buffers[1 - current];
+
+	ofPushStyle();
+	ofFill();
+
+	// scale the new frame by the time it stands for; the color is not clamped, so the weight can be above 1
+	float weight = MIN(elapsed * referenceRate, MAX_WEIGHT);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ZERO, GL_SRC_COLOR);
+	glColor4f(weight, weight, weight, 1);
+	ofRect(0, 0, width, height);
+
+	// and add the previous image, faded and moved along
+	glBlendFunc(GL_ONE, GL_ONE);
+	glColor4f(1, 1, 1, 1);
+	decayShader.begin();
+	decayShader.setUniform1f("decay", halfLife > 0 ? pow(0.5f, elapsed / halfLife) : 0);
+	decayShader.setUniform2f("drift", drift.x * elapsed, drift.y * elapsed);
+	if (flow != NULL)
+	{
+		decayShader.setUniformTexture("flow", *flow, 1);
+		decayShader.setUniform2f("flowScale", flow->getWidth() / width, flow->getHeight() / height);
+		decayShader.setUniform1f("flowAmount", flowAmount * elapsed);
+	}
+	else decayShader.setUniform1f("flowAmount", 0);
+	previous.draw(0, 0);
+	decayShader.end();
+
+	ofPopStyle();
+
+	glClampColorARB(GL_CLAMP_VERTEX_COLOR_ARB, GL_TRUE);
+	glClampColorARB(GL_CLAMP_FRAGMENT_COLOR_ARB, GL_FIXED_ONLY_ARB);
+
+	buffers[current].end();
+}
+
+void Feedback::draw(float x, float y, float w, float h)
+{
+	buffers[current].draw(x, y, w, h);
+}
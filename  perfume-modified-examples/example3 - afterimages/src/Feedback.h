@@ -0,0 +1,73 @@
+#pragma once
+
+#include "ofMain.h"
+
+// Screen-space trails.  Two floating point buffers take turns: every frame the new frame is drawn into one of them,
+// and the previous image is added from the other, faded and optionally pushed along a flow texture.  The cost is a
+// couple of full-screen passes however long the trails are and however many figures leave them.
+//
+// The new frame counts by the time it stands for: at the reference rate with its full brightness, at half the rate
+// with twice of it.  As the fading is per second too, trails are as long and as bright at any frame rate; only the
+// newest frame itself is brighter or fainter.
+//
+//   trails.setup(ofGetWidth(), ofGetHeight());
+//   ...
+//   trails.begin(ofGetLastFrameTime());
+//   drawScene();                            // no clear; additive blending
+//   trails.end();
+//   trails.draw(0, 0, ofGetWidth(), ofGetHeight());
+//
+// The buffers start out black, so the background should be cleared in the target and the trails drawn over it
+// additively.
+class Feedback
+{
+public:
+
+	Feedback() : width(0), height(0), samples(0), current(0), elapsed(0), referenceRate(60), halfLife(0.25), flow(NULL), flowAmount(0) {}
+
+	// allocates the buffers and compiles the shader; needs a GL context.  Calling it again with the same size does nothing.
+	// The buffers are multisampled with numSamples > 0.  Returns false if the shader could not be compiled.
+	bool setup(int width, int height, int numSamples = 0);
+	bool isAllocated() const { return width > 0; }
+
+	// erases the trails
+	void clear();
+
+	// draw the new frame between begin() and end(), which adds the previous image faded by the seconds since the last
+	// frame
+	void begin(float elapsed);
+	void end();
+
+	void draw(float x, float y, float w, float h);
+
+	// frames per second at which a frame is added with its own brightness
+	void setReferenceRate(float fps) { referenceRate = fps; }
+	// seconds until the trails have faded to half their brightness
+	void setHalfLife(float halfLife) { this->halfLife = halfLife; }
+	// constant motion of the trails, in pixels per second
+	void setDrift(ofVec2f drift) { this->drift = drift; }
+	// motion that varies over the screen: the red and green channels of the texture, stretched over the buffer, are
+	// multiplied by amount to give pixels per second.  Pass NULL to turn it off; the texture is not copied.
+	void setFlow(ofTexture *flow, float amount) { this->flow = flow; flowAmount = amount; }
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+
+protected:
+
+	int width, height;
+	int samples;
+	ofFbo buffers[2];
+	// the buffer the last frame was drawn into
+	int current;
+	// seconds since the previous frame, from begin()
+	float elapsed;
+	float referenceRate;
+
+	float halfLife;
+	ofVec2f drift;
+	ofTexture *flow;
+	float flowAmount;
+
+	ofShader decayShader;
+};
@@ -0,0 +1,147 @@
+#include "FlowField.h"
+
+// step of the central differences the curl is taken with, in noise units
+static const float DERIVATIVE_STEP = 0.01;
+
+// one component of the vector potential the velocities are the curl of
+static float potential(int component, float seed, float x, float y, float z, float w)
+{
+	return ofSignedNoise(x + seed + component * 31.4, y, z, w + component * 17.3);
+}
+
+void FlowField::setup(const ofVec3f &min, const ofVec3f &max, int nx, int ny, int nz)
+{
+	this->min = min;
+	this->max = max;
+	this->nx = MAX(nx, 2);
+	this->ny = MAX(ny, 2);
+	this->nz = MAX(nz, 2);
+
+	int size = this->nx * this->ny * this->nz;
+	for (int i = 0; i < 3; i++)
+		keys[i].assign(size, ofVec3f());
+	current.assign(size, ofVec3f());
+	from = 0;
+	to = 1;
+	next = 2;
+	started = false;
+}
+
+void FlowField::update(float time)
+{
+	if (current.empty())
+		return;
+
+	if (!started || time < keyTime || time >= keyTime + 2 * period)
+	{
+		// start over from the key before the current time
+		keyTime = floor(time / period) * period;
+		computeKey(keys[from], keyTime);
+		computeKey(keys[to], keyTime + period);
+		slice = 0;
+		started = true;
+	}
+	else if (time >= keyTime + period)
+	{
+		// the key being computed is the next one to blend to; finish it if the period went by in fewer updates than
+		// it has slices
+		while (slice < nz)
+			computeNextSlice();
+		int spare = from;
+		from = to;
+		to = next;
+		next = spare;
+		keyTime += period;
+		slice = 0;
+	}
+
+	if (slice < nz)
+		computeNextSlice();
+
+	float t = (time - keyTime) / period;
+	const vector<ofVec3f> &a = keys[from], &b = keys[to];
+	for (int i = 0; i < current.size(); i++)
+		current[i] = a[i] + (b[i] - a[i]) * t;
+}
+
+ofVec3f FlowField::sample(const ofVec3f &position) const
+{
+	if (current.empty())
+		return ofVec3f();
+
+	// grid coordinates, clamped to the edges
+	float gx = ofClamp((position.x - min.x) / (max.x - min.x), 0, 1) * (nx - 1);
+	float gy = ofClamp((position.y - min.y) / (max.y - min.y), 0, 1) * (ny - 1);
+	float gz = ofClamp((position.z - min.z) / (max.z - min.z), 0, 1) * (nz - 1);
+	int x = MIN((int)gx, nx - 2);
+	int y = MIN((int)gy, ny - 2);
+	int z = MIN((int)gz, nz - 2);
+	float fx = gx - x, fy = gy - y, fz = gz - z;
+
+	const ofVec3f *c = &current[(z * ny + y) * nx + x];
+	int dy = nx, dz = nx * ny;
+	ofVec3f c00 = c[0] + (c[1] - c[0]) * fx;
+	ofVec3f c10 = c[dy] + (c[dy + 1] - c[dy]) * fx;
+	ofVec3f c01 = c[dz] + (c[dz + 1] - c[dz]) * fx;
+	ofVec3f c11 = c[dz + dy] + (c[dz + dy + 1] - c[dz + dy]) * fx;
+	ofVec3f c0 = c00 + (c10 - c00) * fy;
+	ofVec3f c1 = c01 + (c11 - c01) * fy;
+	return c0 + (c1 - c0) * fz;
+}
+
+void FlowField::computeSlice(vector<ofVec3f> &key, int z, float time)
+{
+	// noise units per scene unit, the same along every axis so the swirls stay round
+	float extent = MAX(max.x - min.x, MAX(max.y - min.y, max.z - min.z));
+	float frequency = extent > 0 ? scale / extent : 0;
+	float w = time / period * 0.5;
+	float h = DERIVATIVE_STEP;
+
+	float pz = (min.z + (max.z - min.z) * z / (nz - 1)) * frequency;
+	for (int y = 0; y < ny; y++)
+	{
+		float py = (min.y + (max.y - min.y) * y / (ny - 1)) * frequency;
+		for (int x = 0; x < nx; x++)
+		{
+			float px = (min.x + (max.x - min.x) * x / (nx - 1)) * frequency;
+
+			// partial derivatives of the potential's components, named by component and axis
+			float zy = potential(2, seed, px, py + h, pz, w) - potential(2, seed, px, py - h, pz, w);
+			float yz = potential(1, seed, px, py, pz + h, w) - potential(1, seed, px, py, pz - h, w);
+			float xz = potential(0, seed, px, py, pz + h, w) - potential(0, seed, px, py, pz - h, w);
+			float zx = potential(2, seed, px + h, py, pz, w) - potential(2, seed, px - h, py, pz, w);
+			float yx = potential(1, seed, px + h, py, pz, w) - potential(1, seed, px - h, py, pz, w);
+			float xy = potential(0, seed, px, py + h, pz, w) - potential(0, seed, px, py - h, pz, w);
+
+			key[(z * ny + y) * nx + x].set(zy - yz, xz - zx, yx - xy);
+		}
+	}
+}
+
+void FlowField::normalize(vector<ofVec3f> &key)
+{
+	float sum = 0;
+	for (int i = 0; i < key.size(); i++)
+		sum += key[i].lengthSquared();
+	float rms = sqrt(sum / key.size());
+	if (rms > 0)
+	{
+		for (int i = 0; i < key.size(); i++)
+			key[i] /= rms;
+	}
+}
+
+void FlowField::computeKey(vector<ofVec3f> &key, float time)
+{
+	for (int z = 0; z < nz; z++)
+		computeSlice(key, z, time);
+	normalize(key);
+}
+
+void FlowField::computeNextSlice()
+{
+	computeSlice(keys[next], slice, keyTime + 2 * period);
+	slice++;
+	if (slice == nz)
+		normalize(keys[next]);
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "ofMain.h"
+
+// Destination for captured frames.  write() is called on the capture thread, one frame at a time and in order.
+// Pixels are RGBA, bottom row first, as read from OpenGL.
+class FrameSink
+{
+public:
+	virtual ~FrameSink() {}
+
+	virtual bool open(int /*width*/, int /*height*/) { return true; }
+	virtual void write(const unsigned char *pixels, int width, int height, int frame) = 0;
+	virtual void close() {}
+};
+
+// Streams raw frames into the standard input of an encoder process (ffmpeg by default).
+class EncoderSink : public FrameSink
+{
+public:
+	EncoderSink(string path, float fps, string command = "") : path(path), fps(fps), command(command), pipe(NULL) {}
+
+	bool open(int width, int height);
+	void write(const unsigned char *pixels, int width, int height, int frame);
+	void close();
+
+protected:
+	string path;
+	float fps;
+	string command;
+	FILE *pipe;
+};
+
+// Saves every frame as a numbered image file, e.g. "capture/frame_%05d.png".
+class ImageSequenceSink : public FrameSink
+{
+public:
+	ImageSequenceSink(string pattern) : pattern(pattern) {}
+
+	void write(const unsigned char *pixels, int width, int height, int frame);
+
+protected:
+	string pattern;
+	ofPixels image;
+};
+
+// Reads frames back from the GPU without stalling it.  capture() queues an asynchronous read of the current
+// framebuffer into one of a ring of pixel buffer objects, and copies out the frame that was queued numBuffers - 1
+// frames earlier, which the GPU has finished with by then.  The copies are handed to a worker thread that feeds them
+// to the sink, so neither the readback nor the encoding holds up drawing.
+//
+// Live frames come at whatever rate the app manages, while a video plays at a fixed one.  Started with a frame rate,
+// the capture takes the time of every frame and lets it fill the output frames up to that time: a slow frame is
+// written several times over, and a frame that falls within the output frame the last one filled is not read at all.
+// A frame the sink had no room for is filled in by the next one, so the video keeps time either way.
+class FrameCapture : public ofThread
+{
+public:
+
+	FrameCapture(int numBuffers = 3);
+	virtual ~FrameCapture();
+
+	// the capture takes ownership of the sink.  With fps above 0 the output has that constant rate, by the times passed
+	// to capture(); otherwise every captured frame is one frame of the output
+	bool start(int width, int height, FrameSink *sink, float fps = 0);
+	void stop();
+	bool isCapturing() const { return sink != NULL; }
+
+	// read the framebuffer that is currently bound (the window or an ofFbo between begin() and end()); time is when
+	// the frame is shown, in seconds, for captures at a constant rate
+	void capture(float time = 0);
+
+	// when blocking, capture() waits for the sink instead of dropping frames; use it for offline rendering
+	void setBlocking(bool blocking) { this->blocking = blocking; }
+
+	int getNumCaptured() const { return captured; }
+	// frames the sink had no room for, each written as the next captured one instead
+	int getNumDropped() const { return dropped; }
+
+protected:
+
+	int numBuffers;
+	int width, height;
+	bool blocking;
+	float fps;
+	float startTime;
+
+	FrameSink *sink;
+
+	vector<GLuint> pbos;
+	int queued;
+	int captured, dropped;
+	// output frames handed out so far, and the first output frame and the number of them each buffer in the ring
+	// fills; a dropped frame's output frames are carried over to the next one read
+	int scheduled;
+	vector<int> firstFrames, frameCounts;
+	int carriedFirst, carriedCount;
+
+	// frames travel from the free list to the pending queue and back; both are guarded by the thread's lock
+	struct Image
+	{
+		vector<unsigned char> pixels;
+		// written as output frames frame to frame + count - 1
+		int frame, count;
+	};
+	vector<Image*> images;
+	deque<Image*> freeImages;
+	deque<Image*> pendingImages;
+
+	void readBuffer(int index);
+	void threadedFunction();
+};
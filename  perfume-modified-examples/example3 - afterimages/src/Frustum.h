@@ -0,0 +1,47 @@
+#pragma once
+
+#include "ofMain.h"
+
+// The six planes of a camera's view volume, for skipping objects that are entirely off screen before they are drawn.
+// Objects are tested as bounding spheres, which is cheap enough to do for every particle.
+class Frustum
+{
+public:
+
+	// m takes points to clip space, like ofCamera::getModelViewProjectionMatrix(); multiply any transform applied to
+	// the objects in front of it, e.g. ofMatrix4x4::newTranslationMatrix(t) * cam.getModelViewProjectionMatrix()
+	void setup(const ofMatrix4x4& m)
+	{
+		// each plane is a sum or difference of the w column and one of the x, y or z columns
+		for (int i = 0; i < 3; i++)
+		{
+			planes[i * 2].set(m(0, 3) + m(0, i), m(1, 3) + m(1, i), m(2, 3) + m(2, i), m(3, 3) + m(3, i));
+			planes[i * 2 + 1].set(m(0, 3) - m(0, i), m(1, 3) - m(1, i), m(2, 3) - m(2, i), m(3, 3) - m(3, i));
+		}
+
+		// scaled to unit normals, so the plane equation gives the distance
+		for (int i = 0; i < 6; i++)
+		{
+			float length = ofVec3f(planes[i].x, planes[i].y, planes[i].z).length();
+			if (length > 0)
+				planes[i] /= length;
+		}
+	}
+
+	// true if the sphere is at least partly inside
+	bool intersects(const ofVec3f& center, float radius) const
+	{
+		for (int i = 0; i < 6; i++)
+		{
+			const ofVec4f &p = planes[i];
+			if (p.x * center.x + p.y * center.y + p.z * center.z + p.w < -radius)
+				return false;
+		}
+
+		return true;
+	}
+
+protected:
+
+	ofVec4f planes[6];
+};
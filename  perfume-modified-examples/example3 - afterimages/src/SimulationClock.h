@@ -0,0 +1,69 @@
+#pragma once
+
+#include "ofMain.h"
+
+// Fixed timestep clock for the visual effects.  Each update the clock is advanced to the current scene time and
+// reports how many steps of a fixed length have to be simulated to catch up with it, so particles, bolts and trails
+// evolve the same way whether the scene is drawn at 30 or 120 frames per second.  The time left over after the last
+// step is available as getAlpha(), for drawing the state in between two steps.
+class SimulationClock
+{
+public:
+
+	SimulationClock(float stepsPerSecond = 60, int maxSteps = 8) { setup(stepsPerSecond, maxSteps); }
+
+	// maxSteps limits how many steps are simulated in a single update; after a long stall (loading, a breakpoint)
+	// the simulation skips ahead instead of spending the following frames catching up
+	void setup(float stepsPerSecond, int maxSteps = 8)
+	{
+		stepTime = 1.0f / stepsPerSecond;
+		this->maxSteps = maxSteps;
+		started = false;
+		accumulator = 0;
+		stepCount = 0;
+	}
+
+	// returns the number of steps to simulate to reach the given time, in seconds
+	int advance(float time)
+	{
+		if (!started)
+		{
+			started = true;
+			lastTime = time;
+		}
+
+		accumulator += time - lastTime;
+		lastTime = time;
+
+		// the time source jumped backwards
+		if (accumulator < 0)
+			accumulator = 0;
+
+		int steps = (int)(accumulator / stepTime);
+		accumulator -= steps * stepTime;
+
+		if (steps > maxSteps)
+			steps = maxSteps;
+
+		stepCount += steps;
+		return steps;
+	}
+
+	float getStepTime() const { return stepTime; }
+
+	// position of the current time between the last simulated step and the next one, in [0, 1)
+	float getAlpha() const { return accumulator / stepTime; }
+
+	// number of steps simulated since setup()
+	int getStepCount() const { return stepCount; }
+
+protected:
+
+	float stepTime;
+	int maxSteps;
+
+	bool started;
+	float lastTime;
+	float accumulator;
+	int stepCount;
+};
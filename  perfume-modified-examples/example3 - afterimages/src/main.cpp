@@ -3,17 +3,33 @@
 #include "ofAppGlutWindow.h"
 
 //========================================================================
-int main( ){
+int main(int argc, char *argv[]){
 
     ofAppGlutWindow window;
+	testApp *app = new testApp();
+	// --render <file> renders the scene offline to a video file instead of playing it; see OfflineRenderer.h
+	bool offline = app->offline.setup(argc, argv);
+	// --antialiasing smooth|msaa|shader and --aa-benchmark <frames>; see Antialiasing.h
+	app->antialiasing.setup(argc, argv);
+	// --gpu-budget <milliseconds>; see DynamicResolution.h
+	app->resolution.setup(argc, argv);
+	// --frame-budget <milliseconds>; see QualityGovernor.h
+	app->quality.setup(argc, argv);
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		if (string(argv[i]) == "--stream")
+			app->streamAddresses.push_back(argv[++i]);
+	}
+
 	//window.setGlutDisplayString("rgba double samples>=4 depth");
 	ofSetupOpenGL(&window, 1280, 720, OF_WINDOW);			// <-------- setup the GL context
 	ofSetWindowPosition(90, 90);
-	ofToggleFullscreen();
+	if (!offline)
+		ofToggleFullscreen();
 
 	// this kicks off the running of my app
 	// can be OF_WINDOW or OF_FULLSCREEN
 	// pass in width and height too:
-	ofRunApp( new testApp());
+	ofRunApp(app);
 
 }
@@ -1,7 +1,5 @@
 #include "ofxBvh.h"
 
-static inline void billboard();
-
 ofxBvh::~ofxBvh()
 {
 	unload();
@@ -26,10 +24,15 @@ void ofxBvh::load(string path)
 	parseHierarchy(data.substr(HIERARCHY_BEGIN, MOTION_BEGIN));
 	parseMotion(data.substr(MOTION_BEGIN));
 	
-	currentFrame = frames[0];
+	if (motion.empty())
+	{
+		ofLogError("ofxBvh", "no frames in " + path);
+		return;
+	}
 	
-	int index = 0;
-	updateJoint(index, currentFrame, root);
+	current_frame = 0;
+	decodeFrame(current_frame, current_pose);
+	updateJoints(current_pose);
 	
 	frame_new = false;
 }
@@ -40,14 +43,18 @@ void ofxBvh::unload()
 		delete joints[i];
 	
 	joints.clear();
+	jointMap.clear();
 	
 	root = NULL;
 	
-	frames.clear();
-	currentFrame.clear();
+	motion.clear();
+	current_frame = 0;
+	
+	renderer.clear();
 	
 	num_frames = 0;
 	frame_time = 0;
+	source_frame_time = 0;
 	
 	rate = 1;
 	play_head = 0;
@@ -55,6 +62,49 @@ void ofxBvh::unload()
 	loop = false;
 	
 	need_update = false;
+	
+	live = false;
+	live_frame.clear();
+}
+
+bool ofxBvh::loadHierarchy(const string& data)
+{
+	unload();
+	
+	const size_t HIERARCHY_BEGIN = data.find("HIERARCHY", 0);
+	
+	if (HIERARCHY_BEGIN == string::npos)
+	{
+		ofLogError("ofxBvh", "invalid bvh format");
+		return false;
+	}
+	
+	parseHierarchy(data.substr(HIERARCHY_BEGIN));
+	
+	if (!root)
+	{
+		ofLogError("ofxBvh", "invalid bvh format");
+		return false;
+	}
+	
+	live = true;
+	
+	// the rest pose until the first frame arrives
+	FrameData zeros(total_channels, 0);
+	readPose(zeros.empty() ? NULL : &zeros[0], live_frame);
+	updateJoints(live_frame);
+	
+	frame_new = false;
+	return true;
+}
+
+void ofxBvh::setFrameData(const float *channels, int num_channels)
+{
+	if (!live || num_channels != total_channels)
+		return;
+	
+	readPose(channels, live_frame);
+	need_update = true;
 }
 
 void ofxBvh::play()
@@ -84,47 +134,176 @@ void ofxBvh::setRate(float rate)
 	this->rate = rate;
 }
 
-void ofxBvh::updateJoint(int& index, const FrameData& frame_data, ofxBvhJoint *joint)
+void ofxBvh::resample(float fps)
 {
-	ofVec3f translate;
-	ofQuaternion rotate;
+	if (motion.getNumFrames() < 2 || fps <= 0) return;
 	
-	for (int i = 0; i < joint->channel_type.size(); i++)
+	vector<Pose> frames;
+	motion.decompress(frames);
+	
+	const float target_frame_time = 1.0f / fps;
+	const int last = frames.size() - 1;
+	const int count = floor(last * frame_time / target_frame_time) + 1;
+	
+	// when reducing the rate, each new frame averages the frames it spans instead of picking one of them
+	const float radius = target_frame_time > frame_time ? target_frame_time * 0.5f / frame_time : 0;
+	
+	vector<Pose> resampled(count);
+	
+	for (int i = 0; i < count; i++)
 	{
-		float v = frame_data[index++];
-		ofxBvhJoint::CHANNEL t = joint->channel_type[i];
+		const float position = i * target_frame_time / frame_time;
+		Pose &pose = resampled[i];
+		pose.resize(joints.size());
 		
-		if (t == ofxBvhJoint::X_POSITION)
-			translate.x = v;
-		else if (t == ofxBvhJoint::Y_POSITION)
-			translate.y = v;
-		else if (t == ofxBvhJoint::Z_POSITION)
-			translate.z = v;
-		else if (t == ofxBvhJoint::X_ROTATION)
-			rotate = ofQuaternion(v, ofVec3f(1, 0, 0)) * rotate;
-		else if (t == ofxBvhJoint::Y_ROTATION)
-			rotate = ofQuaternion(v, ofVec3f(0, 1, 0)) * rotate;
-		else if (t == ofxBvhJoint::Z_ROTATION)
-			rotate = ofQuaternion(v, ofVec3f(0, 0, 1)) * rotate;
+		if (radius > 0)
+		{
+			int first = MAX(0, (int)ceil(position - radius));
+			int end = MIN(last, (int)floor(position + radius));
+			
+			for (int j = 0; j < joints.size(); j++)
+			{
+				ofVec3f translate;
+				ofVec4f rotate;
+				const ofVec4f reference = frames[first][j].rotate.asVec4();
+				
+				for (int k = first; k <= end; k++)
+				{
+					translate += frames[k][j].translate;
+					
+					// q and -q are the same rotation; keep all of them on one side before summing
+					ofVec4f q = frames[k][j].rotate.asVec4();
+					if (q.dot(reference) < 0)
+						q *= -1;
+					rotate += q;
+				}
+				
+				rotate.normalize();
+				pose[j].translate = translate / (end - first + 1);
+				pose[j].rotate.set(rotate);
+			}
+		}
+		else
+		{
+			const int a = MIN((int)position, last - 1);
+			const float alpha = MIN(position - a, 1);
+			const Pose &from = frames[a];
+			const Pose &to = frames[a + 1];
+			
+			for (int j = 0; j < joints.size(); j++)
+			{
+				pose[j].translate = from[j].translate.getInterpolated(to[j].translate, alpha);
+				pose[j].rotate.slerp(alpha, from[j].rotate, to[j].rotate);
+			}
+		}
 	}
 	
-	translate += joint->initial_offset;
+	motion.compress(resampled, target_frame_time);
+	frame_time = target_frame_time;
+	num_frames = motion.getNumFrames();
 	
-	joint->matrix.makeIdentityMatrix();
-	joint->matrix.glTranslate(translate);
-	joint->matrix.glRotate(rotate);
+	// stay at the same time in the take
+	current_frame = -1;
+	seekFrame(floor(play_head / frame_time));
+}
+
+void ofxBvh::readPose(const float *channels, Pose& pose) const
+{
+	pose.resize(joints.size());
 	
-	joint->global_matrix = joint->matrix;
-	joint->offset = translate;
+	// joints are stored in the same depth first order as their channels
+	int index = 0;
 	
-	if (joint->parent)
+	for (int j = 0; j < joints.size(); j++)
 	{
-		joint->global_matrix.postMult(joint->parent->global_matrix);
+		const ofxBvhJoint *joint = joints[j];
+		ofVec3f translate;
+		ofQuaternion rotate;
+		
+		for (int i = 0; i < joint->channel_type.size(); i++)
+		{
+			float v = channels[index++];
+			ofxBvhJoint::CHANNEL t = joint->channel_type[i];
+			
+			if (t == ofxBvhJoint::X_POSITION)
+				translate.x = v;
+			else if (t == ofxBvhJoint::Y_POSITION)
+				translate.y = v;
+			else if (t == ofxBvhJoint::Z_POSITION)
+				translate.z = v;
+			else if (t == ofxBvhJoint::X_ROTATION)
+				rotate = ofQuaternion(v, ofVec3f(1, 0, 0)) * rotate;
+			else if (t == ofxBvhJoint::Y_ROTATION)
+				rotate = ofQuaternion(v, ofVec3f(0, 1, 0)) * rotate;
+			else if (t == ofxBvhJoint::Z_ROTATION)
+				rotate = ofQuaternion(v, ofVec3f(0, 0, 1)) * rotate;
+		}
+		
+		pose[j].translate = translate + joint->initial_offset;
+		pose[j].rotate = rotate;
 	}
+}
+
+void ofxBvh::decodeFrame(int index, Pose& pose) const
+{
+	pose.resize(joints.size());
 	
-	for (int i = 0; i < joint->children.size(); i++)
+	for (int i = 0; i < joints.size(); i++)
 	{
-		updateJoint(index, frame_data, joint->children[i]);
+		if (lod < joints[i]->skip_level)
+			motion.getJointPose(i, index, pose[i]);
+	}
+}
+
+void ofxBvh::getJointMatrix(const JointPose& pose, ofMatrix4x4& matrix)
+{
+	matrix.makeIdentityMatrix();
+	matrix.glTranslate(pose.translate);
+	matrix.glRotate(pose.rotate);
+}
+
+void ofxBvh::updateJoints(const Pose& pose)
+{
+	// parents always come before their children
+	for (int i = 0; i < joints.size(); i++)
+	{
+		ofxBvhJoint *joint = joints[i];
+		
+		if (lod < joint->skip_level)
+		{
+			getJointMatrix(pose[i], joint->matrix);
+			joint->offset = pose[i].translate;
+		}
+		else
+		{
+			joint->matrix.makeTranslationMatrix(joint->initial_offset);
+			joint->offset = joint->initial_offset;
+		}
+		
+		joint->global_matrix = joint->matrix;
+		if (joint->parent)
+			joint->global_matrix.postMult(joint->parent->global_matrix);
+	}
+}
+
+void ofxBvh::evaluateFrame(int index, vector<ofMatrix4x4>& global_matrices) const
+{
+	global_matrices.resize(joints.size());
+	if (motion.empty()) return;
+	
+	const int frame = ofClamp(index, 0, motion.getNumFrames() - 1);
+	JointPose pose;
+	
+	for (int i = 0; i < joints.size(); i++)
+	{
+		const ofxBvhJoint *joint = joints[i];
+		ofMatrix4x4 &m = global_matrices[i];
+		
+		motion.getJointPose(i, frame, pose);
+		getJointMatrix(pose, m);
+		
+		if (joint->parent)
+			m.postMult(global_matrices[joint->parent->index]);
 	}
 }
 
@@ -132,30 +311,29 @@ void ofxBvh::update()
 {
 	frame_new = false;
 	
-	if (playing && ofGetFrameNum() > 1)
+	if (playing && ofGetFrameNum() > 1 && !motion.empty())
 	{
-		int last_index = getFrame();
-		
 		play_head += ofGetLastFrameTime() * rate;
-		int index = getFrame();
 		
-		if (index != last_index)
+		// wrap or stop before the play head is turned into a frame index
+		const float duration = getDuration();
+		
+		if (play_head >= duration || play_head < 0)
 		{
-			need_update = true;
-			
-			currentFrame = frames[index];
-			
-			if (index >= frames.size())
+			if (loop)
 			{
-				if (loop)
-					play_head = 0;
-				else
-					playing = false;
+				play_head = fmod(play_head, duration);
+				if (play_head < 0)
+					play_head += duration;
+			}
+			else
+			{
+				play_head = ofClamp(play_head, 0, duration);
+				playing = false;
 			}
-			
-			if (play_head < 0)
-				play_head = 0;
 		}
+		
+		seekFrame(floor(play_head / frame_time));
 	}
 	
 	if (need_update)
@@ -163,49 +341,54 @@ void ofxBvh::update()
 		need_update = false;
 		frame_new = true;
 		
-		int index = 0;
-		updateJoint(index, currentFrame, root);
+		if (live)
+		{
+			updateJoints(live_frame);
+		}
+		else
+		{
+			decodeFrame(current_frame, current_pose);
+			updateJoints(current_pose);
+		}
 	}
 }
 
 void ofxBvh::draw()
 {
-	ofPushStyle();
-	ofFill();
+	// reads the modelview once per figure; use draw(modelview) or ofxBvhRenderer to avoid the readback entirely
+	GLfloat m[16];
+	glGetFloatv(GL_MODELVIEW_MATRIX, m);
+	
+	draw(ofMatrix4x4(m));
+}
+
+void ofxBvh::draw(const ofMatrix4x4& modelview)
+{
+	renderer.begin(modelview);
+	renderer.add(*this);
+	renderer.end();
+}
+
+void ofxBvh::setLevelOfDetail(int level)
+{
+	level = ofClamp(level, 0, NUM_LEVELS_OF_DETAIL - 1);
+	if (level == lod) return;
+	
+	lod = level;
+	need_update = true;
+}
+
+int ofxBvh::getNumEvaluatedJoints() const
+{
+	int count = 0;
 	
 	for (int i = 0; i < joints.size(); i++)
 	{
-		ofxBvhJoint *o = joints[i];
-		glPushMatrix();
-		glMultMatrixf(o->getGlobalMatrix().getPtr());
-		
-		if (o->isSite())
-		{
-			ofSetColor(ofColor::yellow);
-			billboard();
-			ofCircle(0, 0, 6);
-		}
-		else if (o->getChildren().size() == 1)
-		{
-			ofSetColor(ofColor::white);		
-			billboard();
-			ofCircle(0, 0, 2);
-		}
-		else if (o->getChildren().size() > 1)
-		{
-			if (o->isRoot())
-				ofSetColor(ofColor::cyan);
-			else
-				ofSetColor(ofColor::green);
-			
-			billboard();
-			ofCircle(0, 0, 4);
-		}
-		
-		glPopMatrix();
+		if (!joints[i]->channel_type.empty() && lod < joints[i]->skip_level)
+			count++;
 	}
 	
-	ofPopStyle();
+	return count;
 }
 
 bool ofxBvh::isFrameNew()
@@ -213,35 +396,61 @@ bool ofxBvh::isFrameNew()
 	return frame_new;
 }
 
+void ofxBvh::seekFrame(int index)
+{
+	if (motion.empty()) return;
+	
+	index = ofClamp(index, 0, motion.getNumFrames() - 1);
+	
+	// the pose is only recomputed in update() when the cursor actually moves
+	if (index != current_frame)
+	{
+		current_frame = index;
+		need_update = true;
+	}
+}
+
+void ofxBvh::setTime(float seconds)
+{
+	if (motion.empty()) return;
+	
+	play_head = ofClamp(seconds, 0, getDuration());
+	seekFrame(floor(play_head / frame_time));
+}
+
+float ofxBvh::getTime()
+{
+	return play_head;
+}
+
 void ofxBvh::setFrame(int index)
 {
-	if (ofInRange(index, 0, frames.size()) && getFrame() != index)
+	if (ofInRange(index, 0, motion.getNumFrames() - 1))
 	{
-		currentFrame = frames[index];
 		play_head = (float)index * frame_time;
-		
-		need_update = true;
+		seekFrame(index);
 	}
 }
 
 int ofxBvh::getFrame()
 {
-	return floor(play_head / frame_time);
+	return current_frame;
 }
 
 void ofxBvh::setPosition(float pos)
 {
-	setFrame((float)frames.size() * pos);
+	setTime(pos * getDuration());
 }
 
 float ofxBvh::getPosition()
 {
-	return play_head / (float)frames.size();
+	const float duration = getDuration();
+	return duration > 0 ? play_head / duration : 0;
 }
 
 float ofxBvh::getDuration()
 {
-	return (float)frames.size() * frame_time;
+	return (float)motion.getNumFrames() * frame_time;
 }
 
 void ofxBvh::parseHierarchy(const string& data)
@@ -278,6 +487,50 @@ void ofxBvh::parseHierarchy(const string& data)
 	}
 }
 
+static bool isChestJoint(const string& name)
+{
+	return name.compare(0, 5, "Chest") == 0 || name.compare(0, 5, "Spine") == 0;
+}
+
+static bool isFingerJoint(const string& name)
+{
+	const char *parts[] = { "Finger", "Thumb", "Index", "Middle", "Ring", "Pinky" };
+	
+	for (int i = 0; i < 6; i++)
+	{
+		if (name.find(parts[i]) != string::npos)
+			return true;
+	}
+	
+	return false;
+}
+
+// the last joints of the limbs, whose turn hardly shows on a distant figure
+static bool isExtremityJoint(const string& name)
+{
+	const char *parts[] = { "Head", "Wrist", "Hand", "Toe" };
+	
+	for (int i = 0; i < 4; i++)
+	{
+		if (name.find(parts[i]) != string::npos)
+			return true;
+	}
+	
+	return false;
+}
+
+int ofxBvh::getSkipLevel(const ofxBvhJoint *joint)
+{
+	if (joint->isSite() || isFingerJoint(joint->name) || isExtremityJoint(joint->name))
+		return 1;
+	
+	// the first joint of the chest chain still bends the upper body
+	if (isChestJoint(joint->name) && joint->parent && isChestJoint(joint->parent->name))
+		return 2;
+	
+	return NUM_LEVELS_OF_DETAIL;
+}
+
 ofxBvhJoint* ofxBvh::parseJoint(int& index, vector<string> &tokens, ofxBvhJoint *parent)
 {
 	string name = tokens[index++];
@@ -285,6 +538,7 @@ ofxBvhJoint* ofxBvh::parseJoint(int& index, vector<string> &tokens, ofxBvhJoint
 	if (parent) parent->children.push_back(joint);
 	
 	joint->bvh = this;
+	joint->index = joints.size();
 	
 	joints.push_back(joint);
 	jointMap[name] = joint;
@@ -361,6 +615,8 @@ ofxBvhJoint* ofxBvh::parseJoint(int& index, vector<string> &tokens, ofxBvhJoint
 		}
 	}
 	
+	joint->skip_level = getSkipLevel(joint);
+	
 	return joint;
 }
 
@@ -369,6 +625,7 @@ void ofxBvh::parseMotion(const string& data)
 	vector<string> lines = ofSplitString(data, "\n", true, true);
 	
 	int index = 0;
+	vector<Pose> frames;
 	
 	while (index < lines.size())
 	{
@@ -388,6 +645,7 @@ void ofxBvh::parseMotion(const string& data)
 		else if (line.find("Frame Time:") != string::npos)
 		{
 			frame_time = ofToFloat(ofSplitString(line, ":")[1]);
+			source_frame_time = frame_time;
 		}
 		else break;
 		
@@ -402,10 +660,9 @@ void ofxBvh::parseMotion(const string& data)
 		if (channels.size() != total_channels)
 		{
 			ofLogError("ofxBvh", "channel size mismatch");
-			return;
+			break;
 		}
 		
-		char buf[64];
 		FrameData data;
 		for (int i = 0; i < channels.size(); i++)
 		{
@@ -414,51 +671,514 @@ void ofxBvh::parseMotion(const string& data)
 			data.push_back(v);
 		}
 		
-		frames.push_back(data);
+		frames.push_back(Pose());
+		readPose(&data[0], frames.back());
 		
 		index++;
 	}
 	
 	if (num_frames != frames.size())
 		ofLogWarning("ofxBvh", "frame size mismatch");
+	
+	motion.compress(frames, frame_time);
 }
 
-const ofxBvhJoint* ofxBvh::getJoint(int index)
+const ofxBvhJoint* ofxBvh::getJoint(int index) const
 {
 	return joints.at(index);
 }
 
-const ofxBvhJoint* ofxBvh::getJoint(string name)
+const ofxBvhJoint* ofxBvh::getJoint(string name) const
 {
-	return jointMap[name];
+	map<string, ofxBvhJoint*>::const_iterator it = jointMap.find(name);
+	return it != jointMap.end() ? it->second : NULL;
 }
 
-static inline void billboard()
+// picks the keys of a track: from each key, the next one is the farthest frame the segment can be stretched to with
+// every frame in between still interpolated within tolerance.  The segment length is doubled until it no longer
+// fits and then narrowed down, so long still passages cost a few tests instead of one per frame.
+template<class Fit>
+static void reduceKeys(int num_frames, const Fit& fit, vector<unsigned short>& keys)
 {
-	GLfloat m[16];
-	glGetFloatv(GL_MODELVIEW_MATRIX, m);
+	const int last = num_frames - 1;
+	int a = 0;
+	
+	keys.clear();
+	keys.push_back(0);
+	
+	while (a < last)
+	{
+		int good = a + 1;
+		int bad = MIN(a + 2, last + 1);
+		
+		while (bad <= last && fit(a, bad))
+		{
+			good = bad;
+			bad = MIN(a + (bad - a) * 2, last + 1);
+		}
+		
+		while (bad - good > 1)
+		{
+			int middle = (good + bad) / 2;
+			
+			if (fit(a, middle))
+				good = middle;
+			else
+				bad = middle;
+		}
+		
+		keys.push_back(good);
+		a = good;
+	}
+}
+
+// normalized linear interpolation along the shorter arc; the keys are close enough for it to stay within tolerance
+// of a slerp, and it is the interpolation the keys were fitted with
+static ofVec4f interpolateRotation(const ofVec4f& from, ofVec4f to, float alpha)
+{
+	if (from.dot(to) < 0)
+		to *= -1;
+	
+	ofVec4f q = from * (1 - alpha) + to * alpha;
+	q.normalize();
+	return q;
+}
+
+struct RotationFit
+{
+	const vector<ofVec4f> &source;
+	const vector<ofVec4f> &decoded;
+	float min_dot;
+	
+	RotationFit(const vector<ofVec4f>& source, const vector<ofVec4f>& decoded, float min_dot)
+		: source(source), decoded(decoded), min_dot(min_dot) {}
+	
+	bool operator()(int a, int b) const
+	{
+		for (int i = a + 1; i < b; i++)
+		{
+			ofVec4f q = interpolateRotation(decoded[a], decoded[b], (float)(i - a) / (b - a));
+			if (fabs(q.dot(source[i])) < min_dot)
+				return false;
+		}
+		
+		return true;
+	}
+};
+
+struct TranslationFit
+{
+	const vector<ofVec3f> &source;
+	const vector<int> &quantized;
+	float step;
+	float tolerance;
+	
+	TranslationFit(const vector<ofVec3f>& source, const vector<int>& quantized, float step, float tolerance)
+		: source(source), quantized(quantized), step(step), tolerance(tolerance) {}
+	
+	bool operator()(int a, int b) const
+	{
+		// the key is stored as a difference to the previous one
+		for (int k = 0; k < 3; k++)
+		{
+			if (abs(quantized[b * 3 + k] - quantized[a * 3 + k]) > 32767)
+				return false;
+		}
+		
+		const ofVec3f from(quantized[a * 3] * step, quantized[a * 3 + 1] * step, quantized[a * 3 + 2] * step);
+		const ofVec3f to(quantized[b * 3] * step, quantized[b * 3 + 1] * step, quantized[b * 3 + 2] * step);
+		
+		for (int i = a + 1; i < b; i++)
+		{
+			ofVec3f v = from.getInterpolated(to, (float)(i - a) / (b - a));
+			if (v.distance(source[i]) > tolerance)
+				return false;
+		}
+		
+		return true;
+	}
+};
+
+void ofxBvhMotion::setTolerance(float degrees, float distance)
+{
+	rotation_tolerance = degrees;
+	distance_tolerance = distance;
+}
+
+void ofxBvhMotion::clear()
+{
+	num_frames = 0;
+	frame_time = 0;
+	
+	rotations.clear();
+	translations.clear();
+}
+
+void ofxBvhMotion::compress(const vector<ofxBvhPose>& frames, float frame_time)
+{
+	clear();
+	if (frames.empty()) return;
+	
+	int count = frames.size();
+	
+	if (count > MAX_FRAMES)
+	{
+		ofLogError("ofxBvh", "takes are cut off after " + ofToString((int)MAX_FRAMES) + " frames");
+		count = MAX_FRAMES;
+	}
+	
+	const vector<ofxBvhPose> source(frames.begin(), frames.begin() + count);
+	const int num_joints = source[0].size();
+	
+	num_frames = count;
+	this->frame_time = frame_time;
+	
+	rotations.resize(num_joints);
+	translations.resize(num_joints);
+	
+	for (int j = 0; j < num_joints; j++)
+	{
+		compressRotations(source, j, rotations[j]);
+		compressTranslations(source, j, translations[j]);
+	}
+	
+	ofLogVerbose("ofxBvh", ofToString(num_frames) + " frames compressed to " + ofToString(getMemoryUsage() / 1024) + " KB, "
+		+ ofToString(getUncompressedSize() / 1024) + " KB uncompressed");
+}
+
+void ofxBvhMotion::compressRotations(const vector<ofxBvhPose>& frames, int joint, RotationTrack& track) const
+{
+	vector<ofVec4f> source(num_frames), decoded(num_frames);
+	vector<unsigned short> values(num_frames * 3);
+	
+	// every frame is quantized first, so the keys are fitted against what the decoder will actually see
+	for (int i = 0; i < num_frames; i++)
+	{
+		source[i] = frames[i][joint].rotate.asVec4();
+		source[i].normalize();
+		
+		encodeRotation(source[i], &values[i * 3]);
+		decoded[i] = decodeRotation(&values[i * 3]);
+	}
+	
+	// q and -q are the same rotation, so the error is measured from the absolute dot product
+	const float min_dot = cos(rotation_tolerance * DEG_TO_RAD * 0.5);
+	reduceKeys(num_frames, RotationFit(source, decoded, min_dot), track.keys);
+	
+	track.values.resize(track.keys.size() * 3);
+	
+	for (int i = 0; i < track.keys.size(); i++)
+	{
+		for (int k = 0; k < 3; k++)
+			track.values[i * 3 + k] = values[track.keys[i] * 3 + k];
+	}
+}
+
+void ofxBvhMotion::compressTranslations(const vector<ofxBvhPose>& frames, int joint, TranslationTrack& track) const
+{
+	vector<ofVec3f> source(num_frames);
+	float largest_change = 0;
+	
+	for (int i = 0; i < num_frames; i++)
+	{
+		source[i] = frames[i][joint].translate;
+		
+		if (i > 0)
+		{
+			const ofVec3f d = source[i] - source[i - 1];
+			largest_change = MAX(largest_change, MAX(fabs(d.x), MAX(fabs(d.y), fabs(d.z))));
+		}
+	}
+	
+	// a step well below the tolerance, but coarse enough for the change between any two frames to fit in 16 bits
+	track.step = MAX(distance_tolerance * 0.25f, largest_change / 32000);
+	if (track.step <= 0)
+		track.step = 1;
+	
+	vector<int> quantized(num_frames * 3);
+	
+	for (int i = 0; i < num_frames; i++)
+	{
+		quantized[i * 3] = floor(source[i].x / track.step + 0.5f);
+		quantized[i * 3 + 1] = floor(source[i].y / track.step + 0.5f);
+		quantized[i * 3 + 2] = floor(source[i].z / track.step + 0.5f);
+	}
+	
+	reduceKeys(num_frames, TranslationFit(source, quantized, track.step, distance_tolerance), track.keys);
+	
+	track.anchors.clear();
+	track.deltas.resize(track.keys.size() * 3);
+	
+	for (int i = 0; i < track.keys.size(); i++)
+	{
+		const int *value = &quantized[track.keys[i] * 3];
+		
+		if (i % ANCHOR_INTERVAL == 0)
+		{
+			track.anchors.insert(track.anchors.end(), value, value + 3);
+			
+			for (int k = 0; k < 3; k++)
+				track.deltas[i * 3 + k] = 0;
+		}
+		else
+		{
+			const int *previous = &quantized[track.keys[i - 1] * 3];
+			
+			for (int k = 0; k < 3; k++)
+				track.deltas[i * 3 + k] = value[k] - previous[k];
+		}
+	}
+}
+
+void ofxBvhMotion::decompress(vector<ofxBvhPose>& frames) const
+{
+	frames.resize(num_frames);
+	
+	for (int i = 0; i < num_frames; i++)
+		getPose(i, frames[i]);
+}
+
+void ofxBvhMotion::getPose(float frame, ofxBvhPose& pose) const
+{
+	pose.resize(rotations.size());
+	
+	for (int j = 0; j < rotations.size(); j++)
+		getJointPose(j, frame, pose[j]);
+}
+
+void ofxBvhMotion::getJointPose(int joint, float frame, ofxBvhJointPose& pose) const
+{
+	if (num_frames == 0) return;
+	
+	frame = ofClamp(frame, 0, num_frames - 1);
+	
+	const RotationTrack &r = rotations[joint];
+	int key = findKey(r.keys, frame);
+	ofVec4f q = decodeRotation(&r.values[key * 3]);
+	
+	if (key + 1 < r.keys.size())
+	{
+		const float alpha = (frame - r.keys[key]) / (r.keys[key + 1] - r.keys[key]);
+		q = interpolateRotation(q, decodeRotation(&r.values[(key + 1) * 3]), alpha);
+	}
+	
+	pose.rotate.set(q);
+	
+	const TranslationTrack &t = translations[joint];
+	key = findKey(t.keys, frame);
+	pose.translate = getTranslationKey(t, key);
+	
+	if (key + 1 < t.keys.size())
+	{
+		const float alpha = (frame - t.keys[key]) / (t.keys[key + 1] - t.keys[key]);
+		pose.translate.interpolate(getTranslationKey(t, key + 1), alpha);
+	}
+}
+
+ofVec3f ofxBvhMotion::getTranslationKey(const TranslationTrack& track, int key) const
+{
+	// start from the last absolute value and add up the differences after it
+	const int anchor = key / ANCHOR_INTERVAL;
+	int value[3] = { track.anchors[anchor * 3], track.anchors[anchor * 3 + 1], track.anchors[anchor * 3 + 2] };
+	
+	for (int i = anchor * ANCHOR_INTERVAL + 1; i <= key; i++)
+	{
+		for (int k = 0; k < 3; k++)
+			value[k] += track.deltas[i * 3 + k];
+	}
+	
+	return ofVec3f(value[0], value[1], value[2]) * track.step;
+}
+
+int ofxBvhMotion::findKey(const vector<unsigned short>& keys, float frame)
+{
+	// the first key is always frame 0
+	return upper_bound(keys.begin(), keys.end(), frame) - keys.begin() - 1;
+}
+
+static const float SQRT_2 = 1.41421356f;
+
+// smallest-three: the largest of the four components is left out and restored from the unit length, its sign made
+// positive by negating the whole quaternion.  The other three lie within +-1/sqrt(2) and get 15 bits each; the two
+// bits naming the left out component go into the top bits of the first two words.
+void ofxBvhMotion::encodeRotation(const ofVec4f& q, unsigned short *value)
+{
+	const float *c = q.getPtr();
+	int largest = 0;
+	
+	for (int i = 1; i < 4; i++)
+	{
+		if (fabs(c[i]) > fabs(c[largest]))
+			largest = i;
+	}
+	
+	const float sign = c[largest] < 0 ? -1 : 1;
+	int n = 0;
+	
+	for (int i = 0; i < 4; i++)
+	{
+		if (i == largest) continue;
+		
+		float v = ofClamp(c[i] * sign * SQRT_2, -1, 1);
+		value[n++] = floor((v * 0.5f + 0.5f) * 32767 + 0.5f);
+	}
+	
+	value[0] |= (largest >> 1) << 15;
+	value[1] |= (largest & 1) << 15;
+}
+
+ofVec4f ofxBvhMotion::decodeRotation(const unsigned short *value)
+{
+	const int largest = (value[0] >> 15) << 1 | (value[1] >> 15);
+	float c[4];
+	float sum = 0;
+	int n = 0;
+	
+	for (int i = 0; i < 4; i++)
+	{
+		if (i == largest) continue;
+		
+		c[i] = ((value[n++] & 0x7fff) / 32767.0f * 2 - 1) / SQRT_2;
+		sum += c[i] * c[i];
+	}
+	
+	c[largest] = sqrt(MAX(0, 1 - sum));
+	
+	return ofVec4f(c[0], c[1], c[2], c[3]);
+}
+
+int ofxBvhMotion::getMemoryUsage() const
+{
+	int bytes = sizeof(*this);
+	
+	for (int i = 0; i < rotations.size(); i++)
+	{
+		const RotationTrack &r = rotations[i];
+		const TranslationTrack &t = translations[i];
+		
+		bytes += sizeof(r) + r.keys.size() * sizeof(unsigned short) + r.values.size() * sizeof(unsigned short);
+		bytes += sizeof(t) + t.keys.size() * sizeof(unsigned short) + t.anchors.size() * sizeof(int)
+			+ t.deltas.size() * sizeof(short);
+	}
+	
+	return bytes;
+}
+
+int ofxBvhMotion::getUncompressedSize() const
+{
+	return num_frames * (sizeof(ofxBvhPose) + rotations.size() * sizeof(ofxBvhJointPose));
+}
+
+ofxBvhRenderer::ofxBvhRenderer(int resolution) : resolution(resolution)
+{
+	for (int i = 0; i <= resolution; i++)
+	{
+		float a = TWO_PI * i / resolution;
+		circle.push_back(ofVec2f(cos(a), sin(a)));
+	}
+}
+
+void ofxBvhRenderer::begin(const ofMatrix4x4& modelview)
+{
+	// the rows of the view rotation are the camera's right and up axes in model space
+	right.set(modelview(0, 0), modelview(1, 0), modelview(2, 0));
+	up.set(modelview(0, 1), modelview(1, 1), modelview(2, 1));
+	right.normalize();
+	up.normalize();
 	
-	float inv_len;
-	
-	m[8] = -m[12];
-	m[9] = -m[13];
-	m[10] = -m[14];
-	inv_len = 1. / sqrt(m[8] * m[8] + m[9] * m[9] + m[10] * m[10]);
-	m[8] *= inv_len;
-	m[9] *= inv_len;
-	m[10] *= inv_len;
-	
-	m[0] = -m[14];
-	m[1] = 0.0;
-	m[2] = m[12];
-	inv_len = 1. / sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
-	m[0] *= inv_len;
-	m[1] *= inv_len;
-	m[2] *= inv_len;
-	
-	m[4] = m[9] * m[2] - m[10] * m[1];
-	m[5] = m[10] * m[0] - m[8] * m[2];
-	m[6] = m[8] * m[1] - m[9] * m[0];
-	
-	glLoadMatrixf(m);
-}
\ No newline at end of file
+	vertices.clear();
+	colors.clear();
+}
+
+void ofxBvhRenderer::add(const ofxBvh& bvh)
+{
+	for (int i = 0; i < bvh.getNumJoints(); i++)
+	{
+		const ofxBvhJoint *o = bvh.getJoint(i);
+		
+		if (o->isSite())
+			addDisc(o->getPosition(), 6, ofColor::yellow);
+		else if (o->getChildren().size() == 1)
+			addDisc(o->getPosition(), 2, ofColor::white);
+		else if (o->isRoot())
+			addDisc(o->getPosition(), 4, ofColor::cyan);
+		else
+			addDisc(o->getPosition(), 4, ofColor::green);
+	}
+}
+
+void ofxBvhRenderer::end()
+{
+	if (vertices.empty()) return;
+	
+	vbo.setVertexData(&vertices[0], vertices.size(), GL_STREAM_DRAW);
+	vbo.setColorData(&colors[0], colors.size(), GL_STREAM_DRAW);
+	vbo.draw(GL_TRIANGLES, 0, vertices.size());
+}
+
+void ofxBvhRenderer::clear()
+{
+	vbo.clear();
+}
+
+void ofxBvhRenderer::addDisc(const ofVec3f& center, float radius, const ofFloatColor& color)
+{
+	const ofVec3f r = right * radius;
+	const ofVec3f u = up * radius;
+	
+	for (int i = 0; i < resolution; i++)
+	{
+		vertices.push_back(center);
+		vertices.push_back(center + r * circle[i].x + u * circle[i].y);
+		vertices.push_back(center + r * circle[i + 1].x + u * circle[i + 1].y);
+		
+		colors.push_back(color);
+		colors.push_back(color);
+		colors.push_back(color);
+	}
+}
+
+void ofxBvhAudioClock::setup(ofSoundPlayer *player)
+{
+	this->player = player;
+	
+	time = 0;
+	drift = 0;
+	last_report = -1;
+}
+
+void ofxBvhAudioClock::update()
+{
+	if (!player) return;
+	
+	int report = player->getPositionMS();
+	
+	if (!player->getIsPlaying())
+	{
+		time = report / 1000.0f;
+		drift = 0;
+		last_report = report;
+		return;
+	}
+	
+	const float dt = ofGetLastFrameTime();
+	
+	// extrapolate until the player reports a new position
+	time += dt * player->getSpeed();
+	
+	if (report != last_report)
+	{
+		last_report = report;
+		drift = report / 1000.0f - time;
+		
+		if (fabs(drift) > max_drift)
+		{
+			time = report / 1000.0f;
+			drift = 0;
+		}
+	}
+	
+	float correction = drift * MIN(1, dt * slew_rate);
+	time += correction;
+	drift -= correction;
+}
@@ -1,14 +1,42 @@
 #include "testApp.h"
+#include "RandomGenerator.h"
+#include "SimulationClock.h"
+#include "Frustum.h"
+#include "FlowField.h"
+#include "Feedback.h"
 
 class Tracker;
 class Particle;
 class ParticleSystem;
 
 const float trackDuration = 64.28;
+// seed for all random effects; runs with the same seed play back identically
+const int randomSeed = 1;
 ofVec3f center, center_t;
 ofVec3f campos, campos_t;
-ofVec3f offset, offset_v;
 vector<Tracker*> trackers;
+// seconds since the start, used for animating the scene; advances in fixed steps when rendering offline
+float elapsedTime;
+// advances the effects in fixed steps, independently of how often the scene is drawn
+SimulationClock simClock;
+// view volume of the current frame in scene coordinates, set in drawScene(); figures and afterimages outside it are not drawn
+Frustum frustum;
+// toggled with 'b': the scene is drawn once, thin and bright, into the bloom buffers, which add the glow in one post pass;
+// off, the glow comes from drawing every primitive several times in wider, fainter layers
+bool bloomMode = true;
+// slowly swirling flow the particles and the history of poses drift along
+FlowField flowField;
+// toggled with 't': instead of emitting afterimage particles and keeping a history of poses, the figures leave
+// screen-space trails in a feedback buffer
+bool trailMode = false;
+// subsystems and knobs of the quality governor, in the order setup() adds them; see QualityGovernor.h
+enum { PARTICLES };
+enum { MAX_PARTICLES };
+Feedback trails;
+// the flow the trails drift along: a coarse noise field, redrawn every frame while trail mode is on
+ofTexture trailFlow;
+vector<float> trailFlowData;
+const int trailFlowWidth = 32, trailFlowHeight = 18;
 
 /* classes for handling particles */
 
@@ -16,7 +44,7 @@ vector<Tracker*> trackers;
 // class used for tracking information relevant to a particle
 class Particle {
 private:
-	ofVec3f pos;
+	ofVec3f pos, prevPos;
 	ofVec3f heading;
 	float lifespan;
 	int type;
@@ -24,6 +52,7 @@ private:
 public:
 	void init(ofVec3f pos_, ofVec3f heading_, float lifespan_, int type_) {
 		pos = pos_;
+		prevPos = pos_;
 		heading = heading_;
 		lifespan = lifespan_;
 		type = type_;
@@ -36,6 +65,10 @@ public:
 	ofVec3f getPos() {
 		return pos;
 	}
+	// position between the previous simulation step and the current one, for drawing
+	ofVec3f getPos(float alpha) {
+		return prevPos.getInterpolated(pos, alpha);
+	}
 	ofVec3f getHeading() {
 		return heading;
 	}
@@ -51,50 +84,161 @@ public:
 	void setType(int type_) {
 		type = type_;
 	}
+
+	// move along the heading, carried along by drift on top of it, and age by the given number of motion capture frames
+	void move(float amount, const ofVec3f &drift) {
+		prevPos = pos;
+		pos += (heading + drift) * amount;
+		lifespan -= amount;
+	}
+};
+
+// scene-wide limit on the number of particles, shared by the particle systems of all figures, so the most particles
+// there can be (and the cost of drawing them) does not grow with the number of figures.  When the budget is full, a
+// new particle takes the place of the oldest ones of the system holding the most particles for its priority: the
+// emitting system itself, unless another one holds more than its fair share.
+class ParticleBudget {
+private:
+	vector<ParticleSystem*> systems;
+	int capacity;
+
+public:
+	ParticleBudget() : capacity(10000) {}
+
+	void add(ParticleSystem *system) {
+		systems.push_back(system);
+	}
+
+	// lowering the capacity evicts the particles over it right away
+	void setCapacity(int capacity_);
+	int getCapacity() {
+		return capacity;
+	}
+	// particles in all systems together
+	int getSize();
+
+	// makes room for one more particle in the given system
+	void reserve(ParticleSystem *system);
+
+	// the system with the most particles for its priority, preferring the given one on a tie
+	ParticleSystem *findLargest(ParticleSystem *preferred);
 };
 
 // class for handling creation and updating of particles
 class ParticleSystem {
 private:
-	vector<Particle> particleVec;
+	// oldest first
+	deque<Particle> particles;
+	ParticleBudget *budget;
+	float priority;
+	int groupSize;
+	const FlowField *flow;
+	float flowStrength;
 
 public:
+	ParticleSystem() : budget(NULL), priority(1), groupSize(1), flow(NULL), flowStrength(0) {}
+
+	// share the given budget with the other systems.  groupSize particles emitted together are drawn together, and
+	// evicted together
+	void setup(ParticleBudget *budget_, int groupSize_ = 1) {
+		budget = budget_;
+		groupSize = groupSize_;
+		budget->add(this);
+	}
+
+	// particles drift along the flow field at strength times its velocity, in scene units per motion capture frame;
+	// pass NULL to move them along their headings only
+	void setFlow(const FlowField *flow_, float strength) {
+		flow = flow_;
+		flowStrength = strength;
+	}
+
+	// a system with twice the priority keeps twice as many particles when the budget is full; must be above 0
+	void setPriority(float priority_) {
+		priority = priority_;
+	}
+	float getPriority() {
+		return priority;
+	}
+
 	// create a particle at a given location with a movement direction and lifespan
 	void emit(ofVec3f pos_, ofVec3f heading_, float lifespan_, int type_) {
+		if (budget != NULL)
+			budget->reserve(this);
 		Particle next;
 		next.init(pos_, heading_, lifespan_, type_);
-		particleVec.push_back(next);
+		particles.push_back(next);
 	}
 
-	// move particles according to their current direction and update their lifespan
-	void updateParticles() {
-		for (int i = 0; i < particleVec.size(); i++) {
-			particleVec[i].setPos(particleVec[i].getPos() + particleVec[i].getHeading());
-			particleVec[i].setLifespan(particleVec[i].getLifespan()-1);
+	// move particles according to their current direction and update their lifespan.  Headings and lifespans are given
+	// per motion capture frame; amount is the length of a simulation step in those frames
+	void updateParticles(float amount) {
+		for (int i = 0; i < particles.size(); i++) {
+			ofVec3f drift = flow != NULL ? flow->sample(particles[i].getPos()) * flowStrength : ofVec3f();
+			particles[i].move(amount, drift);
 		}
 	}
 
-	// remove particles from the system when they run out of lifespan
+	// remove particles from the system when they run out of lifespan; particles that die before older ones are hidden
+	// until those are removed
 	void checkLifespans() {
-		for (int i = 0; i < particleVec.size(); i++) {
-			if (particleVec[i].getLifespan() < 0) {
-				particleVec[i].setType(-1);
-				if (particleVec[0].getType() == -1) {
-					particleVec.erase(particleVec.begin());
-				}
-			}
+		for (int i = 0; i < particles.size(); i++) {
+			if (particles[i].getLifespan() < 0)
+				particles[i].setType(-1);
 		}
+		while (!particles.empty() && particles.front().getType() == -1)
+			particles.pop_front();
+	}
+
+	// remove the oldest group of particles to make room for new ones
+	void evictOldest() {
+		for (int i = 0; i < groupSize && !particles.empty(); i++)
+			particles.pop_front();
 	}
 
 	// getters and setters
 	size_t getSize() {
-		return particleVec.size();
+		return particles.size();
 	}
-	vector<Particle> getParticles() {
-		return particleVec;
+	deque<Particle> &getParticles() {
+		return particles;
 	}
 };
 
+void ParticleBudget::setCapacity(int capacity_) {
+	capacity = capacity_;
+	while (getSize() > capacity)
+		findLargest(NULL)->evictOldest();
+}
+
+int ParticleBudget::getSize() {
+	int size = 0;
+	for (int i = 0; i < systems.size(); i++)
+		size += systems[i]->getSize();
+	return size;
+}
+
+void ParticleBudget::reserve(ParticleSystem *system) {
+	while (getSize() >= capacity) {
+		ParticleSystem *largest = findLargest(system);
+		if (largest->getSize() == 0)
+			return;
+		largest->evictOldest();
+	}
+}
+
+ParticleSystem *ParticleBudget::findLargest(ParticleSystem *preferred) {
+	ParticleSystem *largest = preferred;
+	for (int i = 0; i < systems.size(); i++) {
+		if (largest == NULL || systems[i]->getSize() / systems[i]->getPriority() > largest->getSize() / largest->getPriority())
+			largest = systems[i];
+	}
+	return largest;
+}
+
+// the one budget all figures' particles come from
+ParticleBudget particleBudget;
+
 /* The Tracker class handles the motion of each figure in the scene.  Each Tracker object tracks the position data of one figure in the scene, 
    as well as visual effects related to that figure.  The Tracker also stores the position data of the other two figures, which allows the figure 
    the Tracker handles to interact with the others. */
@@ -110,9 +254,13 @@ public:
 	
 	// Frames hold the set of position values in each frame of movement
 	typedef vector<ofVec3f> Frame;
-	// each track contains the position values of all frames for each figure
+	// the poses of the figure, newest first, one per capture frame; see recordFrame()
 	typedef deque<Frame> Track;
-	deque<Frame> track, lTrack, rTrack;
+	Track track;
+	// poses kept in the track: five seconds of the Perfume takes
+	static const int HISTORY_FRAMES = 200;
+	// seconds since the last pose went into the track
+	float historyTime;
 	int numPoints;
 	bool drawClone;
 	
@@ -124,14 +272,34 @@ public:
 	typedef vector<Buffer> BufferArray;
 	vector<BufferArray> buffer;
 	ParticleSystem particleHandler;
+	RandomGenerator rng;
+	// separate stream for the flicker of line widths and point sizes, so drawing more or less often does not change the effects
+	RandomGenerator jitter;
+	// the current pose of the figure, uploaded once per new frame and shared by every layer drawn in drawFigure()
+	ofVbo figureVbo;
+	int figureVertices;
 	Frame startPoints, lPoints, rPoints;
+	// bounding sphere of the current pose
+	ofVec3f boundsCenter;
+	float boundsRadius;
+	// times the afterimages, and sets how many particles they may have
+	QualityGovernor *quality;
 	
 	// initialize values
-	void setup(ofxBvh *o, int id_)
+	void setup(ofxBvh *o, int id_, QualityGovernor *quality_)
 	{
 		bvh = o;
+		quality = quality_;
 		id = id_;
+		rng.setSeed(randomSeed, id);
+		// the particles of an afterimage are drawn in pairs, the ends of every bone
+		particleHandler.setup(&particleBudget, 2);
+		particleHandler.setFlow(&flowField, 0.15);
+		jitter.setSeed(randomSeed, 100 + id);
+		figureVertices = 0;
+		historyTime = 0;
 		drawClone = false;
+		boundsRadius = 0;
 	}
 	// set which figures are to the left and right of this figure
 	void setBvhL(ofxBvh *o) {
@@ -146,23 +314,42 @@ public:
 	{
 		if (bvh->isFrameNew())
 		{
-			// add the position data in the current frame to the tracker
-			Frame f;
-			addFrame(&f, bvh, &track);
-			modifyVertices();
-			cacheVertices();
-			particleHandler.updateParticles();
+			getFrame(&startPoints, bvh);
+			uploadFigure();
+			updateBounds();
 		}
 	}
 
-	// draw the elements in the scene
+	// advance the afterimages by one fixed simulation step of stepTime seconds
+	void step(float stepTime)
+	{
+		// the history of poses, and what is emitted with it, moves on once per capture frame, whatever rate the takes
+		// were resampled to for drawing
+		historyTime += stepTime;
+		if (startPoints.empty())
+			historyTime = 0;
+		while (historyTime >= getCaptureFrameTime()) {
+			historyTime -= getCaptureFrameTime();
+			recordFrame();
+		}
+
+		quality->begin(PARTICLES);
+		// lifespans are given in motion capture frames
+		particleHandler.updateParticles(stepTime / getCaptureFrameTime());
+
+		if (!startPoints.empty() && !trailMode)
+			setupParticles();
+		quality->end(PARTICLES);
+	}
+
+	// draw the figure; the afterimages are drawn in a pass of their own, so they can be timed for the governor
 	void draw()
 	{
 		glEnable(GL_POLYGON_OFFSET_FILL);
 		glPolygonOffset(1, 1);
-		setupParticles();
-		drawParticles();
-		drawFigure();
+		// line widths and point sizes reach past the joints, so the sphere is given some room
+		if (frustum.intersects(boundsCenter, boundsRadius + 50))
+			drawFigure();
 		glDisable(GL_POLYGON_OFFSET_FILL);
 		glPolygonOffset(0, 0);
 		glDisable(GL_LIGHT0);
@@ -171,8 +358,9 @@ public:
 	
 	/* Tracker updating functions: except for the code for updating particles, these are taken directly from the original code's update() function. */
 
-	// adds the current position values of the figure to a Track container 
-	void addFrame(Frame* f, ofxBvh *o, Track* track_) {
+	// fills a Frame with the current position values of a figure
+	void getFrame(Frame* f, ofxBvh *o) {
+		f->clear();
 		for (int i = 0; i < o->getNumJoints(); i++)
 		{
 			const ofxBvhJoint *j = o->getJoint(i);
@@ -183,9 +371,23 @@ public:
 				f->push_back(j->getChildren().at(n)->getPosition());
 			}
 		}
-		track_->push_front(*f);	
-		if (track_->size() > 200)
-			track_->pop_back();
+	}
+
+	// adds the current pose to the figure's Track and moves the older ones along; once per capture frame
+	void recordFrame() {
+		track.push_front(startPoints);
+		// trails come from the feedback buffer, so only the current pose is needed
+		int length = trailMode ? 1 : HISTORY_FRAMES;
+		while (track.size() > length)
+			track.pop_back();
+		modifyVertices();
+		cacheVertices();
+	}
+
+	// seconds per frame of the take as captured; particle headings and lifespans, and the pose history, are given in
+	// these frames.  Without a take, one frame per simulation step
+	float getCaptureFrameTime() {
+		return bvh->getSourceFrameTime() > 0 ? bvh->getSourceFrameTime() : simClock.getStepTime();
 	}
 
 	// applies gravity modifiers to the position data in Frames older than the current one; not currently used
@@ -203,10 +405,11 @@ public:
 					
 				// gravity
 				f.y -= -2.5 * (1 - sin(pow(delta, 2) * PI));
-				f.y += ofNoise(v.y * 0.0001 + offset.y) * 1.4;
-					
-				f.x += ofSignedNoise(v.x * 0.0001 + offset.x) * 3;
-				f.z += ofSignedNoise(v.z * 0.0001 + offset.z) * 3;
+				// drift along the flow field, upwards on average
+				ofVec3f flow = flowField.sample(v);
+				f.x += flow.x * 3;
+				f.y += 0.7 + flow.y * 0.7;
+				f.z += flow.z * 3;
 					
 				if (v.y < 0)
 				{
@@ -228,6 +431,32 @@ public:
 		}
 	}
 
+	// copies the current pose of this figure into its vertex buffer
+	void uploadFigure() {
+		const Frame &f = startPoints;
+		if (f.empty())
+			return;
+		if (f.size() != figureVertices) {
+			figureVbo.setVertexData(&f[0], f.size(), GL_DYNAMIC_DRAW);
+			figureVertices = f.size();
+		}
+		else figureVbo.updateVertexData(&f[0], f.size());
+	}
+
+	// a sphere around every joint of the current pose, from their average and the farthest one from it
+	void updateBounds() {
+		const Frame &f = startPoints;
+		if (f.empty())
+			return;
+		boundsCenter.set(0, 0, 0);
+		for (int i = 0; i < f.size(); i++)
+			boundsCenter += f[i];
+		boundsCenter /= f.size();
+		boundsRadius = 0;
+		for (int i = 0; i < f.size(); i++)
+			boundsRadius = MAX(boundsRadius, boundsCenter.distance(f[i]));
+	}
+
 	// stores the positions of the vertices in this figure's Track
 	void cacheVertices() {
 		// cache vertexes
@@ -272,7 +501,7 @@ public:
 	/* drawing functions */
 	// draw an openGL point
 	void drawPoint(int size, ofColor color, ofVec3f pos) {
-		glPointSize(size);
+		Antialiasing::pointSize(size);
 		glBegin(GL_POINTS);
 		ofSetColor(color);
 		glVertex3fv(pos.getPtr());
@@ -281,7 +510,7 @@ public:
 
 	// draw an openGL line strip
 	void drawLineStrip(int width, ofColor color, ofVec3f pos1, ofVec3f pos2) {
-		glLineWidth(width);
+		Antialiasing::lineWidth(width);
 		glBegin(GL_LINE_STRIP);
 		ofSetColor(color);
 		glVertex3fv(pos1.getPtr());
@@ -291,27 +520,29 @@ public:
 
 	// periodically emit particles at the figure's joints - these will form an "afterimage"
 	void setupParticles() {
-		if (int(ofGetElapsedTimef())%2 == 0) {
-			// track[0] stores the current frame's position data
-			for (int j = 0; j < track[0].size(); j++) {
-				if (drawClone && particleHandler.getSize() < 5000) {
+		if (int(elapsedTime)%2 == 0) {
+			for (int j = 0; j < startPoints.size(); j++) {
+				if (drawClone) {
 					particleHandler.checkLifespans();
-					particleHandler.emit(track[0][j], ofVec3f(0,0,0), 300, 0);
+					particleHandler.emit(startPoints[j], ofVec3f(0,0,0), 300, 0);
 				}
 			}
 			drawClone = false;
 		}
 
-		if (int(ofGetElapsedTimef())%2 != 0) {
+		if (int(elapsedTime)%2 != 0) {
 			drawClone = true;
 		}
 	}
 
 	// draw the existing particles and change their properties according to their lifespan
-	void drawParticles() {
-		vector<Particle> current = particleHandler.getParticles();
+	void drawParticles(float alpha) {
+		deque<Particle> &current = particleHandler.getParticles();
 		for (int j = 0; j < current.size(); j+=2) {
 			if (current[j].getType() == 0) {
+				// each pair of particles is drawn together, so it is only skipped when both are off screen
+				if (!frustum.intersects(current[j].getPos(alpha), 30) && !frustum.intersects(current[j+1].getPos(alpha), 30))
+					continue;
 				int size, fade;
 				// modify the size and transparency of the particles as their lifespan decreases
 				if (current[j].getLifespan() > 288) {
@@ -323,93 +554,85 @@ public:
 					fade = (300 - current[j].getLifespan()) / 2;
 				}
 				// draw several particles at each particle position for visual effect
-				glPointSize(3+size);
+				Antialiasing::pointSize(3+size);
 				glBegin(GL_POINTS);
 				ofSetColor(230, 230, 230, 150-fade);
-				glVertex3fv(current[j].getPos().getPtr());
-				glVertex3fv(current[j+1].getPos().getPtr());
-				glEnd();
-				glPointSize(9+size);
-				glBegin(GL_POINTS);
-				ofSetColor(100, 100, 100, 100-fade);
-				glVertex3fv(current[j].getPos().getPtr());
-				glVertex3fv(current[j+1].getPos().getPtr());
-				glEnd();
-				glPointSize(15+size);
-				glBegin(GL_POINTS);
-				// change color of the largest particles based on which figure they come from
-				if (id == 0)
-					ofSetColor(150, 100, 100, 100-fade);
-				if (id == 1)
-					ofSetColor(100, 150, 100, 100-fade);
-				if (id == 2)
-					ofSetColor(150, 150, 70, 100-fade);
-				glVertex3fv(current[j].getPos().getPtr());
-				glVertex3fv(current[j+1].getPos().getPtr());
+				glVertex3fv(current[j].getPos(alpha).getPtr());
+				glVertex3fv(current[j+1].getPos(alpha).getPtr());
 				glEnd();
+				// with bloom the bright core is enough; the glow around it comes from the post pass
+				if (!bloomMode) {
+					Antialiasing::pointSize(9+size);
+					glBegin(GL_POINTS);
+					ofSetColor(100, 100, 100, 100-fade);
+					glVertex3fv(current[j].getPos(alpha).getPtr());
+					glVertex3fv(current[j+1].getPos(alpha).getPtr());
+					glEnd();
+					Antialiasing::pointSize(15+size);
+					glBegin(GL_POINTS);
+					// change color of the largest particles based on which figure they come from
+					if (id == 0)
+						ofSetColor(150, 100, 100, 100-fade);
+					if (id == 1)
+						ofSetColor(100, 150, 100, 100-fade);
+					if (id == 2)
+						ofSetColor(150, 150, 70, 100-fade);
+					glVertex3fv(current[j].getPos(alpha).getPtr());
+					glVertex3fv(current[j+1].getPos(alpha).getPtr());
+					glEnd();
+				}
 				// connect the particles with lines, to make a copy of the figure as it looked in this frame
-				glLineWidth(2);
+				Antialiasing::lineWidth(2);
 				glBegin(GL_LINES);
 				if (j > 0) {
-					glVertex3fv(current[j].getPos().getPtr());
-					glVertex3fv(current[j+1].getPos().getPtr());
+					glVertex3fv(current[j].getPos(alpha).getPtr());
+					glVertex3fv(current[j+1].getPos(alpha).getPtr());
 				}
 				glEnd();
 			}
 		}
 	}
 
-	// draws the figure this Tracker is handling.  Taken from the original code.
+	// draws the figure this Tracker is handling.  Adapted from the original code; every layer is drawn from the figure's vertex buffer.
 	void drawFigure() {
-		if (!track.empty())
-		{
-			Frame &f = track[0];
-			
-			glLineWidth(2);
-			ofSetColor(222, 222, 222, 120);
-			glBegin(GL_LINES);
-			for (int n = 0; n < f.size(); n += 2)
-			{
-				ofVec3f &v1 = f[n];
-				ofVec3f &v2 = f[n + 1];
-				
-				glVertex3fv(v1.getPtr());
-				glVertex3fv(v2.getPtr());
-			}
-			glEnd();
+		if (figureVertices > 0 && bloomMode)
+		{
+			// the lines and the joints once each, the lines between white and the figure's color; the bloom pass spreads them
+			// into the halo the wide layers below draw
+			Antialiasing::lineWidth(3);
+			ofSetColor(146, 171, 222, 200);
+			if (id == 0)
+				ofSetColor(211, 146, 146, 200);
+			if (id == 1)
+				ofSetColor(146, 186, 146, 200);
+			if (id == 2)
+				ofSetColor(211, 211, 146, 200);
+			figureVbo.draw(GL_LINES, 0, figureVertices);
+			Antialiasing::pointSize(jitter.nextInt(4)+6);
+			ofSetColor(255, 255, 255, 120);
+			figureVbo.draw(GL_POINTS, 0, figureVertices);
+		}
+		else if (figureVertices > 0)
+		{
+			Antialiasing::lineWidth(2);
+			ofSetColor(222, 222, 222, 120);
+			figureVbo.draw(GL_LINES, 0, figureVertices);
 			// draw another set of lines for visual effect; color changes depending on which figure they correspond to
-			glLineWidth(20);
+			Antialiasing::lineWidth(20);
 			ofSetColor(70, 120, 222, 100);
 			if (id == 0)
 				ofSetColor(200, 70, 70, 100);
 			if (id == 1)
 				ofSetColor(70, 150, 70, 100);
 			if (id == 2)
-				ofSetColor(200, 200, 70, 100);
-			glBegin(GL_LINES);
-			for (int n = 0; n < f.size(); n += 2)
-			{
-				ofVec3f &v1 = f[n];
-				ofVec3f &v2 = f[n + 1];
-				
-				glVertex3fv(v1.getPtr());
-				glVertex3fv(v2.getPtr());
-			}
-			glEnd();
-			// draw points at the joints of the figure
-			glPointSize(rand()%10+10);
-			glBegin(GL_POINTS);
-			for (int n = 0; n < f.size(); n++)
-			{
-				ofVec3f &v1 = f[n];
-				glVertex3fv(v1.getPtr());
-			}
-			glEnd();
-			for (int n = 0; n < f.size(); n++)
-			{
-				ofVec3f &v1 = f[n];
-				drawPoint(10-rand()%2, ofColor(255, 255, 255, 55), v1);
-			}
+				ofSetColor(200, 200, 70, 100);
+			figureVbo.draw(GL_LINES, 0, figureVertices);
+			// draw points at the joints of the figure
+			Antialiasing::pointSize(jitter.nextInt(10)+10);
+			figureVbo.draw(GL_POINTS, 0, figureVertices);
+			Antialiasing::pointSize(10-jitter.nextInt(2));
+			ofSetColor(255, 255, 255, 55);
+			figureVbo.draw(GL_POINTS, 0, figureVertices);
 		}
 	}
 
@@ -466,10 +689,36 @@ public:
 	
 };
 
+// fills the flow texture from a vertical slice through the middle of the flow field, stretched over the screen, so the
+// trails swirl the same way as the particles
+void updateTrailFlow() {
+	const ofVec3f &min = flowField.getMin(), &max = flowField.getMax();
+	for (int y = 0; y < trailFlowHeight; y++) {
+		for (int x = 0; x < trailFlowWidth; x++) {
+			ofVec3f pos(ofLerp(min.x, max.x, (x + 0.5) / trailFlowWidth), ofLerp(max.y, min.y, (y + 0.5) / trailFlowHeight), (min.z + max.z) / 2);
+			ofVec3f flow = flowField.sample(pos);
+			float *v = &trailFlowData[(y * trailFlowWidth + x) * 3];
+			v[0] = flow.x;
+			v[1] = -flow.y;
+			v[2] = 0;
+		}
+	}
+	trailFlow.loadData(&trailFlowData[0], trailFlowWidth, trailFlowHeight, GL_RGB);
+}
+
+// in trail mode the figures are already in the trail buffer, which is added over the background in their place
+void drawTrails(float width, float height) {
+	ofEnableBlendMode(OF_BLENDMODE_ADD);
+	ofSetColor(255);
+	trails.draw(0, 0, width, height);
+}
+
 /* functions for running the program in general; nearly all from the original code except for adding more figures to the bvh vector */
 //--------------------------------------------------------------
 void testApp::setup()
 {
+	ofSeedRandom(randomSeed);
+
 	ofSetFrameRate(60);
 	ofSetVerticalSync(true);
 	
@@ -489,12 +738,49 @@ void testApp::setup()
 
 	for (int i = 0; i < bvh.size(); i++)
 	{
+		// one pose per drawn frame, so playback never lands between two captured frames
+		bvh[i].resample(offline.isEnabled() ? offline.getFps() : 60);
 		bvh[i].setFrame(4);
 	}
 	
+	// figures driven by a live feed; each one plays its file until the feed has sent its skeleton
+	for (int i = 0; i < streamAddresses.size() && i < bvh.size(); i++)
+	{
+		ofxBvhStream *s = new ofxBvhStream;
+		s->open(streamAddresses[i]);
+		streams.push_back(s);
+	}
+	
 	track.loadSound("Perfume_globalsite_sound.wav");
 	track.setLoop(true);
-	track.play();
+	if (offline.isEnabled()) {
+		// render as fast as possible, without sound
+		ofSetFrameRate(0);
+		ofSetVerticalSync(false);
+		offline.start(trackDuration);
+	}
+	else {
+		track.play();
+		audioClock.setup(&track);
+	}
+	
+	antialiasing.start();
+	setupBuffers();
+	
+	// the trails fade over about a second and drift along a noise field
+	if (trails.isAllocated()) {
+		trailFlowData.resize(trailFlowWidth * trailFlowHeight * 3);
+		trailFlow.allocate(trailFlowWidth, trailFlowHeight, GL_RGB32F_ARB);
+		trails.setHalfLife(0.6);
+		trails.setFlow(&trailFlow, 60);
+	}
+	
+	// the afterimages are the only effect with a density to scale
+	quality.addSubsystem("afterimages");
+	quality.addKnob(PARTICLES, 2000, 10000);
+	// offline renders take as long as they need, at full density
+	if (offline.isEnabled())
+		quality.setEnabled(false);
 	
 	// setup tracker
 	for (int i = 0; i < bvh.size(); i++)
@@ -502,7 +788,7 @@ void testApp::setup()
 		ofxBvh &b = bvh[i];
 
 		Tracker *t = new Tracker;
-		t->setup(&b, i);
+		t->setup(&b, i, &quality);
 		trackers.push_back(t);
 	}
 	
@@ -513,12 +799,9 @@ void testApp::setup()
 	trackers[1]->setBvhR(&bvh[2]);
 	trackers[2]->setBvhR(&bvh[0]);
 
-	offset.x = ofRandom(1);
-	offset.y = ofRandom(1);
-	offset.z = ofRandom(1);
-	offset_v.x = ofRandom(0.001);
-	offset_v.y = ofRandom(0.005);
-	offset_v.z = ofRandom(0.001);
+	// a coarse grid over the space the figures move in; the flow changes over four seconds
+	flowField.setup(ofVec3f(-1000, -200, -1000), ofVec3f(1000, 800, 1000), 16, 8, 16);
+	flowField.setSeed(ofRandom(1000));
 	
 	campos_t.set(0, 0, -300);
 }
@@ -526,48 +809,162 @@ void testApp::setup()
 //--------------------------------------------------------------
 void testApp::update()
 {
-	float t = (track.getPosition() * trackDuration);
-	t = t / bvh[0].getDuration();
+	quality.beginFrame();
+	// the governor sizes the scene-wide particle budget; lowering it evicts the oldest particles right away
+	particleBudget.setCapacity(quality.get(MAX_PARTICLES));
+	
+	// the antialiasing benchmark changes the mode on its own, and the resolution follows the GPU time of the last frames;
+	// the buffers follow both.  The resolution gives way to the quality governor, which thins out the effects first
+	if (!offline.isEnabled()) {
+		bool changed = antialiasing.update();
+		if (!antialiasing.isBenchmarking() && resolution.update(!quality.isCutting(), quality.isFull()))
+			changed = true;
+		if (changed)
+			setupBuffers();
+	}
+	
+	float t;
+	if (offline.isEnabled()) {
+		t = offline.getTime();
+		elapsedTime = t;
+	}
+	else {
+		// follow the music, smoothing out the coarse position reports of the sound player
+		audioClock.update();
+		t = audioClock.getTime();
+		elapsedTime = ofGetElapsedTimef();
+	}
+	flowField.update(elapsedTime);
 	
 	center_t.set(0, 0, 0);
 	
 	for (int i = 0; i < bvh.size(); i++)
 	{
-		bvh[i].setPosition(t);
+		if (i < streams.size())
+			streams[i]->update(bvh[i]);
+		if (!bvh[i].isLive())
+			bvh[i].setTime(t);
 		bvh[i].update();
 		
 		center_t += bvh[i].getJoint(0)->getPosition();
 	}
 	
 	center_t /= 3;
-	center += (center_t - center) * 0.01;
 	
 	for (int i = 0; i < trackers.size(); i++)
 	{
 		trackers[i]->update();
 	}
 	
-	offset += offset_v;
+	// advance the effects in fixed steps, however often the scene is drawn
+	int steps = simClock.advance(elapsedTime);
+	for (int s = 0; s < steps; s++)
+	{
+		for (int i = 0; i < trackers.size(); i++)
+		{
+			trackers[i]->step(simClock.getStepTime());
+		}
+		
+		center += (center_t - center) * 0.01;
+		campos += (campos_t - campos) * 0.01;
+	}
 	
 	cam.setPosition(campos.x, campos.y, campos.z);
 	cam.lookAt(ofVec3f(0, 0, 0));
-	campos += (campos_t - campos) * 0.01;
+	
+	if (trailMode)
+		updateTrailFlow();
 }
 
 //--------------------------------------------------------------
 void testApp::draw(){
+	// the GPU is idle during update(); the frame's GPU time starts here
+	quality.beginFrameDraw();
+	if (offline.isEnabled()) {
+		if (offline.isDone()) {
+			offline.finish();
+			ofExit();
+			return;
+		}
+		// the new frame over the faded trails; drawTrails() below shows them
+		if (trailMode) {
+			trails.begin(1 / offline.getFps());
+			drawScene();
+			trails.end();
+		}
+		if (bloomMode) {
+			drawBloom();
+			offline.begin();
+			bloom.draw(0, 0, offline.getWidth(), offline.getHeight());
+			offline.end();
+		}
+		else {
+			offline.begin();
+			ofClear(10, 255);
+			if (trailMode)
+				drawTrails(offline.getWidth(), offline.getHeight());
+			else drawScene();
+			offline.end();
+		}
+		// preview of the frame that was just rendered
+		ofSetColor(255);
+		ofDisableBlendMode();
+		offline.draw(0, 0, ofGetWidth(), ofGetHeight());
+		quality.endFrame();
+		return;
+	}
+
+	// the GPU time of everything drawn for the frame picks the resolution of the next ones
+	resolution.begin();
+
+	if (trailMode) {
+		trails.begin(ofGetLastFrameTime());
+		drawScene();
+		trails.end();
+	}
+	if (bloomMode) {
+		drawBloom();
+		bloom.draw(0, 0, ofGetWidth(), ofGetHeight());
+	}
+	else if (trailMode)
+		drawTrails(ofGetWidth(), ofGetHeight());
+	else
+		drawScene();
+	resolution.end();
+	quality.endFrame();
+	recorder.capture(ofGetElapsedTimef());
+}
+
+//--------------------------------------------------------------
+// (re)allocates the buffers the scene is drawn through, at the size of the render target and with the samples the
+// antialiasing mode needs
+void testApp::setupBuffers(){
+	// offline renders always use their full size
+	float scale = offline.isEnabled() ? 1 : resolution.getScale();
+	int width = (offline.isEnabled() ? offline.getWidth() : ofGetWidth()) * scale;
+	int height = (offline.isEnabled() ? offline.getHeight() : ofGetHeight()) * scale;
+	if (!bloom.setup(width, height, antialiasing.getNumSamples()))
+		bloomMode = false;
+	if (!trails.setup(width, height, antialiasing.getNumSamples()))
+		trailMode = false;
+}
+
+//--------------------------------------------------------------
+// draw the scene into the bloom buffers and run the glow passes; bloom.draw() then composites it into the target
+void testApp::drawBloom(){
+	bloom.begin();
+	ofClear(10, 255);
+	if (trailMode)
+		drawTrails(bloom.getWidth(), bloom.getHeight());
+	else drawScene();
+	bloom.end();
+}
+
+//--------------------------------------------------------------
+void testApp::drawScene(){
 	glDisable(GL_DEPTH_TEST);
 	glShadeModel(GL_SMOOTH);
-	
-	ofEnableSmoothing();
-	
-	glEnable(GL_LINE_SMOOTH);
-	glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
 	glLineWidth(1);
-
-	// smooth particle
-	glEnable(GL_POINT_SMOOTH);
-	glHint(GL_POINT_SMOOTH_HINT, GL_NICEST);
 	
 	ofEnableBlendMode(OF_BLENDMODE_ADD);
 
@@ -575,10 +972,18 @@ void testApp::draw(){
 	light.setPosition(0, -500, 0);
 	
 	cam.begin();
+
+	// the same transform as the one applied below, followed by the camera's
+	frustum.setup(ofMatrix4x4::newTranslationMatrix(ofVec3f(-center.x, -100, -center.z))
+		* ofMatrix4x4::newRotationMatrix(elapsedTime * 20, ofVec3f(0, 1, 0))
+		* cam.getModelViewProjectionMatrix());
+	
+	// lines and points are antialiased as chosen with 'a' or --antialiasing
+	antialiasing.begin();
 	
 	ofPushMatrix();
 	{
-		glRotatef(ofGetElapsedTimef() * 20, 0, 1, 0);
+		glRotatef(elapsedTime * 20, 0, 1, 0);
 		glTranslatef(-center.x, -100, -center.z);
 		
 		ofSetColor(50);
@@ -597,10 +1002,18 @@ void testApp::draw(){
 		}*/
 		
 		ofSetColor(ofColor::white, 80);
+		// the afterimages in a pass of their own, so the governor can time them
+		quality.beginDraw(PARTICLES);
+		for (int i = 0; i < trackers.size(); i++)
+		{
+			trackers[i]->drawParticles(simClock.getAlpha());
+		}
+		quality.endDraw(PARTICLES);
 		for (int i = 0; i < trackers.size(); i++)
 		{
 			trackers[i]->draw();
 		}
+		antialiasing.end();
 	}
 	ofPopMatrix();
 	
@@ -610,8 +1023,63 @@ void testApp::draw(){
 	
 }
 
+//--------------------------------------------------------------
+void testApp::exit(){
+	recorder.stop();
+	offline.finish();
+	
+	for (int i = 0; i < streams.size(); i++)
+		delete streams[i];
+	streams.clear();
+}
+
 //--------------------------------------------------------------
 void testApp::keyPressed(int key){
+	// record the window to a video file in the data folder
+	if (key == 'r') {
+		if (recorder.isCapturing()) {
+			recorder.stop();
+			if (recorder.getNumDropped() > 0)
+				ofLogWarning("testApp", "recording dropped " + ofToString(recorder.getNumDropped()) + " frames");
+		}
+		else {
+			string path = ofToDataPath("recording-" + ofToString(ofGetUnixTime()) + ".mp4", true);
+			// the frames repeated or left out as the frame rate varies, so the video plays at 60 frames per second
+			recorder.start(ofGetWidth(), ofGetHeight(), new EncoderSink(path, 60), 60);
+		}
+		return;
+	}
+
+	if (key == 'a') {
+		antialiasing.nextMode();
+		setupBuffers();
+		ofLogNotice("testApp", "antialiasing: " + antialiasing.getModeName());
+		return;
+	}
+
+	if (key == 'd') {
+		resolution.setEnabled(!resolution.isEnabled());
+		setupBuffers();
+		return;
+	}
+
+	if (key == 'g') {
+		quality.setEnabled(!quality.isEnabled());
+		ofLogNotice("testApp", string("quality governor ") + (quality.isEnabled() ? "on" : "off"));
+		return;
+	}
+
+	if (key == 'b') {
+		bloomMode = !bloomMode && bloom.isAllocated();
+		return;
+	}
+
+	if (key == 't') {
+		trailMode = !trailMode && trails.isAllocated();
+		trails.clear();
+		return;
+	}
+
 	campos_t.x = ofRandom(-600, 600);
 	campos_t.z = ofRandom(-600, 600);
 	campos_t.y = ofRandom(-100, 200);
@@ -643,6 +1111,8 @@ void testApp::mouseReleased(int x, int y, int button){
 
 //--------------------------------------------------------------
 void testApp::windowResized(int w, int h){
+	if (!offline.isEnabled())
+		setupBuffers();
 }
 
 //--------------------------------------------------------------
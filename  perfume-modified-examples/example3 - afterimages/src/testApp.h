@@ -2,6 +2,12 @@
 
 #include "ofMain.h"
 #include "ofxBvh.h"
+#include "ofxBvhStream.h"
+#include "OfflineRenderer.h"
+#include "Bloom.h"
+#include "Antialiasing.h"
+#include "DynamicResolution.h"
+#include "QualityGovernor.h"
 
 class testApp : public ofBaseApp{
 
@@ -9,6 +15,10 @@ class testApp : public ofBaseApp{
 	void setup();
 	void update();
 	void draw();
+	void drawScene();
+	void drawBloom();
+	void setupBuffers();
+	void exit();
 
 	void keyPressed  (int key);
 	void keyReleased(int key);
@@ -21,8 +31,24 @@ class testApp : public ofBaseApp{
 	void gotMessage(ofMessage msg);
 	
 	ofSoundPlayer track;
+	ofxBvhAudioClock audioClock;
 	vector<ofxBvh> bvh;
 	
+	// --stream <address> on the command line, one per figure; see ofxBvhStream.h
+	vector<string> streamAddresses;
+	vector<ofxBvhStream*> streams;
+	
 	ofCamera cam;
 	ofLight light;
+	
+	OfflineRenderer offline;
+	// glow pass the scene is drawn through; see Bloom.h
+	Bloom bloom;
+	// how lines and points are antialiased; see Antialiasing.h
+	Antialiasing antialiasing;
+	// fraction of the window the offscreen buffers are drawn at, picked from the GPU time; see DynamicResolution.h
+	DynamicResolution resolution;
+	// scales the density of the effects to hold the frame time; see QualityGovernor.h
+	QualityGovernor quality;
+	FrameCapture recorder;
 };
@@ -0,0 +1,342 @@
+// Compares the frame time of the three antialiasing modes of the examples (see Antialiasing.h) without
+// openFrameworks or a window, so it runs on headless machines and under llvmpipe as well as on a desktop driver.
+// Every frame draws a scene like example1's at full density - the figures as wide and narrow lines and joint points,
+// the bolts as layered line strips and the particles as points - into a 16 bit float buffer like the bloom scene
+// buffer, with the same blending, and waits for the GPU to finish:
+//
+//   smooth   GL_LINE_SMOOTH and GL_POINT_SMOOTH with NICEST hints
+//   msaa     a multisampled buffer, resolved into a plain one every frame as ofFbo does when it is read
+//   shader   the lines and points a pixel wider, through the shaders of Antialiasing.cpp
+//
+//   aabench [--frames 300] [--samples 4] [--width 1280] [--height 720]
+//   LIBGL_ALWAYS_SOFTWARE=1 aabench       // llvmpipe
+//
+// Needs EGL with a surfaceless platform (Mesa, and the NVIDIA driver):
+//
+//   g++ -O2 -o aabench aabench.cpp -lEGL -lGL
+
+#define GL_GLEXT_PROTOTYPES
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <sys/time.h>
+
+using namespace std;
+
+static const char *vertexSource =
+	"#version 120\n"
+	"uniform vec4 viewport;\n"
+	"varying vec3 center;\n"
+	"void main() {\n"
+	"	gl_FrontColor = gl_Color;\n"
+	"	gl_Position = ftransform();\n"
+	"	vec2 window = viewport.xy + (gl_Position.xy / gl_Position.w * 0.5 + 0.5) * viewport.zw;\n"
+	"	center = vec3(window * gl_Position.w, gl_Position.w);\n"
+	"}\n";
+
+static const char *fragmentSource =
+	"#version 120\n"
+	"uniform int primitive;\n"
+	"uniform float radius;\n"
+	"varying vec3 center;\n"
+	"void main() {\n"
+	"	float coverage = 1.0;\n"
+	"	if (primitive == 1)\n"
+	"		coverage = clamp(radius + 0.5 - length(gl_PointCoord - 0.5) * (2.0 * radius + 1.0), 0.0, 1.0);\n"
+	"	else if (primitive == 2)\n"
+	"		coverage = clamp(radius + 0.5 - length(gl_FragCoord.xy - center.xy / center.z), 0.0, 1.0);\n"
+	"	gl_FragColor = vec4(gl_Color.rgb, gl_Color.a * coverage);\n"
+	"}\n";
+
+enum Mode { SMOOTH, MULTISAMPLE, SHADER, NUM_MODES };
+static const char *modeNames[] = { "smooth", "msaa", "shader" };
+
+struct Point { float x, y, z; };
+
+static Mode mode;
+static GLuint program;
+static GLint primitiveLocation, radiusLocation, viewportLocation;
+
+static double now()
+{
+	timeval t;
+	gettimeofday(&t, NULL);
+	return t.tv_sec + t.tv_usec / 1000000.0;
+}
+
+static float random(float low, float high)
+{
+	return low + (high - low) * rand() / (float)RAND_MAX;
+}
+
+static Point randomPoint()
+{
+	Point p = { random(-400, 400), random(-50, 350), random(-300, 300) };
+	return p;
+}
+
+static void lineWidth(float width)
+{
+	if (mode != SHADER)
+	{
+		glLineWidth(width);
+		return;
+	}
+	glLineWidth(width + 1);
+	glUniform1i(primitiveLocation, 2);
+	glUniform1f(radiusLocation, width * 0.5f);
+}
+
+static void pointSize(float size)
+{
+	if (mode != SHADER)
+	{
+		glPointSize(size);
+		return;
+	}
+	glPointSize(size + 1);
+	glUniform1i(primitiveLocation, 1);
+	glUniform1f(radiusLocation, size * 0.5f);
+}
+
+static GLuint compile(GLenum type, const char *source)
+{
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+	GLint ok;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+	if (!ok)
+	{
+		char log[1024];
+		glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+		fprintf(stderr, "shader: %s\n", log);
+	}
+	return shader;
+}
+
+// the figures, bolts and particles of example1: 3 figures of 27 bones, 7 bolts of 20 segments in 3 layers drawn twice
+// per figure, and 3000 particles
+struct Scene
+{
+	vector<Point> bones, bolts, particles;
+
+	void setup()
+	{
+		for (int i = 0; i < 3 * 27; i++)
+		{
+			Point a = randomPoint(), b = a;
+			b.x += random(-40, 40); b.y += random(-40, 40); b.z += random(-40, 40);
+			bones.push_back(a);
+			bones.push_back(b);
+		}
+		for (int i = 0; i < 3 * 7; i++)
+		{
+			Point a = randomPoint(), b = randomPoint();
+			for (int k = 0; k <= 20; k++)
+			{
+				Point p = { a.x + (b.x - a.x) * k / 20 + random(-10, 10), a.y + (b.y - a.y) * k / 20 + random(-20, 20), a.z + (b.z - a.z) * k / 20 };
+				bolts.push_back(p);
+			}
+		}
+		for (int i = 0; i < 3000; i++)
+			particles.push_back(randomPoint());
+	}
+
+	void draw()
+	{
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+
+		// Tracker::drawFigure()
+		lineWidth(2);
+		glColor4f(0.87f, 0.87f, 0.87f, 0.2f);
+		drawLines(GL_LINES, bones);
+		lineWidth(10);
+		glColor4f(0.27f, 0.47f, 0.87f, 0.16f);
+		drawLines(GL_LINES, bones);
+		pointSize(15);
+		glColor4f(0.27f, 0.47f, 0.87f, 0.4f);
+		drawLines(GL_POINTS, bones);
+
+		// Tracker::drawBolts(), two passes of three layers
+		const float widths[] = { 4, 6, 10 };
+		for (int pass = 0; pass < 2; pass++)
+		{
+			for (int layer = 0; layer < 3; layer++)
+			{
+				lineWidth(widths[layer]);
+				glColor4f(0.4f, 0.4f, 0.9f, 0.3f);
+				for (int b = 0; b < bolts.size(); b += 21)
+				{
+					glBegin(GL_LINE_STRIP);
+					for (int k = 0; k < 21; k++)
+						glVertex3f(bolts[b + k].x, bolts[b + k].y, bolts[b + k].z);
+					glEnd();
+				}
+			}
+		}
+
+		// the particles
+		pointSize(3);
+		glColor4f(1, 1, 1, 0.6f);
+		drawLines(GL_POINTS, particles);
+	}
+
+	void drawLines(GLenum primitive, const vector<Point> &points)
+	{
+		glBegin(primitive);
+		for (int i = 0; i < points.size(); i++)
+			glVertex3f(points[i].x, points[i].y, points[i].z);
+		glEnd();
+	}
+};
+
+static GLuint createBuffer(int width, int height, int samples, GLuint &renderbuffer)
+{
+	GLuint fbo;
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glGenRenderbuffers(1, &renderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+	if (samples > 0)
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA16F, width, height);
+	else
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA16F, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		fprintf(stderr, "incomplete framebuffer with %d samples\n", samples);
+	return fbo;
+}
+
+int main(int argc, char *argv[])
+{
+	int frames = 300, samples = 4, width = 1280, height = 720;
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		if (strcmp(argv[i], "--frames") == 0) frames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--samples") == 0) samples = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--width") == 0) width = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--height") == 0) height = atoi(argv[++i]);
+	}
+
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	EGLDisplay display = getPlatformDisplay ? getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL) : eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+	{
+		fprintf(stderr, "no EGL display\n");
+		return 1;
+	}
+	eglBindAPI(EGL_OPENGL_API);
+	EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config;
+	EGLint numConfigs;
+	eglChooseConfig(display, configAttributes, &config, 1, &numConfigs);
+	EGLContext context = eglCreateContext(display, numConfigs > 0 ? config : EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, NULL);
+	if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+	{
+		fprintf(stderr, "no GL context\n");
+		return 1;
+	}
+	printf("%s, %s, %dx%d, %d frames per mode\n", glGetString(GL_RENDERER), glGetString(GL_VERSION), width, height, frames);
+
+	program = glCreateProgram();
+	glAttachShader(program, compile(GL_VERTEX_SHADER, vertexSource));
+	glAttachShader(program, compile(GL_FRAGMENT_SHADER, fragmentSource));
+	glLinkProgram(program);
+	primitiveLocation = glGetUniformLocation(program, "primitive");
+	radiusLocation = glGetUniformLocation(program, "radius");
+	viewportLocation = glGetUniformLocation(program, "viewport");
+
+	GLuint colorbuffer, multisampledColorbuffer;
+	GLuint plain = createBuffer(width, height, 0, colorbuffer);
+	GLint maxSamples;
+	glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+	samples = samples < maxSamples ? samples : maxSamples;
+	GLuint multisampled = createBuffer(width, height, samples, multisampledColorbuffer);
+
+	srand(1);
+	Scene scene;
+	scene.setup();
+
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	glFrustum(-width / 2000.0, width / 2000.0, -height / 2000.0, height / 2000.0, 1, 5000);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	glTranslatef(0, -150, -900);
+	glViewport(0, 0, width, height);
+	glEnable(GL_BLEND);
+
+	for (int m = 0; m < NUM_MODES; m++)
+	{
+		mode = (Mode)m;
+		double total = 0;
+		// the first frames warm up the driver's caches and shader variants
+		for (int frame = -10; frame < frames; frame++)
+		{
+			double start = now();
+
+			glBindFramebuffer(GL_FRAMEBUFFER, mode == MULTISAMPLE ? multisampled : plain);
+			glClearColor(0, 0, 0, 1);
+			glClear(GL_COLOR_BUFFER_BIT);
+
+			if (mode == SMOOTH)
+			{
+				glEnable(GL_LINE_SMOOTH);
+				glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
+				glEnable(GL_POINT_SMOOTH);
+				glHint(GL_POINT_SMOOTH_HINT, GL_NICEST);
+			}
+			else if (mode == MULTISAMPLE)
+				glEnable(GL_MULTISAMPLE);
+			else
+			{
+				glEnable(GL_POINT_SPRITE);
+				glUseProgram(program);
+				glUniform4f(viewportLocation, 0, 0, width, height);
+				glUniform1i(primitiveLocation, 0);
+			}
+
+			scene.draw();
+
+			if (mode == SMOOTH)
+			{
+				glDisable(GL_LINE_SMOOTH);
+				glDisable(GL_POINT_SMOOTH);
+			}
+			else if (mode == MULTISAMPLE)
+			{
+				glDisable(GL_MULTISAMPLE);
+				glBindFramebuffer(GL_READ_FRAMEBUFFER, multisampled);
+				glBindFramebuffer(GL_DRAW_FRAMEBUFFER, plain);
+				glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+			}
+			else
+			{
+				glUseProgram(0);
+				glDisable(GL_POINT_SPRITE);
+			}
+
+			glFinish();
+			if (frame >= 0)
+				total += now() - start;
+		}
+
+		if (mode == MULTISAMPLE)
+			printf("%-7s %7.2f ms per frame (%d samples)\n", modeNames[m], total / frames * 1000, samples);
+		else
+			printf("%-7s %7.2f ms per frame\n", modeNames[m], total / frames * 1000);
+	}
+
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglDestroyContext(display, context);
+	eglTerminate(display);
+	return 0;
+}
@@ -0,0 +1,278 @@
+// Streams a bvh file in real time, as a stand-in for a live motion capture feed (see ofxBvhStream in the examples).
+// The HIERARCHY and MOTION header is sent once per connection, then one frame line every Frame Time seconds.
+//
+//   bvhreplay [--port 7001 | --unix /tmp/bvh.sock | --stdout] [--rate 1] [--loop] file.bvh
+//
+//   bvhreplay --loop --port 7001 ../data/bvhfiles/aachan.bvh
+//   example1 --stream tcp://127.0.0.1:7001
+//
+//   bvhreplay --stdout ../data/bvhfiles/aachan.bvh | example1 --stream -
+//
+// Build with any C++ compiler, no other dependencies:
+//
+//   g++ -O2 -o bvhreplay bvhreplay.cpp
+//   cl /O2 bvhreplay.cpp ws2_32.lib
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <windows.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static double now()
+{
+#ifdef _WIN32
+	LARGE_INTEGER frequency, counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart / frequency.QuadPart;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+#endif
+}
+
+static void sleepUntil(double time)
+{
+	double wait = time - now();
+	if (wait <= 0) return;
+
+#ifdef _WIN32
+	Sleep((DWORD)(wait * 1000));
+#else
+	usleep((useconds_t)(wait * 1000000));
+#endif
+}
+
+static void closeSocket(int fd)
+{
+#ifdef _WIN32
+	closesocket(fd);
+#else
+	close(fd);
+#endif
+}
+
+// writes everything or fails; fd -1 is stdout
+static bool sendAll(int fd, const string& data)
+{
+	if (fd < 0)
+	{
+		size_t n = fwrite(data.data(), 1, data.size(), stdout);
+		fflush(stdout);
+		return n == data.size();
+	}
+
+	size_t sent = 0;
+	while (sent < data.size())
+	{
+		int n = send(fd, data.data() + sent, (int)(data.size() - sent), 0);
+		if (n <= 0) return false;
+		sent += n;
+	}
+
+	return true;
+}
+
+// plays the motion to one receiver; returns false when the receiver went away
+static bool play(int fd, const string& header, const vector<string>& frames, double frameTime, bool loop)
+{
+	if (!sendAll(fd, header)) return false;
+
+	double start = now();
+	long long frame = 0;
+
+	do
+	{
+		for (size_t i = 0; i < frames.size(); i++, frame++)
+		{
+			sleepUntil(start + frame * frameTime);
+
+			if (!sendAll(fd, frames[i] + "\n"))
+				return false;
+		}
+	}
+	while (loop);
+
+	return true;
+}
+
+static int usage()
+{
+	fprintf(stderr, "usage: bvhreplay [--port 7001 | --unix /tmp/bvh.sock | --stdout] [--rate 1] [--loop] file.bvh\n");
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	int port = 7001;
+	string unixPath;
+	bool toStdout = false;
+	bool loop = false;
+	double rate = 1;
+	string path;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+
+		if (arg == "--port" && i + 1 < argc)
+			port = atoi(argv[++i]);
+		else if (arg == "--unix" && i + 1 < argc)
+			unixPath = argv[++i];
+		else if (arg == "--stdout")
+			toStdout = true;
+		else if (arg == "--rate" && i + 1 < argc)
+			rate = atof(argv[++i]);
+		else if (arg == "--loop")
+			loop = true;
+		else if (arg[0] != '-')
+			path = arg;
+		else
+			return usage();
+	}
+
+	if (path.empty() || rate <= 0)
+		return usage();
+
+	// split the file into the header, up to and including "Frame Time:", and the frame lines
+	ifstream file(path.c_str());
+	if (!file)
+	{
+		fprintf(stderr, "bvhreplay: could not open %s\n", path.c_str());
+		return 1;
+	}
+
+	string header;
+	vector<string> frames;
+	double frameTime = 0;
+	bool inHeader = true;
+	string line;
+
+	while (getline(file, line))
+	{
+		if (!line.empty() && line[line.size() - 1] == '\r')
+			line.erase(line.size() - 1);
+
+		if (inHeader)
+		{
+			header += line + "\n";
+
+			if (line.compare(0, 11, "Frame Time:") == 0)
+			{
+				frameTime = atof(line.c_str() + 11);
+				inHeader = false;
+			}
+		}
+		else if (!line.empty())
+		{
+			frames.push_back(line);
+		}
+	}
+
+	if (frameTime <= 0 || frames.empty())
+	{
+		fprintf(stderr, "bvhreplay: %s is not a valid bvh file\n", path.c_str());
+		return 1;
+	}
+
+	frameTime /= rate;
+
+	if (toStdout)
+		return play(-1, header, frames, frameTime, loop) ? 0 : 1;
+
+#ifdef _WIN32
+	WSADATA wsa;
+	WSAStartup(MAKEWORD(2, 2), &wsa);
+
+	if (!unixPath.empty())
+	{
+		fprintf(stderr, "bvhreplay: unix sockets are not supported on this platform\n");
+		return 1;
+	}
+#else
+	signal(SIGPIPE, SIG_IGN);
+#endif
+
+	int server;
+
+#ifndef _WIN32
+	if (!unixPath.empty())
+	{
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, unixPath.c_str(), sizeof(addr.sun_path) - 1);
+		unlink(unixPath.c_str());
+
+		server = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (server < 0 || bind(server, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+		{
+			fprintf(stderr, "bvhreplay: could not bind %s\n", unixPath.c_str());
+			return 1;
+		}
+	}
+	else
+#endif
+	{
+		struct sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		server = socket(AF_INET, SOCK_STREAM, 0);
+
+		int one = 1;
+		setsockopt(server, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one));
+
+		if (server < 0 || bind(server, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+		{
+			fprintf(stderr, "bvhreplay: could not bind port %d\n", port);
+			return 1;
+		}
+	}
+
+	listen(server, 1);
+	fprintf(stderr, "bvhreplay: %d frames at %.1f fps, waiting for a receiver\n", (int)frames.size(), 1 / frameTime);
+
+	// one receiver at a time; each new one gets the header and the motion from the start
+	while (true)
+	{
+		int client = accept(server, NULL, NULL);
+		if (client < 0) continue;
+
+		// every frame is sent as soon as it is due instead of being held back to fill a packet
+		int one = 1;
+		if (unixPath.empty())
+			setsockopt(client, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+
+		fprintf(stderr, "bvhreplay: receiver connected\n");
+		play(client, header, frames, frameTime, loop);
+		fprintf(stderr, "bvhreplay: receiver disconnected\n");
+
+		closeSocket(client);
+	}
+
+	return 0;
+}